@@ -0,0 +1,180 @@
+#pragma once
+
+#include "common/rolling_hash.hpp"
+#include "common/hash_utils.hpp"
+#include "common/verify.hpp"
+#include "sequences/mapped_reader.hpp"
+#include "sequences/sequence.hpp"
+#include <experimental/filesystem>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace dbg {
+    //Binary checkpoints of graph construction: the list of junction hashes and the packed disjointigs.
+    //File layout: header (magic, construction parameters, record count, payload size and checksum) followed
+    //by the payload. Hash lists are stored as raw hash values. Disjointigs are stored as the list of their
+    //lengths followed by packed sequences, 2 bits per nucleotide, each padded to 8 bytes.
+    //Checkpoints are loaded through a memory mapping and verified against the checksum and the parameters of the run.
+    class ConstructionCheckpoint {
+    private:
+        struct Header {
+            char magic[8];
+            uint64_t k;
+            uint64_t w;
+            uint64_t hash_base;
+            uint64_t hash_size;
+            uint64_t count;
+            uint64_t payload_size;
+            uint64_t checksum;
+        };
+
+        static const char *hashsMagic() {
+            return "LJAVTX01";
+        }
+
+        static const char *disjointigsMagic() {
+            return "LJADJG01";
+        }
+
+        class Checksum {
+        private:
+            uint64_t value = 0x243f6a8885a308d3ull;
+        public:
+            void update(const uint64_t *words, size_t size) {
+                for(size_t i = 0; i < size; i++) {
+                    value ^= words[i];
+                    value = ((value << 31u) | (value >> 33u)) * 0x9e3779b97f4a7c15ull;
+                }
+            }
+
+            uint64_t get() const {
+                return value;
+            }
+        };
+
+        class Writer {
+        private:
+            std::experimental::filesystem::path path;
+            std::experimental::filesystem::path tmp;
+            std::ofstream os;
+            Header header{};
+            Checksum checksum;
+        public:
+            Writer(const std::experimental::filesystem::path &_path, const char *magic,
+                   const hashing::RollingHash &hasher, size_t w, size_t count) :
+                    path(_path), tmp(_path.string() + ".tmp") {
+                memcpy(header.magic, magic, sizeof(header.magic));
+                header.k = hasher.getK();
+                header.w = w;
+                header.hash_base = uint64_t(hasher.getBase());
+                header.hash_size = sizeof(hashing::htype);
+                header.count = count;
+                os.open(tmp, std::ios::binary);
+                VERIFY_MSG(os.is_open(), "Could not open file " << tmp << " for writing");
+                os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            }
+
+            void write(const uint64_t *words, size_t size) {
+                os.write(reinterpret_cast<const char *>(words), size * sizeof(uint64_t));
+                checksum.update(words, size);
+                header.payload_size += size * sizeof(uint64_t);
+            }
+
+            void close() {
+                header.checksum = checksum.get();
+                os.seekp(0);
+                os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                os.close();
+                VERIFY_MSG(!os.fail(), "Failed to write file " << tmp);
+                std::experimental::filesystem::rename(tmp, path);
+            }
+        };
+
+        static bool hasMagic(const std::experimental::filesystem::path &path, const char *magic) {
+            std::ifstream is(path, std::ios::binary);
+            char buf[8] = {};
+            is.read(buf, sizeof(buf));
+            return is.gcount() == sizeof(buf) && memcmp(buf, magic, sizeof(buf)) == 0;
+        }
+
+        static const uint64_t *open(const io::MappedFile &file, const char *magic,
+                                    const hashing::RollingHash &hasher, size_t w, size_t &count) {
+            VERIFY_MSG(file.size() >= sizeof(Header), "Checkpoint file is truncated");
+            Header header{};
+            memcpy(&header, file.data(), sizeof(header));
+            VERIFY_MSG(memcmp(header.magic, magic, sizeof(header.magic)) == 0, "Unexpected checkpoint file type");
+            VERIFY_MSG(header.k == hasher.getK() && header.hash_base == uint64_t(hasher.getBase()),
+                       "Checkpoint was constructed with k = " << header.k << " and hash base " << header.hash_base);
+            VERIFY_MSG(header.w == w, "Checkpoint was constructed with w = " << header.w << " instead of " << w);
+            VERIFY_MSG(header.hash_size == sizeof(hashing::htype),
+                       "Checkpoint was constructed with " << header.hash_size * 8 << "-bit hashes");
+            VERIFY_MSG(file.size() == sizeof(Header) + header.payload_size, "Checkpoint file is truncated");
+            const uint64_t *payload = reinterpret_cast<const uint64_t *>(file.data() + sizeof(Header));
+            Checksum checksum;
+            checksum.update(payload, header.payload_size / sizeof(uint64_t));
+            VERIFY_MSG(checksum.get() == header.checksum, "Checkpoint checksum mismatch, file is corrupted");
+            count = header.count;
+            return payload;
+        }
+
+    public:
+        static bool isHashs(const std::experimental::filesystem::path &path) {
+            return hasMagic(path, hashsMagic());
+        }
+
+        static bool isDisjointigs(const std::experimental::filesystem::path &path) {
+            return hasMagic(path, disjointigsMagic());
+        }
+
+        static void writeHashs(const std::experimental::filesystem::path &path, const hashing::RollingHash &hasher,
+                               size_t w, const std::vector<hashing::htype> &hashs) {
+            static_assert(sizeof(hashing::htype) % sizeof(uint64_t) == 0, "Unexpected hash size");
+            Writer writer(path, hashsMagic(), hasher, w, hashs.size());
+            writer.write(reinterpret_cast<const uint64_t *>(hashs.data()),
+                         hashs.size() * sizeof(hashing::htype) / sizeof(uint64_t));
+            writer.close();
+        }
+
+        static std::vector<hashing::htype> readHashs(const std::experimental::filesystem::path &path,
+                                                     const hashing::RollingHash &hasher, size_t w) {
+            io::MappedFile file(path);
+            size_t count = 0;
+            const uint64_t *payload = open(file, hashsMagic(), hasher, w, count);
+            std::vector<hashing::htype> res(count);
+            memcpy(res.data(), payload, count * sizeof(hashing::htype));
+            return std::move(res);
+        }
+
+        static void writeDisjointigs(const std::experimental::filesystem::path &path, const hashing::RollingHash &hasher,
+                                     size_t w, const std::vector<Sequence> &disjointigs) {
+            Writer writer(path, disjointigsMagic(), hasher, w, disjointigs.size());
+            std::vector<uint64_t> lengths;
+            for(const Sequence &seq : disjointigs)
+                lengths.emplace_back(seq.size());
+            writer.write(lengths.data(), lengths.size());
+            for(const Sequence &seq : disjointigs) {
+                std::vector<uint64_t> packed = seq.packed();
+                writer.write(packed.data(), packed.size());
+            }
+            writer.close();
+        }
+
+        static std::vector<Sequence> readDisjointigs(const std::experimental::filesystem::path &path,
+                                                     const hashing::RollingHash &hasher, size_t w) {
+            io::MappedFile file(path);
+            size_t count = 0;
+            const uint64_t *payload = open(file, disjointigsMagic(), hasher, w, count);
+            const uint64_t *words = payload + count;
+            std::vector<Sequence> res;
+            res.reserve(count);
+            for(size_t i = 0; i < count; i++) {
+                res.emplace_back(Sequence::FromPacked(words, payload[i]));
+                words += (payload[i] + 31) / 32;
+            }
+            VERIFY_MSG(reinterpret_cast<const char *>(words) == file.data() + file.size(), "Checkpoint file is corrupted");
+            return std::move(res);
+        }
+    };
+}
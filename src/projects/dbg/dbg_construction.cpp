@@ -1,41 +1,50 @@
 #include "graph_stats.hpp"
 #include "dbg_construction.hpp"
+#include "common/flat_hash_index.hpp"
+#include "common/radix_sort.hpp"
 
 using namespace hashing;
 using namespace dbg;
-std::vector<hashing::htype>
-findJunctions(logging::Logger &logger, const std::vector<Sequence> &disjointigs, const hashing::RollingHash &hasher,
-              size_t threads) {
-    bloom_parameters parameters;
-    parameters.projected_element_count = std::max(total_size(disjointigs) - hasher.getK() * disjointigs.size(), size_t(1000));
+//Long disjointigs are cut into pieces of 20k nucleotides overlapping by k so that they are processed in parallel.
+static std::vector<Sequence> splitDisjointigs(const std::vector<Sequence> &disjointigs, size_t k) {
     std::vector<Sequence> split_disjointigs;
     for(const Sequence &seq : disjointigs) {
-        if(seq.size() > hasher.getK() * 20) {
+        if(seq.size() > k * 20) {
             size_t cur = 0;
-            while(cur + hasher.getK() < seq.size()) {
-                split_disjointigs.emplace_back(seq.Subseq(cur, std::min(seq.size(), cur + hasher.getK() * 20)));
-                cur += hasher.getK() * 19;
+            while(cur + k < seq.size()) {
+                split_disjointigs.emplace_back(seq.Subseq(cur, std::min(seq.size(), cur + k * 20)));
+                cur += k * 19;
             }
         } else {
             split_disjointigs.emplace_back(seq);
         }
     }
+    return std::move(split_disjointigs);
+}
+
+std::vector<hashing::htype>
+findJunctions(logging::Logger &logger, const std::vector<Sequence> &disjointigs, const hashing::RollingHash &hasher,
+              size_t threads) {
+    bloom_parameters parameters;
+    parameters.projected_element_count = std::max(total_size(disjointigs) - hasher.getK() * disjointigs.size(), size_t(1000));
+    std::vector<Sequence> split_disjointigs = splitDisjointigs(disjointigs, hasher.getK());
     parameters.false_positive_probability = 0.0001;
     VERIFY(!!parameters);
     parameters.compute_optimal_parameters();
-    BloomFilter filter(parameters);
+    BlockedBloomFilter filter(parameters);
 //    DelayedBloomFilter filter(parameters, threads);
     const hashing::RollingHash ehasher = hasher.extensionHash();
     std::function<void(size_t, const Sequence &)> task = [&filter, &ehasher](size_t pos, const Sequence & seq) {
         if(seq.size() < ehasher.getK())
             return;
-        hashing::KWH kmer(ehasher, seq, 0);
-        while (true) {
-            filter.insert(kmer.hash());
-//            filter.delayedInsert(kmer.hash());
-            if (!kmer.hasNext())
-                break;
-            kmer = kmer.next();
+        hashing::KmerCursor kmer(ehasher, seq, 0);
+        hashing::KmerHash batch[256];
+        hashing::htype hashs[256];
+        size_t n;
+        while ((n = kmer.fill(batch, 256)) > 0) {
+            for (size_t i = 0; i < n; i++)
+                hashs[i] = batch[i].hash;
+            filter.insert(hashs, n);
         }
     };
     logger.info() << "Filling bloom filter with k+1-mers." << std::endl;
@@ -48,33 +57,129 @@ findJunctions(logging::Logger &logger, const std::vector<Sequence> &disjointigs,
     std::pair<size_t, size_t> bits = filter.count_bits();
     logger.info() << "Filled " << bits.first << " bits out of " << bits.second << std::endl;
     logger.info() << "Finished filling bloom filter. Selecting junctions." << std::endl;
-    ParallelRecordCollector<hashing::htype> junctions(threads);
+    ParallelRecordCollector<hashing::htype> junctions(threads, true);
     std::function<void(size_t, const Sequence &)> junk_task = [&filter, &hasher, &junctions](size_t pos, const Sequence & seq) {
-        KWH kmer(hasher, seq, 0);
+        KmerCursor kmer(hasher, seq, 0);
         size_t cnt = 0;
+        hashing::htype neighbours[8];
         while (true) {
-            size_t cnt1 = 0;
-            size_t cnt2 = 0;
             for (unsigned char c = 0; c < 4u; c++) {
-                cnt1 += filter.contains(kmer.extendRight(c));
-                cnt2 += filter.contains(kmer.extendLeft(c));
+                neighbours[c] = kmer.extendRight(c);
+                neighbours[c + 4] = kmer.extendLeft(c);
             }
+            uint32_t found = filter.containsBatch(neighbours, 8);
+            size_t cnt1 = __builtin_popcount(found & 0xfu);
+            size_t cnt2 = __builtin_popcount(found >> 4u);
             if (cnt1 != 1 || cnt2 != 1) {
                 cnt += 1;
                 junctions.emplace_back(kmer.hash());
             }
-            VERIFY(cnt1 <= 4 && cnt2 <= 4);
             if (!kmer.hasNext())
                 break;
-            kmer = kmer.next();
+            kmer.next();
         }
         if (cnt == 0) {
-            junctions.emplace_back(KWH(hasher, seq, 0).hash());
+            junctions.emplace_back(KmerCursor(hasher, seq, 0).hash());
         }
     };
 
     processRecords(split_disjointigs.begin(), split_disjointigs.end(), logger, threads, junk_task);
+    std::vector<hashing::htype> res = junctions.collectUnique();
+    logger.info() << "Collected " << res.size() << " junctions." << std::endl;
+    return res;
+}
+
+//Every k-mer occurrence emits its canonical hash with the masks of its neighbours in the sequence: bit c is set for
+//outgoing nucleotide c and bit 4 + c for incoming nucleotide c. Records are split into 256 partitions by the top byte
+//of the hash. Since all hashes of a partition share the top byte, the mask is stored in its place and every record
+//takes a single hash. Only the partitions of one round are kept in memory at a time. Since canonical hashes are skewed
+//towards small values, rounds are sized for twice the average partition. Without a memory limit rounds are sized for
+//default_round_bytes. Each partition is radix sorted, and the masks of equal hashes are merged to get exact in and
+//out degrees.
+std::vector<hashing::htype>
+findJunctionsExact(logging::Logger &logger, const std::vector<Sequence> &disjointigs, const hashing::RollingHash &hasher,
+                   size_t threads, size_t max_memory) {
+    const size_t partitions = 256;
+    const size_t top_shift = sizeof(htype) * 8 - 8;
+    const size_t default_round_bytes = size_t(4) << 30u;
+    const htype low_mask = (htype(1) << top_shift) - 1;
+    size_t k = hasher.getK();
+    std::vector<Sequence> split_disjointigs = splitDisjointigs(disjointigs, k);
+    size_t record_bytes = total_size(split_disjointigs) * sizeof(htype);
+    size_t round_bytes = max_memory == 0 ? default_round_bytes : max_memory;
+    size_t rounds = std::min(partitions, record_bytes * 2 / round_bytes + 1);
+    logger.info() << "Collecting exact k-mer extensions in " << rounds << " rounds of "
+                  << partitions / rounds << " partitions" << std::endl;
+    ParallelRecordCollector<hashing::htype> junctions(threads);
+    for(size_t round = 0; round < rounds; round++) {
+        size_t from = partitions * round / rounds;
+        size_t to = partitions * (round + 1) / rounds;
+        std::vector<std::vector<std::vector<htype>>> buffers(threads, std::vector<std::vector<htype>>(to - from));
+        std::function<void(size_t, const Sequence &)> emit_task =
+                [&buffers, &hasher, k, from, to, top_shift, low_mask](size_t pos, const Sequence &seq) {
+            if(seq.size() < k)
+                return;
+            std::vector<std::vector<htype>> &buffer = buffers[omp_get_thread_num()];
+            KmerCursor kmer(hasher, seq, 0);
+            while(true) {
+                size_t partition = size_t(kmer.hash() >> top_shift);
+                if(partition >= from && partition < to) {
+                    unsigned char mask = 0;
+                    if(kmer.pos + k < seq.size())
+                        mask |= kmer.isCanonical() ? 1u << seq[kmer.pos + k] : 16u << (seq[kmer.pos + k] ^ 3u);
+                    if(kmer.pos > 0)
+                        mask |= kmer.isCanonical() ? 16u << seq[kmer.pos - 1] : 1u << (seq[kmer.pos - 1] ^ 3u);
+                    buffer[partition - from].push_back((kmer.hash() & low_mask) | (htype(mask) << top_shift));
+                }
+                if(!kmer.hasNext())
+                    break;
+                kmer.next();
+            }
+        };
+        processRecords(split_disjointigs.begin(), split_disjointigs.end(), logger, threads, emit_task);
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1) shared(buffers, junctions, from, to, threads, top_shift, low_mask)
+        for(size_t p = 0; p < to - from; p++) {
+            std::vector<htype> records = std::move(buffers[0][p]);
+            for(size_t t = 1; t < threads; t++) {
+                records.insert(records.end(), buffers[t][p].begin(), buffers[t][p].end());
+                buffers[t][p] = {};
+            }
+            radixSort(records, [](htype rec) {return rec;}, 0, sizeof(htype) - 1);
+            for(size_t i = 0; i < records.size();) {
+                htype hash = records[i] & low_mask;
+                unsigned char mask = 0;
+                size_t j = i;
+                for(; j < records.size() && (records[j] & low_mask) == hash; j++)
+                    mask |= (unsigned char)(records[j] >> top_shift);
+                if(__builtin_popcount(mask & 0xfu) != 1 || __builtin_popcount(mask >> 4u) != 1)
+                    junctions.emplace_back(hash | (htype(from + p) << top_shift));
+                i = j;
+            }
+        }
+    }
     std::vector<hashing::htype> res = junctions.collect();
+    std::vector<std::pair<hashing::htype, bool>> index_records;
+    for(hashing::htype hash : res)
+        index_records.emplace_back(hash, true);
+    FlatHashIndex<hashing::htype, bool, hashing::alt_hasher<hashing::htype>> index;
+    index.add(std::move(index_records), threads);
+//    Pieces of perfect cycles have no junctions, so their first k-mer is made a junction as in findJunctions.
+    std::function<void(size_t, const Sequence &)> cycle_task = [&index, &hasher, &junctions, k](size_t pos, const Sequence &seq) {
+        if(seq.size() < k)
+            return;
+        KmerCursor kmer(hasher, seq, 0);
+        while(!index.contains(kmer.hash())) {
+            if(!kmer.hasNext()) {
+                junctions.emplace_back(KmerCursor(hasher, seq, 0).hash());
+                return;
+            }
+            kmer.next();
+        }
+    };
+    processRecords(split_disjointigs.begin(), split_disjointigs.end(), logger, threads, cycle_task);
+    std::vector<hashing::htype> cycles = junctions.collect();
+    res.insert(res.end(), cycles.begin(), cycles.end());
     __gnu_parallel::sort(res.begin(), res.end());
     res.erase(std::unique(res.begin(), res.end()), res.end());
     logger.info() << "Collected " << res.size() << " junctions." << std::endl;
@@ -84,7 +189,7 @@ findJunctions(logging::Logger &logger, const std::vector<Sequence> &disjointigs,
 SparseDBG constructDBG(logging::Logger &logger, const std::vector<hashing::htype> &vertices, const std::vector<Sequence> &disjointigs,
              const RollingHash &hasher, size_t threads) {
     logger.info() << "Starting DBG construction." << std::endl;
-    SparseDBG dbg(vertices.begin(), vertices.end(), hasher);
+    SparseDBG dbg(vertices.begin(), vertices.end(), hasher, threads);
     logger.info() << "Vertices created." << std::endl;
     std::function<void(size_t, Sequence &)> edge_filling_task = [&dbg](size_t pos, Sequence & seq) {
         dbg.processRead(seq);
@@ -117,6 +222,8 @@ SparseDBG constructDBG(logging::Logger &logger, const std::vector<hashing::htype
     logger.info() << "Merging unbranching paths" << std::endl;
     mergeAll(logger, dbg, threads);
     logger.info() << "Ended merging edges. Resulting size " << dbg.size() << std::endl;
+//    Edges of the merged graph stay for the whole phase, pieces it was merged from are already freed
+    dbg.moveToArena(logger, threads);
     logger.trace() << "Statistics for de Bruijn graph:" << std::endl;
     printStats(logger, dbg);
     return std::move(dbg);
@@ -142,6 +249,7 @@ inline std::vector<htype> readHashs(std::istream &is) {
             result.push_back(tmp);
         }
     } else {
+        VERIFY_MSG(sizeof(htype) == 2 * sizeof(size_t), "Legacy vertex files can only be read with 128-bit hashes");
         size_t len = std::stoull(first);
         size_t a[2];
         for (size_t i = 0; i < len; i++) {
@@ -155,14 +263,21 @@ inline std::vector<htype> readHashs(std::istream &is) {
 
 SparseDBG DBGPipeline(logging::Logger &logger, const RollingHash &hasher, size_t w, const io::Library &lib,
                       const std::experimental::filesystem::path &dir, size_t threads, const string &disjointigs_file,
-                      const string &vertices_file) {
+                      const string &vertices_file, size_t max_memory, bool exact_junctions) {
     std::experimental::filesystem::path df;
+    std::vector<Sequence> disjointigs;
+    bool in_memory = false;
     if (disjointigs_file == "none") {
-        std::function<void()> task = [&logger, &lib, &threads, &w, &dir, &hasher]() {
+//        Without fork isolation the task runs in this process and its disjointigs are used directly. The checkpoint
+//        and the fasta file are written in both cases.
+        std::function<void()> task = [&logger, &lib, &threads, &w, &dir, &hasher, max_memory, &disjointigs, &in_memory]() {
             std::vector<hashing::htype> hash_list;
             hash_list = constructMinimizers(logger, lib, threads, hasher, w);
-            std::vector<Sequence> disjointigs = constructDisjointigs(hasher, w, lib, hash_list, threads, logger);
-            hash_list.clear();
+            disjointigs = max_memory == 0 ?
+                    constructDisjointigs(hasher, w, lib, hash_list, threads, logger) :
+                    constructDisjointigsInBuckets(hasher, w, lib, hash_list, threads, logger, max_memory, dir);
+            hash_list = {};
+            ConstructionCheckpoint::writeDisjointigs(dir / "disjointigs.bin", hasher, w, disjointigs);
             std::ofstream df;
             df.open(dir / "disjointigs.fasta");
             for (size_t i = 0; i < disjointigs.size(); i++) {
@@ -170,31 +285,40 @@ SparseDBG DBGPipeline(logging::Logger &logger, const RollingHash &hasher, size_t
                 df << disjointigs[i] << std::endl;
             }
             df.close();
+            in_memory = true;
         };
-        runInFork(task);
-        df = dir / "disjointigs.fasta";
+        runIsolated(task);
+        df = dir / "disjointigs.bin";
     } else {
         df = disjointigs_file;
     }
-    logger.info() << "Loading disjointigs from file " << df << std::endl;
-    io::SeqReader reader(df);
-    std::vector<Sequence> disjointigs;
-    while(!reader.eof()) {
-        disjointigs.push_back(reader.read().makeSequence());
+    if (in_memory) {
+        logger.info() << "Using " << disjointigs.size() << " disjointigs constructed in memory" << std::endl;
+    } else if (ConstructionCheckpoint::isDisjointigs(df)) {
+        logger.info() << "Loading disjointigs from file " << df << std::endl;
+        disjointigs = ConstructionCheckpoint::readDisjointigs(df, hasher, w);
+    } else {
+        logger.info() << "Loading disjointigs from file " << df << std::endl;
+        io::SeqReader reader(df);
+        while(!reader.eof()) {
+            disjointigs.push_back(reader.read().makeSequence());
+        }
     }
     std::vector<hashing::htype> vertices;
     if (vertices_file == "none") {
-        vertices = findJunctions(logger, disjointigs, hasher, threads);
-        std::ofstream os;
-        os.open(std::string(dir.c_str()) + "/vertices.save");
-        writeHashs(os, vertices);
-        os.close();
+        vertices = exact_junctions ? findJunctionsExact(logger, disjointigs, hasher, threads, max_memory) :
+                   findJunctions(logger, disjointigs, hasher, threads);
+        ConstructionCheckpoint::writeHashs(dir / "vertices.bin", hasher, w, vertices);
     } else {
         logger.info() << "Loading vertex hashs from file " << vertices_file << std::endl;
-        std::ifstream is;
-        is.open(vertices_file);
-        vertices = readHashs(is);
-        is.close();
+        if (ConstructionCheckpoint::isHashs(vertices_file)) {
+            vertices = ConstructionCheckpoint::readHashs(vertices_file, hasher, w);
+        } else {
+            std::ifstream is;
+            is.open(vertices_file);
+            vertices = readHashs(is);
+            is.close();
+        }
     }
     return std::move(constructDBG(logger, vertices, disjointigs, hasher, threads));
 }
@@ -5,6 +5,7 @@
 
 #include "minimizer_selection.hpp"
 #include "dbg_disjointigs.hpp"
+#include "dbg_checkpoint.hpp"
 #include "sparse_dbg.hpp"
 #include "common/rolling_hash.hpp"
 #include "sequences/sequence.hpp"
@@ -17,8 +18,13 @@
 
 std::vector<hashing::htype> findJunctions(logging::Logger & logger, const std::vector<Sequence>& disjointigs,
                                  const hashing::RollingHash &hasher, size_t threads);
+//Exact alternative to findJunctions without Bloom filter false positives. A non zero max_memory bounds the memory
+//taken by k-mer records.
+std::vector<hashing::htype> findJunctionsExact(logging::Logger & logger, const std::vector<Sequence>& disjointigs,
+                                      const hashing::RollingHash &hasher, size_t threads, size_t max_memory = 0);
 dbg::SparseDBG constructDBG(logging::Logger & logger, const std::vector<hashing::htype> &vertices,
                        const std::vector<Sequence> &disjointigs, const hashing::RollingHash &hasher, size_t threads);
 dbg::SparseDBG DBGPipeline(logging::Logger & logger, const hashing::RollingHash &hasher, size_t w, const io::Library &lib,
                                 const std::experimental::filesystem::path &dir, size_t threads,
-                                const std::string& disjointigs_file = "none", const std::string &vertices_file = "none");
\ No newline at end of file
+                                const std::string& disjointigs_file = "none", const std::string &vertices_file = "none",
+                                size_t max_memory = 0, bool exact_junctions = false);
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "dbg_disjointigs.hpp"
 #include "graph_stats.hpp"
+#include "dbg_checkpoint.hpp"
+#include <atomic>
+#include <parallel/algorithm>
+#include <tuple>
 
 using namespace hashing;
 using namespace dbg;
@@ -166,3 +170,232 @@ std::vector<Sequence> constructDisjointigs(const RollingHash &hasher, size_t w,
     disjointigs = extractDisjointigs(logger, sdbg, threads);
     return disjointigs;
 }
+
+//Minimizers in hash_list[from, to). Vertices are looked up by their canonical hash so both orientations of a vertex
+//always fall into the same bucket.
+static std::function<bool(const Vertex &)> bucketFilter(const std::vector<htype> &hash_list, size_t from, size_t to) {
+    htype lo = hash_list[from];
+    htype hi = to < hash_list.size() ? hash_list[to] : hash_list.back();
+    bool last = to == hash_list.size();
+    return [lo, hi, last](const Vertex &vertex) {
+        return vertex.hash() >= lo && (vertex.hash() < hi || (last && vertex.hash() == hi));
+    };
+}
+
+//Streams all reads and fills the edges of bucket vertices. Returns an estimate of the memory taken by the edges.
+static size_t fillBucket(SparseDBG &sdbg, const io::Library &reads_file, size_t w,
+                         const std::function<bool(const Vertex &)> &filter, logging::Logger &logger, size_t threads) {
+    size_t k = sdbg.hasher().getK();
+    io::ProcessReads(reads_file, (k + w) * 20, (k + w) * 4, [&](auto begin, auto end) {
+        typedef typename decltype(begin)::value_type ContigType;
+        std::function<void(size_t, ContigType &)> task = [&sdbg, &filter, k, w](size_t pos, ContigType &contig) {
+            Sequence seq = contig.makeSequence();
+            if (seq.size() >= k + w - 1)
+                sdbg.processRead(seq, filter);
+        };
+        processRecords(begin, end, logger, threads, task);
+    });
+    std::atomic<size_t> bytes(0);
+    std::function<void(size_t, std::pair<const htype, Vertex> &)> task =
+            [&filter, &bytes](size_t pos, std::pair<const htype, Vertex> &pair) {
+                if(!filter(pair.second))
+                    return;
+                size_t cnt = 0;
+                for(Vertex *vertex : {&pair.second, &pair.second.rc()}) {
+                    for(const Edge &edge : *vertex)
+                        cnt += sizeof(Edge) + edge.size() / 4;
+                }
+                bytes += cnt;
+            };
+    processObjects(sdbg.begin(), sdbg.end(), logger, threads, task);
+    return bytes;
+}
+
+//Every edge of a bucket vertex becomes a disjointig together with its start k-mer. An edge and its reverse complement
+//are stored at different vertices, possibly in different buckets, and only the canonical one of them is reported.
+//Tips are stored at a single vertex and are always reported. Edges and vertex sequences of the bucket are released.
+static void extractBucket(SparseDBG &sdbg, const std::function<bool(const Vertex &)> &filter,
+                          ParallelRecordCollector<Sequence> &res, logging::Logger &logger, size_t threads) {
+    std::function<void(size_t, std::pair<const htype, Vertex> &)> task =
+            [&filter, &res](size_t pos, std::pair<const htype, Vertex> &pair) {
+                if(!filter(pair.second))
+                    return;
+                for(Vertex *vertex : {&pair.second, &pair.second.rc()}) {
+                    for(const Edge &edge : *vertex) {
+                        Sequence seq = vertex->seq + edge.seq;
+                        if(edge.end() == nullptr || *vertex < edge.end()->rc() ||
+                                (*vertex == edge.end()->rc() && seq <= !seq))
+                            res.add(seq);
+                    }
+                }
+                pair.second.clear();
+                pair.second.clearSequence();
+            };
+    processObjects(sdbg.begin(), sdbg.end(), logger, threads, task);
+}
+
+//Disjointigs of a bucket are moved to disk so that they do not take memory while the next buckets are filled.
+static void spillBucket(ParallelRecordCollector<Sequence> &res, const RollingHash &hasher, size_t w,
+                        std::vector<std::experimental::filesystem::path> &spilled,
+                        const std::experimental::filesystem::path &dir) {
+    std::vector<Sequence> disjointigs = res.collect();
+    if(disjointigs.empty())
+        return;
+    spilled.emplace_back(dir / ("bucket_" + std::to_string(spilled.size()) + ".bin"));
+    ConstructionCheckpoint::writeDisjointigs(spilled.back(), hasher, w, disjointigs);
+}
+
+//Edge disjointigs overlap by a k-mer at every vertex. Any piece that ends at a minimizer vertex can be glued to any
+//piece that starts there: the k-mers spelled stay the same and one copy of the vertex k-mer is dropped. At every
+//vertex pieces are glued pairwise unless a pair would close a cycle. Oriented piece 2 * i + r is piece i, reverse
+//complemented if r is 1. Pieces are released as soon as they are copied into the result.
+static std::vector<Sequence> stitchDisjointigs(std::vector<Sequence> &&pieces, const RollingHash &hasher,
+                                               const std::vector<htype> &hash_list, logging::Logger &logger,
+                                               size_t threads) {
+    const size_t none = size_t(-1);
+    size_t k = hasher.getK();
+    size_t n = pieces.size();
+//    Ends are listed at the canonical orientation of their vertex as (hash, outgoing, oriented piece)
+    ParallelRecordCollector<std::tuple<htype, bool, size_t>> ends(threads);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(pieces, hasher, hash_list, ends, n, k)
+    for(size_t i = 0; i < n; i++) {
+        const Sequence &seq = pieces[i];
+        if(seq.size() <= k)
+            continue;
+        for(const KWH &kwh : {KWH(hasher, seq, 0), KWH(hasher, seq, seq.size() - k)}) {
+            if(!std::binary_search(hash_list.begin(), hash_list.end(), kwh.hash()))
+                continue;
+            bool out = kwh.pos == 0;
+            ends.emplace_back(kwh.hash(), out == kwh.isCanonical(), 2 * i + size_t(!kwh.isCanonical()));
+        }
+    }
+    std::vector<std::tuple<htype, bool, size_t>> sorted = ends.collect();
+    __gnu_parallel::sort(sorted.begin(), sorted.end());
+    std::vector<size_t> next(2 * n, none);
+    std::vector<size_t> component(n);
+    for(size_t i = 0; i < n; i++)
+        component[i] = i;
+    std::function<size_t(size_t)> find = [&component](size_t i) {
+        while(component[i] != i) {
+            component[i] = component[component[i]];
+            i = component[i];
+        }
+        return i;
+    };
+    size_t glued = 0;
+    for(size_t left = 0; left < sorted.size();) {
+        size_t mid = left;
+        while(mid < sorted.size() && std::get<0>(sorted[mid]) == std::get<0>(sorted[left]) && !std::get<1>(sorted[mid]))
+            mid++;
+        size_t right = mid;
+        while(right < sorted.size() && std::get<0>(sorted[right]) == std::get<0>(sorted[left]))
+            right++;
+        size_t out = mid;
+        for(size_t in = left; in < mid && out < right; in++) {
+            size_t from = std::get<2>(sorted[in]);
+            size_t to = std::get<2>(sorted[out]);
+            if(find(from / 2) == find(to / 2))
+                continue;
+            next[from] = to;
+            next[to ^ 1u] = from ^ 1u;
+            component[find(from / 2)] = find(to / 2);
+            glued++;
+            out++;
+        }
+        left = right;
+    }
+    sorted = {};
+    std::vector<Sequence> res;
+    for(size_t i = 0; i < n; i++) {
+        if(pieces[i].empty())
+            continue;
+        size_t cur = 2 * i;
+        while(next[cur ^ 1u] != none)
+            cur = next[cur ^ 1u] ^ 1u;
+        SequenceBuilder sb;
+        for(bool first = true; cur != none; cur = next[cur], first = false) {
+            Sequence seq = cur % 2 == 0 ? pieces[cur / 2] : !pieces[cur / 2];
+            sb.append(first ? seq : seq.Subseq(k));
+            pieces[cur / 2] = Sequence();
+        }
+        res.emplace_back(sb.BuildSequence());
+    }
+    logger.info() << "Glued " << n << " edge disjointigs into " << res.size() << " disjointigs, total size reduced by "
+                  << glued * k << std::endl;
+    return std::move(res);
+}
+
+//Rough size of a vertex with both orientations, their k-mers and a hash map slot.
+static size_t vertexBytes(size_t k) {
+    return sizeof(std::pair<const htype, Vertex>) * 2 + sizeof(Vertex) + 2 * (k / 4 + 8);
+}
+
+//Memory bounded construction. All minimizer vertices are kept, but edges are only built for one range of minimizer
+//hashes at a time, streaming the reads once per range. A small first range is used to estimate the edge memory of the
+//whole graph. If the estimate fits into the budget the usual in memory construction is used. Otherwise every edge of
+//the sparse graph is reported as a separate disjointig, which spells the same set of k-mers as merged disjointigs.
+//Disjointigs of every bucket are written to dir, read back one file at a time once the sparse graph is released and
+//glued at shared vertices, so that the result is not much longer than the disjointigs of the in memory construction.
+std::vector<Sequence> constructDisjointigsInBuckets(const RollingHash &hasher, size_t w, const io::Library &reads_file,
+                                                    const std::vector<htype> &hash_list, size_t threads,
+                                                    logging::Logger &logger, size_t max_memory,
+                                                    const std::experimental::filesystem::path &dir) {
+    if(hash_list.empty())
+        return constructDisjointigs(hasher, w, reads_file, hash_list, threads, logger);
+    size_t vertex_bytes = hash_list.size() * vertexBytes(hasher.getK());
+    size_t edge_budget = max_memory - std::min(max_memory, vertex_bytes);
+    if(edge_budget < max_memory / 4) {
+        logger.info() << "WARNING: vertices of the sparse graph take about " << (vertex_bytes >> 30u)
+                      << "Gb which is close to the memory limit of " << (max_memory >> 30u) << "Gb" << std::endl;
+        edge_budget = std::max<size_t>(max_memory / 4, 1);
+    }
+    logger.info() << "Starting bucketed construction of sparse de Bruijn graph with memory limit "
+                  << (max_memory >> 20u) << "Mb" << std::endl;
+    SparseDBG sdbg(hash_list.begin(), hash_list.end(), hasher, threads);
+    logger.info() << "Vertex map constructed." << std::endl;
+    ParallelRecordCollector<Sequence> res(threads);
+    size_t sample = std::max<size_t>(hash_list.size() / 64, 1);
+    std::function<bool(const Vertex &)> filter = bucketFilter(hash_list, 0, sample);
+    size_t sample_bytes = fillBucket(sdbg, reads_file, w, filter, logger, threads);
+    size_t estimate = size_t(double(sample_bytes) * hash_list.size() / sample);
+    logger.info() << "Edges of " << sample << " minimizers take " << (sample_bytes >> 20u)
+                  << "Mb. Estimated size of all edges is " << (estimate >> 20u) << "Mb" << std::endl;
+    if(estimate <= edge_budget) {
+        logger.info() << "Sparse graph fits into memory limit. Switching to regular construction." << std::endl;
+        sdbg = SparseDBG(hasher);
+        return constructDisjointigs(hasher, w, reads_file, hash_list, threads, logger);
+    }
+    std::vector<std::experimental::filesystem::path> spilled;
+    extractBucket(sdbg, filter, res, logger, threads);
+    spillBucket(res, hasher, w, spilled, dir);
+    size_t rest = hash_list.size() - sample;
+    size_t buckets = std::min((estimate - sample_bytes + edge_budget - 1) / edge_budget, std::max<size_t>(rest, 1));
+    logger.info() << "Splitting remaining " << rest << " minimizers into " << buckets << " buckets" << std::endl;
+    for(size_t i = 0; i < buckets; i++) {
+        size_t from = sample + rest * i / buckets;
+        size_t to = sample + rest * (i + 1) / buckets;
+        if(from == to)
+            continue;
+        filter = bucketFilter(hash_list, from, to);
+        size_t bytes = fillBucket(sdbg, reads_file, w, filter, logger, threads);
+        logger.info() << "Bucket " << (i + 1) << " of " << buckets << ": edges of " << (to - from)
+                      << " minimizers take " << (bytes >> 20u) << "Mb" << std::endl;
+        extractBucket(sdbg, filter, res, logger, threads);
+        spillBucket(res, hasher, w, spilled, dir);
+    }
+    sdbg = SparseDBG(hasher);
+    std::vector<Sequence> pieces;
+    for(const std::experimental::filesystem::path &path : spilled) {
+        std::vector<Sequence> bucket = ConstructionCheckpoint::readDisjointigs(path, hasher, w);
+        pieces.insert(pieces.end(), std::make_move_iterator(bucket.begin()), std::make_move_iterator(bucket.end()));
+        std::experimental::filesystem::remove(path);
+    }
+    logger.info() << "Extracted " << pieces.size() << " edge disjointigs of total size " << total_size(pieces) << std::endl;
+    std::vector<Sequence> rres = stitchDisjointigs(std::move(pieces), hasher, hash_list, logger, threads);
+    std::sort(rres.begin(), rres.end(), [] (const Sequence& lhs, const Sequence& rhs) {
+        return lhs.size() > rhs.size();
+    });
+    logger.info() << "Finished extracting " << rres.size() << " disjointigs of total size " << total_size(rres) << std::endl;
+    return rres;
+}
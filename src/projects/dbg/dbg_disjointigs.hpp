@@ -18,4 +18,9 @@ void extractCircularDisjointigs(dbg::SparseDBG &sdbg, ParallelRecordCollector<Se
 std::vector<Sequence> extractDisjointigs(logging::Logger & logger, dbg::SparseDBG &sdbg, size_t threads);
 std::vector<Sequence> constructDisjointigs(const hashing::RollingHash &hasher, size_t w, const io::Library &reads_file,
                                            const std::vector<hashing::htype> & hash_list, size_t threads,
-                                           logging::Logger & logger);
\ No newline at end of file
+                                           logging::Logger & logger);
+std::vector<Sequence> constructDisjointigsInBuckets(const hashing::RollingHash &hasher, size_t w,
+                                                    const io::Library &reads_file,
+                                                    const std::vector<hashing::htype> &hash_list, size_t threads,
+                                                    logging::Logger &logger, size_t max_memory,
+                                                    const std::experimental::filesystem::path &dir);
\ No newline at end of file
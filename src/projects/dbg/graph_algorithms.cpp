@@ -31,51 +31,69 @@ namespace dbg {
                                           const RollingHash &hasher, const std::vector<htype> &hash_list,
                                           const size_t w) {
         logger.info() << "Starting construction of sparse de Bruijn graph" << std::endl;
-        SparseDBG sdbg(hash_list.begin(), hash_list.end(), hasher);
+        SparseDBG sdbg(hash_list.begin(), hash_list.end(), hasher, threads);
         logger.info() << "Vertex map constructed." << std::endl;
-        io::SeqReader reader(reads_file, (hasher.getK() + w) * 20, (hasher.getK() + w) * 4);
         logger.info() << "Filling edge sequences." << std::endl;
-        FillSparseDBGEdges(sdbg, reader.begin(), reader.end(), logger, threads, w + hasher.getK() - 1);
+        io::ProcessReads(reads_file, (hasher.getK() + w) * 20, (hasher.getK() + w) * 4, [&](auto begin, auto end) {
+            FillSparseDBGEdges(sdbg, begin, end, logger, threads, w + hasher.getK() - 1);
+        });
         logger.info() << "Finished sparse de Bruijn graph construction." << std::endl;
         return std::move(sdbg);
     }
 
+//    Tips are tied by adding a vertex at the last k-mer of every tip. Only the tip ends are materialized to find the new
+//    vertices. Then every old vertex rebuilds its own edges in parallel: old edges are split at new vertices reusing
+//    their sequences and tips are reinserted as reads. Edges are only added to the vertex being rebuilt and to new
+//    vertices, which never have old edges, so vertices do not need to be cleared all at once.
     void tieTips(logging::Logger &logger, SparseDBG &sdbg, size_t w, size_t threads) {
         logger.info() << " Collecting tips " << std::endl;
-//    TODO reduce memory consumption!! A lot of duplicated k-mer storing
-        ParallelRecordCollector<std::pair<Vertex *, Sequence>> old_edges(threads);
-        ParallelRecordCollector<Sequence> new_edges(threads);
         ParallelRecordCollector<htype> new_minimizers(threads);
-        std::function<void(size_t, std::pair<const htype, Vertex> &)> task =
-                [&sdbg, &old_edges, &new_minimizers, &new_edges](size_t pos, std::pair<const htype, Vertex> &pair) {
+        std::function<void(size_t, std::pair<const htype, Vertex> &)> collect_task =
+                [&sdbg, &new_minimizers](size_t pos, std::pair<const htype, Vertex> &pair) {
                     Vertex &cvertex = pair.second;
+                    size_t k = sdbg.hasher().getK();
                     for (auto *vit: {&cvertex, &cvertex.rc()}) {
                         Vertex &vertex = *vit;
                         VERIFY(!vertex.seq.empty());
                         for (const Edge &ext: vertex) {
                             if (ext.end() == nullptr) {
-                                Sequence seq = vertex.seq + ext.seq;
-                                KWH kwh(sdbg.hasher(), seq, ext.size());
-                                new_edges.add(seq);
-                                new_minimizers.emplace_back(kwh.hash());
-                            } else {
-                                old_edges.add({&vertex, ext.seq});
+                                Sequence kmer = ext.size() >= k ? ext.seq.Subseq(ext.size() - k) :
+                                                vertex.seq.Subseq(ext.size()) + ext.seq;
+                                new_minimizers.emplace_back(KWH(sdbg.hasher(), kmer, 0).hash());
                             }
                         }
                     }
-                    cvertex.clear();
                 };
-        processObjects(sdbg.begin(), sdbg.end(), logger, threads, task);
+        processObjects(sdbg.begin(), sdbg.end(), logger, threads, collect_task);
         logger.info() << "Added " << new_minimizers.size() << " artificial minimizers from tips." << std::endl;
-        logger.info() << "Collected " << old_edges.size() << " old edges." << std::endl;
-        for (auto it = new_minimizers.begin(); it != new_minimizers.end(); ++it) {
-            sdbg.addVertex(*it);
-        }
+//        Vertices are stored in insertion order so the new ones are placed after old_end
+        SparseDBG::vertex_iterator_type old_end = sdbg.end();
+        sdbg.addVertices(new_minimizers.collect(), threads);
         logger.info() << "New minimizers added to sparse graph." << std::endl;
-        logger.info() << "Refilling graph with old edges." << std::endl;
-        RefillSparseDBGEdges(sdbg, old_edges.begin(), old_edges.end(), logger, threads);
-        logger.info() << "Filling graph with new edges." << std::endl;
-        FillSparseDBGEdges(sdbg, new_edges.begin(), new_edges.end(), logger, threads, sdbg.hasher().getK() + 1);
+        logger.info() << "Refilling graph edges." << std::endl;
+        std::atomic<size_t> old_edges(0);
+        std::function<void(size_t, std::pair<const htype, Vertex> &)> refill_task =
+                [&sdbg, &old_edges](size_t pos, std::pair<const htype, Vertex> &pair) {
+                    Vertex &cvertex = pair.second;
+                    std::vector<std::pair<Vertex *, Sequence>> edges;
+                    std::vector<std::pair<Vertex *, Sequence>> tips;
+                    for (auto *vit: {&cvertex, &cvertex.rc()}) {
+                        for (const Edge &ext: *vit) {
+                            if (ext.end() == nullptr)
+                                tips.emplace_back(vit, ext.seq);
+                            else
+                                edges.emplace_back(vit, ext.seq);
+                        }
+                    }
+                    cvertex.clear();
+                    for (auto &edge: edges)
+                        sdbg.processEdge(*edge.first, edge.second);
+                    for (auto &tip: tips)
+                        sdbg.processRead(tip.first->seq + tip.second);
+                    old_edges += edges.size();
+                };
+        processObjects(sdbg.begin(), old_end, logger, threads, refill_task);
+        logger.info() << "Refilled " << old_edges << " old edges." << std::endl;
         logger.info() << "Finished fixing sparse de Bruijn graph." << std::endl;
     }
 
@@ -159,51 +177,67 @@ namespace dbg {
         rc_new_edge.incCov(cov - rc_new_edge.intCov());
     }
 
-    void MergeEdge(SparseDBG &sdbg, Vertex &start, Edge &edge) {
-        Path path = Path::WalkForward(edge);
+    std::pair<Edge *, Edge *> mergePath(Path &path) {
+        Vertex &start = path.start();
         Vertex &end = path.finish().rc();
-        if (path.size() > 1 && end.hash() >= start.hash()) {
-            VERIFY(start.seq.size() > 0)
-            VERIFY(end.seq.size() > 0);
-            Sequence newSeq(path.Seq());
-            if (start != end)
-                end.lock();
-            size_t cov = 0;
-            for (size_t i = 0; i + 1 < path.size(); i++) {
-//            path[i].end()->clear();
-                path[i].end()->mark();
-                path[i].end()->rc().mark();
-                cov += path[i].intCov();
-            }
-            cov += path.back().intCov();
-            Edge &new_edge = start.addEdgeLockFree(Edge(&start, &end.rc(), newSeq.Subseq(start.seq.size())));
-            Edge &rc_new_edge = end.addEdgeLockFree(Edge(&end, &start.rc(), (!newSeq).Subseq(start.seq.size())));
-            new_edge.incCov(cov - new_edge.intCov());
-            rc_new_edge.incCov(cov - rc_new_edge.intCov());
-            if (start != end)
-                end.unlock();
+        VERIFY(start.seq.size() > 0)
+        VERIFY(end.seq.size() > 0);
+        Sequence newSeq(path.Seq());
+        size_t cov = 0;
+        for (size_t i = 0; i + 1 < path.size(); i++) {
+            path[i].end()->mark();
+            path[i].end()->rc().mark();
+            cov += path[i].intCov();
         }
+        cov += path.back().intCov();
+        Edge &new_edge = start.addEdgeLockFree(Edge(&start, &end.rc(), newSeq.Subseq(start.seq.size())));
+        Edge &rc_new_edge = end.addEdgeLockFree(Edge(&end, &start.rc(), (!newSeq).Subseq(start.seq.size())));
+        new_edge.incCov(cov - new_edge.intCov());
+        rc_new_edge.incCov(cov - rc_new_edge.intCov());
+        return {&new_edge, &rc_new_edge};
+    }
+
+    void MergeEdge(SparseDBG &sdbg, Vertex &start, Edge &edge) {
+        Path path = Path::WalkForward(edge);
+        if (path.size() > 1 && path.finish().rc().hash() >= start.hash())
+            mergePath(path);
     }
 
+//    A path and its reverse complement are merged once, from the end with the smaller hash. Ties between the two
+//    ends of a path are broken by the side and first nucleotide of the edge leaving each end.
+    bool isCanonicalPath(const Vertex &start, const Edge &first, const Vertex &end, const Edge &rc_first) {
+        if (start.hash() != end.hash())
+            return start.hash() < end.hash();
+        return std::make_pair(start.isCanonical(), first.seq[0]) >= std::make_pair(end.isCanonical(), rc_first.seq[0]);
+    }
+
+//    Unbranching paths are collected in parallel without modifying the graph and then merged in parallel. Every path
+//    is rewired by one thread that only touches its first edge, the reverse complement of its last edge and its inner
+//    vertices, so no locks are needed and the result does not depend on the number of threads.
     void mergeLinearPaths(logging::Logger &logger, SparseDBG &sdbg, size_t threads) {
         logger.trace() << "Merging linear unbranching paths" << std::endl;
+        ParallelRecordCollector<Path> paths(threads);
         std::function<void(size_t, std::pair<const htype, Vertex> &)> task =
-                [&sdbg](size_t pos, std::pair<const htype, Vertex> &pair) {
-                    Vertex &start = pair.second;
-                    if (!start.isJunction())
+                [&paths](size_t pos, std::pair<const htype, Vertex> &pair) {
+                    Vertex &vertex = pair.second;
+                    if (!vertex.isJunction())
                         return;
-                    start.lock();
-                    for (Edge &edge: start) {
-                        MergeEdge(sdbg, start, edge);
-                    }
-                    start.unlock();
-                    start.rc().lock();
-                    for (Edge &edge: start.rc()) {
-                        MergeEdge(sdbg, start.rc(), edge);
+                    for (Vertex *start : {&vertex, &vertex.rc()}) {
+                        for (Edge &edge: *start) {
+                            Path path = Path::WalkForward(edge);
+                            if (path.size() > 1 && isCanonicalPath(*start, edge, path.finish().rc(), path.back().rc()))
+                                paths.emplace_back(std::move(path));
+                        }
                     }
-                    start.rc().unlock();
                 };
         processObjects(sdbg.begin(), sdbg.end(), logger, threads, task);
+        std::vector<Path> path_list = paths.collect();
+        logger.trace() << "Found " << path_list.size() << " unbranching paths" << std::endl;
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(path_list)
+        for (size_t i = 0; i < path_list.size(); i++) {
+            mergePath(path_list[i]);
+        }
         logger.trace() << "Finished merging linear unbranching paths" << std::endl;
     }
 
@@ -228,12 +262,15 @@ namespace dbg {
                     if (ismin) {
                         loops.emplace_back(start.hash());
                     }
-                    start.unlock();
                 };
         processObjects(sdbg.begin(), sdbg.end(), logger, threads, task);
-        logger.trace() << "Found " << loops.size() << " perfect loops" << std::endl;
-        for (htype loop: loops) {
-            Vertex &start = sdbg.getVertex(loop);
+        std::vector<htype> loop_list = loops.collect();
+        logger.trace() << "Found " << loop_list.size() << " perfect loops" << std::endl;
+//        Each loop is identified by its vertex with the smallest hash and shares no vertices with other loops
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(sdbg, loop_list)
+        for (size_t i = 0; i < loop_list.size(); i++) {
+            Vertex &start = sdbg.getVertex(loop_list[i]);
             Path path = Path::WalkForward(start[0]);
             mergeLoop(path);
         }
@@ -246,6 +283,7 @@ namespace dbg {
 //    sdbg.checkConsistency(threads, logger);
         mergeCyclicPaths(logger, sdbg, threads);
 //    sdbg.checkConsistency(threads, logger);
+        sdbg.releaseRetiredEdges();
         logger.trace() << "Removing isolated vertices" << std::endl;
         sdbg.removeMarked();
         logger.trace() << "Finished removing isolated vertices" << std::endl;
@@ -329,10 +367,12 @@ namespace dbg {
             sequences.add(seq);
         };
         processRecords(reader.begin(), reader.end(), logger, threads, collect_task);
-        SparseDBG res(vertices.begin(), vertices.end(), hasher);
+        SparseDBG res(vertices.begin(), vertices.end(), hasher, threads);
+        res.enableArena();
         reader.reset();
         FillSparseDBGEdges(res, sequences.begin(), sequences.end(), logger, threads, hasher.getK() + 1);
         logger.info() << "Finished loading graph" << std::endl;
+        logger.trace() << "Graph sequence arena: " << *res.arena() << std::endl;
         return std::move(res);
     }
 }
\ No newline at end of file
@@ -13,18 +13,10 @@ namespace dbg {
             if (seq.size() >= min_read_size)
                 sdbg.processRead(seq);
         };
-        processRecords(begin, end, logger, threads, task);
-        logger.trace() << "Sparse graph edges filled." << std::endl;
-    }
-
-    template<class Iterator>
-    void RefillSparseDBGEdges(SparseDBG &sdbg, Iterator begin, Iterator end, logging::Logger &logger, size_t threads) {
-        logger.trace() << "Starting to fill edges" << std::endl;
-        std::function<void(size_t, std::pair<Vertex *, Sequence> &)> task = [&sdbg](size_t pos,
-                                                                                    std::pair<Vertex *, Sequence> &contig) {
-            sdbg.processEdge(*contig.first, contig.second);
-        };
-        processObjects(begin, end, logger, threads, task);
+        ParallelProcessor<ContigType> processor(task, logger, threads);
+//        Tips replaced by longer ones are freed after every batch of reads, when no thread can hold them
+        processor.doAfter = [&sdbg]() {sdbg.releaseRetiredEdges();};
+        processor.processRecords(begin, end);
         logger.trace() << "Sparse graph edges filled." << std::endl;
     }
 
@@ -47,6 +39,12 @@ namespace dbg {
 
     void mergeLoop(Path path);
 
+//    Replaces an unbranching path by a single edge. The first edge of the path and the reverse complement of its last
+//    edge are replaced by longer copies that are returned, inner vertices are marked for removal.
+    std::pair<Edge *, Edge *> mergePath(Path &path);
+
+    bool isCanonicalPath(const Vertex &start, const Edge &first, const Vertex &end, const Edge &rc_first);
+
     void MergeEdge(SparseDBG &sdbg, Vertex &start, Edge &edge);
 
     void mergeLinearPaths(logging::Logger &logger, SparseDBG &sdbg, size_t threads);
@@ -1,4 +1,6 @@
 #include "graph_alignment_storage.hpp"
+#include "sequences/mapped_reader.hpp"
+#include <parallel/algorithm>
 
 using namespace dbg;
 void AlignedRead::correct(CompactPath &&cpath) {
@@ -323,8 +325,50 @@ std::function<std::string(Edge &)> RecordStorage::labeler() const {
 
 void RecordStorage::addRead(AlignedRead &&read) {
     reads.emplace_back(std::move(read));
-    addSubpath(read.path);
-    addSubpath(read.path.RC());
+    addSubpath(reads.back().path);
+    addSubpath(reads.back().path.RC());
+    indexRead(reads.size() - 1);
+}
+
+void RecordStorage::addReads(std::vector<AlignedRead> &&new_reads, size_t threads, bool count_coverage) {
+    size_t start = reads.size();
+    reads.reserve(start + new_reads.size());
+    std::move(new_reads.begin(), new_reads.end(), std::back_inserter(reads));
+    new_reads.clear();
+    size_t finish = reads.size();
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(start, finish, count_coverage)
+    for(size_t i = start; i < finish; i++) {
+        addSubpath(reads[i].path, count_coverage);
+        addSubpath(reads[i].path.RC(), count_coverage);
+    }
+    indexReads(start, finish, threads);
+}
+
+void RecordStorage::indexReads(size_t from, size_t to, size_t threads) {
+    if(edge_index == nullptr)
+        return;
+    ParallelRecordCollector<std::pair<const Edge *, size_t>> entries(threads);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(from, to, entries)
+    for(size_t i = from; i < to; i++) {
+        if(!reads[i].valid())
+            continue;
+        for(const Segment<Edge> &seg : reads[i].path.getAlignment())
+            entries.emplace_back(&seg.contig(), i);
+    }
+    for(const std::pair<const Edge *, size_t> &entry : entries)
+        edge_index->reads[entry.first].emplace_back(entry.second);
+}
+
+void RecordStorage::indexRead(size_t ind) {
+    if(edge_index == nullptr || !reads[ind].valid())
+        return;
+    GraphAlignment al = reads[ind].path.getAlignment();
+    omp_set_lock(&edge_index->writelock);
+    for(const Segment<Edge> &seg : al)
+        edge_index->reads[&seg.contig()].emplace_back(ind);
+    omp_unset_lock(&edge_index->writelock);
 }
 
 void RecordStorage::invalidateRead(AlignedRead &read, const std::string &message) { // NOLINT(readability-convert-member-functions-to-static)
@@ -379,7 +423,7 @@ void RecordStorage::invalidateSubreads(logging::Logger &logger, size_t threads)
     logger.info() << "Uncorrected reads were removed." << std::endl;
 }
 
-void RecordStorage::addSubpath(const CompactPath &cpath) {
+void RecordStorage::addSubpath(const CompactPath &cpath, bool count_coverage) {
     if(!cpath.valid())
         return;
     std::function<void(Vertex &, const Sequence &)> vertex_task = [](Vertex &v, const Sequence &s) {};
@@ -388,7 +432,7 @@ void RecordStorage::addSubpath(const CompactPath &cpath) {
             data.find(&v)->second.addPath(s);
         };
     std::function<void(Segment<Edge>)> edge_task = [](Segment<Edge> seg){};
-    if(track_cov)
+    if(track_cov && count_coverage)
         edge_task = [](Segment<Edge> seg){
             seg.contig().incCov(seg.size());
         };
@@ -419,6 +463,7 @@ bool RecordStorage::apply(AlignedRead &alignedRead) {
     alignedRead.applyCorrection();
     this->addSubpath(alignedRead.path);
     this->addSubpath(alignedRead.path.RC());
+    indexRead(&alignedRead - reads.data());
     return true;
 }
 
@@ -433,6 +478,72 @@ void RecordStorage::reroute(AlignedRead &alignedRead, const GraphAlignment &corr
     reroute(alignedRead, alignedRead.path.getAlignment(), corrected, message);
 }
 
+std::vector<std::pair<size_t, GraphAlignment>> RecordStorage::detachPaths(const std::unordered_set<const Edge *> &edges,
+                                                                          size_t threads) {
+    if(edges.empty())
+        return {};
+    if(edge_index == nullptr) {
+        edge_index = std::make_unique<EdgeIndex>();
+        indexReads(0, reads.size(), threads);
+    }
+//    All reads that use these edges are detached, so their entries are not needed any more
+    std::vector<size_t> candidates;
+    for(const Edge *edge : edges) {
+        auto it = edge_index->reads.find(edge);
+        if(it == edge_index->reads.end())
+            continue;
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        edge_index->reads.erase(it);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    ParallelRecordCollector<std::pair<size_t, GraphAlignment>> res(threads);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(edges, res, candidates)
+    for(size_t j = 0; j < candidates.size(); j++) {
+        size_t i = candidates[j];
+        AlignedRead &read = reads[i];
+        if(!read.valid())
+            continue;
+        GraphAlignment al = read.path.getAlignment();
+        bool touched = false;
+        for(const Segment<Edge> &seg : al) {
+            if(edges.find(&seg.contig()) != edges.end()) {
+                touched = true;
+                break;
+            }
+        }
+        if(!touched)
+            continue;
+        VERIFY_OMP(!read.checkCorrected(), "Attempt to detach read with correction that was not yet applied");
+        removeSubpath(read.path);
+        removeSubpath(read.path.RC());
+        read.path = {};
+        res.emplace_back(i, std::move(al));
+    }
+    return res.collect();
+}
+
+void RecordStorage::attachPaths(std::vector<std::pair<size_t, GraphAlignment>> &&paths, const std::vector<Vertex *> &added,
+                                const std::vector<const Vertex *> &removed, size_t threads) {
+    for(const Vertex *vertex : removed)
+        data.erase(vertex);
+    for(Vertex *vertex : added)
+        data.emplace(vertex, VertexRecord(*vertex));
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(paths)
+    for(size_t i = 0; i < paths.size(); i++) {
+        if(!paths[i].second.valid())
+            continue;
+        AlignedRead &read = reads[paths[i].first];
+        read.path = CompactPath(paths[i].second);
+        addSubpath(read.path);
+        addSubpath(read.path.RC());
+        indexRead(paths[i].first);
+    }
+    paths.clear();
+}
+
 void RecordStorage::applyCorrections(logging::Logger &logger, size_t threads) {
     if(size() > 10000)
         logger.info() << "Applying corrections to reads" << std::endl;
@@ -550,33 +661,199 @@ void RecordStorage::Save(std::ostream &os) const {
     }
 }
 
-void RecordStorage::Load(std::istream &is, SparseDBG &dbg) {
+void RecordStorage::Load(std::istream &is, SparseDBG &dbg, bool count_coverage) {
     size_t sz;
     is >> sz;
+    std::vector<AlignedRead> new_reads;
     for(size_t i = 0; i < sz; i++) {
-        addRead(AlignedRead::Load(is, dbg));
+        new_reads.emplace_back(AlignedRead::Load(is, dbg));
+    }
+    addReads(std::move(new_reads), 1, count_coverage);
+}
+
+namespace {
+//    Binary alignment store. All fields are 64-bit words:
+//    header, read number of each storage, table of start vertex hashes, read id offsets and read ids,
+//    record offsets and records. A record is (start vertex reference, left skip, right skip, number of edges)
+//    followed by edge choices packed 2 bits per edge. Vertex reference is index in the vertex table
+//    times 2 plus 1 for canonical vertices, invalid paths are marked by all ones.
+    struct AlignmentStoreHeader {
+        char magic[8];
+        uint64_t hash_size;
+        uint64_t storage_num;
+        uint64_t vertex_num;
+        uint64_t read_num;
+        uint64_t ids_size;
+        uint64_t records_size;
+    };
+
+    const char *alignmentStoreMagic() {
+        return "LJAALN01";
+    }
+
+    const uint64_t invalid_vertex = uint64_t(-1);
+
+    size_t words(size_t bytes) {
+        return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    }
+
+//    Pads a section of the given size in bytes with zeros to a whole number of words
+    void writePadding(std::ostream &os, size_t bytes) {
+        static const char zeros[sizeof(uint64_t)] = {};
+        os.write(zeros, words(bytes) * sizeof(uint64_t) - bytes);
+    }
+
+    void writeWords(std::ostream &os, const void *data, size_t bytes) {
+        os.write(static_cast<const char *>(data), bytes);
+        writePadding(os, bytes);
+    }
+
+    void writeWord(std::ostream &os, uint64_t word) {
+        os.write(reinterpret_cast<const char *>(&word), sizeof(word));
+    }
+
+//    Number of words of the record of an alignment, edge choices are packed 2 bits per edge
+    size_t recordWords(const CompactPath &path) {
+        return path.valid() ? 4 + words((path.size() + 3) / 4) : 4;
+    }
+
+    void LoadAllReadsText(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs,
+                          dbg::SparseDBG &dbg, bool count_coverage) {
+        std::ifstream is;
+        is.open(fname);
+        size_t sz;
+        is >> sz;
+        VERIFY(sz == recs.size())
+        for(RecordStorage *recordStorage : recs) {
+            recordStorage->Load(is, dbg, count_coverage);
+        }
+        is.close();
     }
 }
 
 void SaveAllReads(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs) {
+//    Sections are written one by one in separate passes over the storages, only the vertex table is kept in memory.
+    AlignmentStoreHeader header{};
+    memcpy(header.magic, alignmentStoreMagic(), sizeof(header.magic));
+    header.hash_size = sizeof(hashing::htype);
+    header.storage_num = recs.size();
+    std::vector<uint64_t> storage_sizes;
+    std::vector<hashing::htype> vertex_hashs;
+    for(RecordStorage *rs : recs) {
+        storage_sizes.emplace_back(rs->size());
+        for(const AlignedRead &alignedRead : *rs) {
+            header.read_num++;
+            header.ids_size += alignedRead.id.size();
+            header.records_size += recordWords(alignedRead.path);
+            if(alignedRead.valid())
+                vertex_hashs.emplace_back(alignedRead.path.start().hash());
+        }
+    }
+    __gnu_parallel::sort(vertex_hashs.begin(), vertex_hashs.end());
+    vertex_hashs.erase(std::unique(vertex_hashs.begin(), vertex_hashs.end()), vertex_hashs.end());
+    header.vertex_num = vertex_hashs.size();
     std::ofstream os;
-    os.open(fname);
-    os << recs.size() << "\n";
+    os.open(fname, std::ios::binary);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeWords(os, storage_sizes.data(), storage_sizes.size() * sizeof(uint64_t));
+    writeWords(os, vertex_hashs.data(), vertex_hashs.size() * sizeof(hashing::htype));
+    uint64_t offset = 0;
+    writeWord(os, offset);
+    for(RecordStorage *rs : recs) {
+        for(const AlignedRead &alignedRead : *rs) {
+            offset += alignedRead.id.size();
+            writeWord(os, offset);
+        }
+    }
+    for(RecordStorage *rs : recs) {
+        for(const AlignedRead &alignedRead : *rs) {
+            os.write(alignedRead.id.data(), alignedRead.id.size());
+        }
+    }
+    writePadding(os, header.ids_size);
+    offset = 0;
+    writeWord(os, offset);
     for(RecordStorage *rs : recs) {
-        rs->Save(os);
+        for(const AlignedRead &alignedRead : *rs) {
+            offset += recordWords(alignedRead.path);
+            writeWord(os, offset);
+        }
+    }
+    for(RecordStorage *rs : recs) {
+        for(const AlignedRead &alignedRead : *rs) {
+            const CompactPath &path = alignedRead.path;
+            if(path.valid()) {
+                size_t ind = std::lower_bound(vertex_hashs.begin(), vertex_hashs.end(), path.start().hash()) - vertex_hashs.begin();
+                writeWord(os, ind * 2 + (path.start().isCanonical() ? 1 : 0));
+                writeWord(os, path.leftSkip());
+                writeWord(os, path.rightSkip());
+                writeWord(os, path.size());
+                std::vector<uint64_t> packed = path.cpath().packed();
+                VERIFY(packed.size() + 4 == recordWords(path));
+                writeWords(os, packed.data(), packed.size() * sizeof(uint64_t));
+            } else {
+                for(uint64_t word : {invalid_vertex, uint64_t(0), uint64_t(0), uint64_t(0)})
+                    writeWord(os, word);
+            }
+        }
     }
+    VERIFY_MSG(os, "Failed to write alignments to " << fname);
     os.close();
 }
 
 void LoadAllReads(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs,
-                  dbg::SparseDBG &dbg) {
-    std::ifstream is;
-    is.open(fname);
-    size_t sz;
-    is >> sz;
-    VERIFY(sz == recs.size())
-    for(RecordStorage *recordStorage : recs) {
-        recordStorage->Load(is, dbg);
+                  dbg::SparseDBG &dbg, size_t threads, bool count_coverage) {
+    io::MappedFile file(fname);
+    if(file.size() < sizeof(AlignmentStoreHeader) || memcmp(file.data(), alignmentStoreMagic(), 8) != 0) {
+        LoadAllReadsText(fname, recs, dbg, count_coverage);
+        return;
     }
-    is.close();
-}
\ No newline at end of file
+    AlignmentStoreHeader header{};
+    memcpy(&header, file.data(), sizeof(header));
+    VERIFY_MSG(header.hash_size == sizeof(hashing::htype), "Alignments were saved with " << header.hash_size * 8 << "-bit hashes");
+    VERIFY(header.storage_num == recs.size());
+    const uint64_t *ptr = reinterpret_cast<const uint64_t *>(file.data() + sizeof(header));
+    const uint64_t *storage_sizes = ptr;
+    ptr += header.storage_num;
+    const auto *vertex_hashs = reinterpret_cast<const hashing::htype *>(ptr);
+    ptr += words(header.vertex_num * sizeof(hashing::htype));
+    const uint64_t *id_offsets = ptr;
+    ptr += header.read_num + 1;
+    const char *ids = reinterpret_cast<const char *>(ptr);
+    ptr += words(header.ids_size);
+    const uint64_t *record_offsets = ptr;
+    ptr += header.read_num + 1;
+    const uint64_t *records = ptr;
+    ptr += header.records_size;
+    VERIFY_MSG(reinterpret_cast<const char *>(ptr) == file.data() + file.size(), "Alignment file " << fname << " is corrupted");
+    std::vector<Vertex *> vertices(header.vertex_num);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(header, vertices, vertex_hashs, dbg)
+    for(size_t i = 0; i < header.vertex_num; i++) {
+        hashing::htype hash;
+        memcpy(&hash, vertex_hashs + i, sizeof(hash));
+        VERIFY_OMP(dbg.containsVertex(hash), "Alignment file refers to a vertex missing from the graph");
+        vertices[i] = &dbg.getVertex(hash);
+    }
+    size_t first = 0;
+    for(size_t storage = 0; storage < header.storage_num; storage++) {
+        std::vector<AlignedRead> reads(storage_sizes[storage]);
+//        Paths are allocated in the arena of their storage instead of a buffer per read
+        NuclArena &arena = recs[storage]->pathArena();
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(reads, first, vertices, ids, id_offsets, records, record_offsets, arena)
+        for(size_t i = 0; i < reads.size(); i++) {
+            size_t ind = first + i;
+            std::string id(ids + id_offsets[ind], ids + id_offsets[ind + 1]);
+            const uint64_t *record = records + record_offsets[ind];
+            if(record[0] == invalid_vertex) {
+                reads[i] = AlignedRead(std::move(id));
+            } else {
+                Vertex &start = *vertices[record[0] / 2];
+                reads[i] = AlignedRead(std::move(id), CompactPath(record[0] % 2 == 1 ? start : start.rc(),
+                                                                  Sequence::FromPacked(record + 4, record[3], arena), record[1], record[2]));
+            }
+        }
+        recs[storage]->addReads(std::move(reads), threads, count_coverage);
+        first += storage_sizes[storage];
+    }
+}
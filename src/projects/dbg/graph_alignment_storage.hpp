@@ -46,18 +46,20 @@ private:
     Storage paths;
     size_t zero_cnt = 0;
     size_t cov = 0;
+    mutable omp_lock_t writelock = {};
 
-    void lock() const {v.lock();}
-    void unlock() const {v.unlock();}
+    void lock() const {omp_set_lock(&writelock);}
+    void unlock() const {omp_unset_lock(&writelock);}
 
     void addPath(const Sequence &seq);
     void removePath(const Sequence &seq);
     void clear() {paths.clear();}
 public:
-    explicit VertexRecord(dbg::Vertex &_v) : v(_v) {}
+    explicit VertexRecord(dbg::Vertex &_v) : v(_v) {omp_init_lock(&writelock);}
     VertexRecord(const VertexRecord &) = delete;
     VertexRecord(VertexRecord &&other)  noexcept : v(other.v), paths(std::move(other.paths)),
-                                                   zero_cnt(other.zero_cnt), cov(other.cov) {}
+                                                   zero_cnt(other.zero_cnt), cov(other.cov) {omp_init_lock(&writelock);}
+    ~VertexRecord() {omp_destroy_lock(&writelock);}
 
     VertexRecord & operator=(const VertexRecord &) = delete;
 
@@ -124,8 +126,21 @@ public:
 
 class RecordStorage {
 private:
+//    Reads whose paths use an edge. The index is built by the first detachPaths and then updated whenever a read gets
+//    a new path. Entries are never removed for reads that leave an edge, so listed reads are checked on lookup.
+    struct EdgeIndex {
+        std::unordered_map<const dbg::Edge *, std::vector<size_t>> reads;
+        omp_lock_t writelock = {};
+
+        EdgeIndex() {omp_init_lock(&writelock);}
+        EdgeIndex(const EdgeIndex &) = delete;
+        ~EdgeIndex() {omp_destroy_lock(&writelock);}
+    };
+//    Paths of reads loaded in bulk and the vertex records built from them borrow the memory of this arena
+    std::unique_ptr<NuclArena> arena;
     std::vector<AlignedRead> reads;
     std::unordered_map<const dbg::Vertex *, VertexRecord> data;
+    std::unique_ptr<EdgeIndex> edge_index;
     ReadLogger *readLogger;
 public:
     size_t min_len;
@@ -137,6 +152,9 @@ public:
 private:
     void processPath(const dbg::CompactPath &cpath, const std::function<void(dbg::Vertex &, const Sequence &)> &task,
                             const std::function<void(Segment<dbg::Edge>)> &edge_task = [](Segment<dbg::Edge>){}) const;
+//    Adds reads in [from, to) to the edge index if it is built. indexRead may be called concurrently.
+    void indexReads(size_t from, size_t to, size_t threads);
+    void indexRead(size_t ind);
 public:
     RecordStorage(dbg::SparseDBG &dbg, size_t _min_len, size_t _max_len, size_t threads,
                   ReadLogger &readLogger, bool _track_cov = false, bool log_changes = false, bool track_suffixes = true);
@@ -161,16 +179,31 @@ public:
     bool isTrackingCov() const {return track_cov;}
     bool isTrackingSuffixes() const {return track_suffixes;}
     size_t size() const {return reads.size();}
+    NuclArena &pathArena() {
+        if(arena == nullptr)
+            arena = std::make_unique<NuclArena>();
+        return *arena;
+    }
 
     std::function<std::string(dbg::Edge &)> labeler() const;
 
-    void addSubpath(const dbg::CompactPath &cpath);
+//    Coverage is not counted when count_coverage is false, e.g. for reads of a graph that was saved with its coverage
+    void addSubpath(const dbg::CompactPath &cpath, bool count_coverage = true);
     void removeSubpath(const dbg::CompactPath &cpath);
     void addRead(AlignedRead &&read);
+    void addReads(std::vector<AlignedRead> &&new_reads, size_t threads, bool count_coverage = true);
     void invalidateRead(AlignedRead &read, const std::string &message);
     void reroute(AlignedRead &alignedRead, const dbg::GraphAlignment &initial, const dbg::GraphAlignment &corrected, const std::string &message);
     void reroute(AlignedRead &alignedRead, const dbg::GraphAlignment &corrected, const std::string &message);
     bool apply(AlignedRead &alignedRead);
+//    Incremental update around an in place graph change. detachPaths removes reads whose paths touch the given edges
+//    from the storage and returns their alignments; only reads listed for these edges in the edge index are decoded.
+//    attachPaths adds remapped alignments back, invalid alignments leave their reads invalidated. Vertex records are
+//    created for added vertices and dropped for removed ones.
+    std::vector<std::pair<size_t, dbg::GraphAlignment>> detachPaths(const std::unordered_set<const dbg::Edge *> &edges,
+                                                                    size_t threads);
+    void attachPaths(std::vector<std::pair<size_t, dbg::GraphAlignment>> &&paths, const std::vector<dbg::Vertex *> &added,
+                     const std::vector<const dbg::Vertex *> &removed, size_t threads);
 
     void invalidateBad(logging::Logger &logger, size_t threads, double threshold, const std::string &message);
     void invalidateBad(logging::Logger &logger, size_t threads, const std::function<bool(const dbg::Edge &)> &is_bad, const std::string &message);
@@ -191,12 +224,13 @@ public:
 
     void Save(std::ostream &os) const;
 
-    void Load(std::istream &is, dbg::SparseDBG &dbg);
+    void Load(std::istream &is, dbg::SparseDBG &dbg, bool count_coverage = true);
 };
 
 void SaveAllReads(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs);
 
-void LoadAllReads(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs, dbg::SparseDBG &dbg);
+void LoadAllReads(const std::experimental::filesystem::path &fname, const std::vector<RecordStorage *> &recs, dbg::SparseDBG &dbg,
+                  size_t threads = 1, bool count_coverage = true);
 
 template<class I>
 void RecordStorage::fill(I begin, I end, dbg::SparseDBG &dbg, size_t min_read_size, logging::Logger &logger, size_t threads) {
@@ -212,7 +246,8 @@ void RecordStorage::fill(I begin, I end, dbg::SparseDBG &dbg, size_t min_read_si
     }
     ParallelRecordCollector<std::tuple<size_t, std::string, dbg::CompactPath>> tmpReads(threads);
     ParallelCounter cnt(threads);
-    std::function<void(size_t, StringContig &)> read_task = [this, min_read_size, &tmpReads, &cnt, &dbg](size_t pos, StringContig & scontig) {
+    typedef typename I::value_type ContigType;
+    std::function<void(size_t, ContigType &)> read_task = [this, min_read_size, &tmpReads, &cnt, &dbg](size_t pos, ContigType & scontig) {
         Contig contig = scontig.makeContig();
         if(contig.size() < min_read_size) {
             tmpReads.emplace_back(pos, contig.id, dbg::CompactPath());
@@ -229,6 +264,7 @@ void RecordStorage::fill(I begin, I end, dbg::SparseDBG &dbg, size_t min_read_si
     };
     processRecords(begin, end, logger, threads, read_task);
     reads.resize(tmpReads.size());
+    edge_index.reset();
     for(auto &rec : tmpReads) {
         VERIFY(std::get<0>(rec) < reads.size());
         reads[std::get<0>(rec)] = AlignedRead(std::get<1>(rec), std::move(std::get<2>(rec)));
@@ -0,0 +1,407 @@
+#include "graph_delta.hpp"
+#include "graph_algorithms.hpp"
+#include <algorithm>
+#include <set>
+
+using namespace dbg;
+
+void ChangeLog::record(const Edge *old_edge, std::vector<EdgePiece> image) {
+    images[old_edge] = std::move(image);
+}
+
+void ChangeLog::addVertex(Vertex &vertex) {
+    added.emplace_back(&vertex);
+}
+
+void ChangeLog::removeVertices(const std::vector<const Vertex *> &vertices) {
+    std::unordered_set<const Vertex *> marked(vertices.begin(), vertices.end());
+    std::unordered_set<const Vertex *> dropped;
+    added.erase(std::remove_if(added.begin(), added.end(), [&marked, &dropped](const Vertex *vertex) {
+        if(marked.find(vertex) == marked.end())
+            return false;
+        dropped.emplace(vertex);
+        return true;
+    }), added.end());
+    for(const Vertex *vertex : vertices) {
+        if(dropped.find(vertex) == dropped.end() && marked.erase(vertex) > 0)
+            removed.emplace_back(vertex);
+    }
+}
+
+std::unordered_set<const Edge *> ChangeLog::changedEdges() const {
+    std::unordered_set<const Edge *> res;
+    for(const auto &it : images)
+        res.emplace(it.first);
+    return std::move(res);
+}
+
+std::vector<Edge *> ChangeLog::imageEdges() const {
+    std::unordered_set<Edge *> res;
+    for(const auto &it : images) {
+        for(const EdgePiece &piece : it.second)
+            res.emplace(piece.edge);
+    }
+    return {res.begin(), res.end()};
+}
+
+bool ChangeLog::map(EdgePosition &pos) const {
+    auto it = images.find(pos.edge);
+    if(it == images.end())
+        return true;
+    for(const EdgePiece &piece : it->second) {
+        if(piece.from <= pos.pos && pos.pos < piece.to) {
+            size_t new_pos = piece.pos + pos.pos - piece.from;
+            if(new_pos == 0)
+                return false;
+            pos.edge = piece.edge;
+            pos.pos = new_pos;
+            return true;
+        }
+    }
+    return false;
+}
+
+GraphAlignment ChangeLog::map(const GraphAlignment &al) const {
+    GraphAlignment res;
+    for(const Segment<Edge> &seg : al) {
+        auto it = images.find(&seg.contig());
+        if(it == images.end()) {
+            res += seg;
+            continue;
+        }
+        if(it->second.empty())
+            return {};
+        for(const EdgePiece &piece : it->second) {
+            size_t left = std::max(seg.left, piece.from);
+            size_t right = std::min(seg.right, piece.to);
+            if(left < right)
+                res += Segment<Edge>(*piece.edge, piece.pos + left - piece.from, piece.pos + right - piece.from);
+        }
+    }
+    return std::move(res);
+}
+
+void ChangeLog::compose(const ChangeLog &next) {
+    for(auto &it : images) {
+        std::vector<EdgePiece> image;
+        for(const EdgePiece &piece : it.second) {
+            auto next_it = next.images.find(piece.edge);
+            if(next_it == next.images.end()) {
+                image.emplace_back(piece);
+                continue;
+            }
+            for(const EdgePiece &next_piece : next_it->second) {
+                size_t left = std::max(piece.pos, next_piece.from);
+                size_t right = std::min(piece.pos + piece.to - piece.from, next_piece.to);
+                if(left < right)
+                    image.push_back({piece.from + left - piece.pos, piece.from + right - piece.pos, next_piece.edge,
+                                     next_piece.pos + left - next_piece.from});
+            }
+        }
+        it.second = std::move(image);
+    }
+//    An edge changed by both logs was reused as a piece of its own image and its entry already maps through next
+    for(const auto &it : next.images)
+        images.emplace(it.first, it.second);
+    for(Vertex *vertex : next.added)
+        addVertex(*vertex);
+    removeVertices(next.removed);
+}
+
+//Every edge and its reverse complement are handled once, through the smaller of the two.
+static Edge &canonicalEdge(Edge &edge) {
+    Edge &rc = edge.rc();
+    return rc < edge ? rc : edge;
+}
+
+static void detachAll(const std::vector<RecordStorage *> &storages, const std::unordered_set<const Edge *> &edges,
+                      std::vector<std::vector<std::pair<size_t, GraphAlignment>>> &detached, size_t threads) {
+    for(size_t i = 0; i < storages.size(); i++) {
+        std::vector<std::pair<size_t, GraphAlignment>> paths = storages[i]->detachPaths(edges, threads);
+        detached[i].insert(detached[i].end(), std::make_move_iterator(paths.begin()), std::make_move_iterator(paths.end()));
+    }
+}
+
+static void remapAll(std::vector<std::vector<std::pair<size_t, GraphAlignment>>> &detached, const ChangeLog &log,
+                     size_t threads) {
+    for(std::vector<std::pair<size_t, GraphAlignment>> &paths : detached) {
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(paths, log)
+        for(size_t i = 0; i < paths.size(); i++) {
+            if(paths[i].second.valid())
+                paths[i].second = log.map(paths[i].second);
+        }
+    }
+}
+
+bool GraphDelta::fitsInPlace(logging::Logger &logger, size_t threads, SparseDBG &dbg) const {
+    if(insertions.empty())
+        return true;
+    const hashing::RollingHash &hasher = dbg.hasher();
+    size_t k = hasher.getK();
+    std::unordered_set<hashing::htype, hashing::alt_hasher<hashing::htype>> borders;
+    for(const EdgePosition &pos : splits)
+        borders.emplace(hashing::KWH(hasher, pos.kmerSeq(), 0).hash());
+    std::unordered_set<hashing::htype, hashing::alt_hasher<hashing::htype>> inner;
+    std::set<Sequence> distinct;
+    for(const Sequence &seq : insertions) {
+        if(!distinct.emplace(std::min(seq, !seq)).second || seq.size() <= k + 1)
+            continue;
+        for(hashing::KmerCursor kmer(hasher, seq, 1); kmer.pos + k < seq.size(); kmer.next()) {
+            hashing::htype hash = kmer.hash();
+            if(borders.find(hash) != borders.end() || dbg.containsVertex(hash))
+                continue;
+            if(!inner.emplace(hash).second) {
+                logger.trace() << "Inserted sequences share a k-mer that is not a vertex" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::unordered_set<const Edge *> removed;
+    for(Edge *edge : removals) {
+        removed.emplace(edge);
+        removed.emplace(&edge->rc());
+    }
+//    Every edge is scanned from its start vertex. Edges that are not tips are also seen from the other strand, so only
+//    the smaller one of the pair is scanned.
+    ParallelRecordCollector<hashing::htype> hits(threads);
+    std::function<void(size_t, std::pair<const hashing::htype, Vertex> &)> task =
+            [&hasher, &inner, &removed, &hits](size_t pos, std::pair<const hashing::htype, Vertex> &pair) {
+        for(Vertex *start : {&pair.second, &pair.second.rc()}) {
+            for(Edge &edge : *start) {
+                if(edge.size() < 2 || removed.find(&edge) != removed.end() ||
+                        (edge.end() != nullptr && &edge.rc() < &edge))
+                    continue;
+                Sequence seq = start->seq + edge.seq;
+                for(hashing::KmerCursor kmer(hasher, seq, 1); kmer.pos < edge.size(); kmer.next()) {
+                    if(inner.find(kmer.hash()) != inner.end()) {
+                        hits.emplace_back(kmer.hash());
+                        return;
+                    }
+                }
+            }
+        }
+    };
+    processObjects(dbg.begin(), dbg.end(), logger, threads, task);
+    if(hits.size() > 0) {
+        logger.trace() << "Inserted sequences share k-mers with edges of the graph" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ChangeLog GraphDelta::apply(logging::Logger &logger, size_t threads, SparseDBG &dbg,
+                            const std::vector<RecordStorage *> &storages) const {
+    logger.trace() << "Applying " << removals.size() << " removals, " << splits.size() << " splits and "
+                   << insertions.size() << " insertions to the graph in place" << std::endl;
+    ChangeLog log;
+    std::vector<Vertex *> touched;
+//    Tips without an end vertex are bound first, so that they can be cut and the border at their end is a vertex
+    for(const EdgePosition &pos : splits) {
+        Edge &tip = *pos.edge;
+        if(tip.end() != nullptr)
+            continue;
+        hashing::htype hash = hashing::KWH(dbg.hasher(), tip.kmerSeq(tip.size()), 0).hash();
+        bool added = !dbg.containsVertex(hash);
+        Vertex &end = dbg.bindTip(*tip.start(), tip);
+        touched.emplace_back(&end);
+        if(added) {
+            log.addVertex(end);
+            log.addVertex(end.rc());
+        }
+    }
+    std::vector<Edge *> removed;
+    std::unordered_set<const Edge *> removed_set;
+    for(Edge *edge : removals) {
+        Edge &canonical = canonicalEdge(*edge);
+        if(removed_set.emplace(&canonical).second)
+            removed.emplace_back(&canonical);
+    }
+    std::vector<std::pair<Edge *, std::vector<size_t>>> cuts;
+    std::unordered_map<const Edge *, size_t> cut_index;
+    for(const EdgePosition &pos : splits) {
+        if(pos.isBorder())
+            continue;
+        Edge &canonical = canonicalEdge(*pos.edge);
+        VERIFY(removed_set.find(&canonical) == removed_set.end());
+        auto it = cut_index.emplace(&canonical, cuts.size()).first;
+        if(it->second == cuts.size())
+            cuts.emplace_back(&canonical, std::vector<size_t>());
+        std::vector<size_t> &positions = cuts[it->second].second;
+        positions.emplace_back(pos.edge == &canonical ? pos.pos : pos.edge->size() - pos.pos);
+        if(&canonical == &canonical.rc())
+            positions.emplace_back(canonical.size() - pos.pos);
+    }
+
+    std::unordered_set<const Edge *> changed;
+    std::vector<Sequence> old_seqs;
+    for(Edge *edge : removed) {
+        changed.emplace(edge);
+        changed.emplace(&edge->rc());
+        old_seqs.emplace_back(edge->start()->seq + edge->seq);
+    }
+    for(std::pair<Edge *, std::vector<size_t>> &cut : cuts) {
+        changed.emplace(cut.first);
+        changed.emplace(&cut.first->rc());
+        old_seqs.emplace_back(cut.first->start()->seq + cut.first->seq);
+    }
+    std::vector<std::vector<std::pair<size_t, GraphAlignment>>> detached(storages.size());
+    detachAll(storages, changed, detached, threads);
+
+    for(Edge *edge : removed) {
+        touched.emplace_back(edge->start());
+        touched.emplace_back(edge->end());
+        log.record(edge, {});
+        log.record(&edge->rc(), {});
+        dbg.removeEdge(*edge);
+    }
+    for(std::pair<Edge *, std::vector<size_t>> &cut : cuts) {
+        Edge &edge = *cut.first;
+        Edge &rc = edge.rc();
+        size_t size = edge.size();
+        std::vector<size_t> bounds = cut.second;
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        std::vector<Edge *> pieces = dbg.splitEdge(edge, bounds);
+        bounds.insert(bounds.begin(), 0);
+        bounds.emplace_back(size);
+        std::vector<EdgePiece> image;
+        for(size_t i = 0; i < pieces.size(); i++)
+            image.push_back({bounds[i], bounds[i + 1], pieces[i], 0});
+        log.record(&edge, image);
+        if(&rc != &edge) {
+            std::vector<EdgePiece> rc_image;
+            for(size_t i = pieces.size(); i > 0; i--)
+                rc_image.push_back({size - bounds[i], size - bounds[i - 1], &pieces[i - 1]->rc(), 0});
+            log.record(&rc, rc_image);
+        }
+        for(size_t i = 1; i < pieces.size(); i++) {
+            Vertex &vertex = *pieces[i]->start();
+            touched.emplace_back(&vertex);
+            log.addVertex(vertex);
+            log.addVertex(vertex.rc());
+        }
+    }
+    size_t k = dbg.hasher().getK();
+    for(const Sequence &seq : insertions) {
+        for(const hashing::KWH &kwh : {hashing::KWH(dbg.hasher(), seq, 0), hashing::KWH(dbg.hasher(), seq, seq.size() - k)}) {
+            if(!dbg.containsVertex(kwh.hash())) {
+                Vertex &vertex = dbg.addVertex(kwh);
+                log.addVertex(vertex);
+                log.addVertex(vertex.rc());
+            }
+        }
+        dbg.processRead(seq);
+        for(const hashing::KWH &kwh : dbg.extractVertexPositions(seq))
+            touched.emplace_back(&dbg.getVertex(kwh));
+    }
+    std::vector<Edge *> inserted;
+    if(anchor_step != 0) {
+        for(const Sequence &seq : insertions) {
+            std::vector<hashing::KWH> kmers = dbg.extractVertexPositions(seq);
+            for(size_t i = 0; i + 1 < kmers.size(); i++) {
+                Edge &edge = dbg.getVertex(kmers[i]).getOutgoing(seq[kmers[i].pos + k]);
+                inserted.emplace_back(&edge);
+                inserted.emplace_back(&edge.rc());
+            }
+        }
+    }
+    dbg.remapAnchors(old_seqs, [&log](EdgePosition &pos) {return log.map(pos);});
+    remapAll(detached, log, threads);
+
+//    Vertices that lost all their edges are removed. Unbranching paths through touched vertices are merged, perfect
+//    loops are left for the next full merge.
+    ChangeLog merge_log;
+    std::unordered_set<hashing::htype, hashing::alt_hasher<hashing::htype>> visited;
+    std::vector<hashing::htype> touched_hashs;
+    for(Vertex *vertex : touched) {
+        if(visited.emplace(vertex->hash()).second)
+            touched_hashs.emplace_back(vertex->hash());
+    }
+    std::vector<Path> paths;
+    std::unordered_set<const Edge *> path_edges;
+    std::vector<hashing::htype> isolated;
+    for(hashing::htype hash : touched_hashs) {
+        Vertex &vertex = dbg.getVertex(hash);
+        if(vertex.outDeg() == 0 && vertex.inDeg() == 0) {
+            isolated.emplace_back(hash);
+            continue;
+        }
+        for(Vertex *start : {&vertex, &vertex.rc()}) {
+            if(start->isJunction())
+                continue;
+            Edge *first = &start->rc()[0].rc();
+            while(first != nullptr && !first->start()->isJunction())
+                first = first->start() == start ? nullptr : &first->start()->rc()[0].rc();
+            if(first == nullptr || path_edges.find(first) != path_edges.end())
+                continue;
+            Path path = Path::WalkForward(*first);
+            if(path.size() < 2 || !isCanonicalPath(*first->start(), *first, path.finish().rc(), path.back().rc()))
+                continue;
+            for(Edge *edge : path) {
+                path_edges.emplace(edge);
+                path_edges.emplace(&edge->rc());
+            }
+            paths.emplace_back(std::move(path));
+        }
+    }
+    detachAll(storages, path_edges, detached, threads);
+    std::vector<Sequence> merged_seqs;
+    std::vector<hashing::htype> inner;
+    for(Path &path : paths) {
+        touched_hashs.emplace_back(path.start().hash());
+        touched_hashs.emplace_back(path.finish().hash());
+//        Merged edges are new objects, so the old edges are collected before the merge
+        std::vector<std::pair<Edge *, Edge *>> old_edges;
+        for(size_t i = 0; i < path.size(); i++) {
+            Edge &edge = path[i];
+            merged_seqs.emplace_back(edge.start()->seq + edge.seq);
+            old_edges.emplace_back(&edge, &edge.rc());
+            if(i > 0)
+                inner.emplace_back(path.getVertex(i).hash());
+        }
+        size_t len = path.len();
+        std::pair<Edge *, Edge *> merged = mergePath(path);
+        size_t offset = 0;
+        for(const std::pair<Edge *, Edge *> &edges : old_edges) {
+            size_t size = edges.first->size();
+            merge_log.record(edges.first, {{0, size, merged.first, offset}});
+            merge_log.record(edges.second, {{0, size, merged.second, len - offset - size}});
+            offset += size;
+        }
+    }
+    inner.insert(inner.end(), isolated.begin(), isolated.end());
+    std::sort(inner.begin(), inner.end());
+    inner.erase(std::unique(inner.begin(), inner.end()), inner.end());
+    std::vector<const Vertex *> dead;
+    for(hashing::htype hash : inner) {
+        Vertex &vertex = dbg.getVertex(hash);
+        dead.emplace_back(&vertex);
+        dead.emplace_back(&vertex.rc());
+    }
+    merge_log.removeVertices(dead);
+    for(hashing::htype hash : inner)
+        dbg.removeVertex(dbg.getVertex(hash));
+    dbg.remapAnchors(merged_seqs, [&merge_log](EdgePosition &pos) {return merge_log.map(pos);});
+    remapAll(detached, merge_log, threads);
+    log.compose(merge_log);
+    if(anchor_step != 0) {
+        std::vector<Edge *> new_edges = log.imageEdges();
+        for(Edge *edge : inserted) {
+            if(!log.changed(edge))
+                new_edges.emplace_back(edge);
+        }
+        dbg.fillAnchors(anchor_step, logger, threads, new_edges);
+    }
+
+    size_t cnt = 0;
+    for(size_t i = 0; i < storages.size(); i++) {
+        cnt += detached[i].size();
+        storages[i]->attachPaths(std::move(detached[i]), log.addedVertices(), log.removedVertices(), threads);
+    }
+//    Removed and replaced edges are freed only now, so that no new edge could reuse the address of a key of the log
+    dbg.releaseRetiredEdges(touched_hashs);
+    logger.trace() << "Changed " << log.size() << " edges, merged " << paths.size() << " paths and remapped "
+                   << cnt << " reads" << std::endl;
+    return std::move(log);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "sparse_dbg.hpp"
+#include "paths.hpp"
+#include "graph_alignment_storage.hpp"
+#include <common/logging.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dbg {
+//    Positions [from, to) of an old edge are spelled by the new edge starting from position pos.
+    struct EdgePiece {
+        size_t from;
+        size_t to;
+        Edge *edge;
+        size_t pos;
+    };
+
+//    Change log of an in place graph update. Every changed edge of the old graph is mapped to the pieces of the new
+//    graph that spell it, removed edges are mapped to nothing and all other edges stay as they were. Old edges are
+//    only used as keys: they may be reused as pieces of their own image and deleted ones are freed only after apply
+//    is done with the log, so that no new edge takes the address of a key.
+    class ChangeLog {
+    private:
+        std::unordered_map<const Edge *, std::vector<EdgePiece>> images;
+        std::vector<Vertex *> added;
+        std::vector<const Vertex *> removed;
+    public:
+        void record(const Edge *old_edge, std::vector<EdgePiece> image);
+        void addVertex(Vertex &vertex);
+//        Vertices added earlier in this log are dropped from it, others are recorded as removed.
+        void removeVertices(const std::vector<const Vertex *> &vertices);
+
+        size_t size() const {return images.size();}
+        bool changed(const Edge *edge) const {return images.find(edge) != images.end();}
+        const std::vector<Vertex *> &addedVertices() const {return added;}
+        const std::vector<const Vertex *> &removedVertices() const {return removed;}
+        std::unordered_set<const Edge *> changedEdges() const;
+//        Edges of the new graph that spell changed old edges
+        std::vector<Edge *> imageEdges() const;
+
+//        Moves a position inside an old edge to the new graph. Returns false if the edge was removed or the position
+//        became a vertex.
+        bool map(EdgePosition &pos) const;
+//        Maps an alignment to the old graph into the new graph. Returns an invalid alignment if it used removed edges.
+        GraphAlignment map(const GraphAlignment &al) const;
+//        Appends a change applied to the graph after this one.
+        void compose(const ChangeLog &next);
+    };
+
+//    Batch of edge splits, sequence insertions and edge removals applied to the graph in place. Removals go first,
+//    then splits and then insertions; unbranching paths through vertices touched by the batch are merged in the end.
+//    Tips without an end vertex that are split get their end vertex first. Inserted sequences must start and end at
+//    vertices or split positions of the batch and apply does not look their inner k-mers up inside existing edges:
+//    fitsInPlace checks that they occur neither there nor in other insertions, otherwise the graph has to be rebuilt.
+//    Reads of the given storages that touch changed edges are detached before the change and added back remapped
+//    through the change log, other reads and edges are not visited. All storages aligned to the graph must be passed.
+//    Anchors of changed edges are remapped and, if an anchor step is set, new and split edges get anchors with that
+//    step as in SparseDBG::fillAnchors.
+    class GraphDelta {
+    private:
+        std::vector<EdgePosition> splits;
+        std::vector<Sequence> insertions;
+        std::vector<Edge *> removals;
+        size_t anchor_step = 0;
+    public:
+        void fillAnchors(size_t w) {anchor_step = w;}
+        void split(const EdgePosition &pos) {splits.emplace_back(pos);}
+        void insert(const Sequence &seq) {insertions.emplace_back(seq);}
+        void remove(Edge &edge) {removals.emplace_back(&edge);}
+        bool empty() const {return splits.empty() && insertions.empty() && removals.empty();}
+
+//        Scans all edges of the graph once
+        bool fitsInPlace(logging::Logger &logger, size_t threads, SparseDBG &dbg) const;
+
+        ChangeLog apply(logging::Logger &logger, size_t threads, SparseDBG &dbg,
+                        const std::vector<RecordStorage *> &storages) const;
+    };
+}
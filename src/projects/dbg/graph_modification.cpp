@@ -1,5 +1,6 @@
 #include "graph_modification.hpp"
 #include "visualization.hpp"
+#include "graph_delta.hpp"
 
 using namespace dbg;
 GraphAlignment realignRead(const GraphAlignment &al,
@@ -73,9 +74,9 @@ void RemoveUncovered(logging::Logger &logger, size_t threads, SparseDBG &dbg, co
                     if(seg.contig() == seg.contig().rc())
                         segmentStorage.emplace_back(seg.RC());
                 } else {
-                    seg.contig().start()->lock();
-                    seg.contig().extraInfo = 1;
-                    seg.contig().start()->unlock();
+                    size_t &info = seg.contig().extraInfo;
+#pragma omp atomic write
+                    info = 1;
                 }
             }
             if (len > 0)
@@ -174,12 +175,10 @@ void RemoveUncovered(logging::Logger &logger, size_t threads, SparseDBG &dbg, co
     dbg = std::move(subgraph);
 }
 
-void AddConnections(logging::Logger &logger, size_t threads, SparseDBG &dbg, const std::vector<RecordStorage *> &storages,
-               const std::vector<Connection> &connections) {
-    logger.info() << "Adding new connections to the graph" << std::endl;
-    size_t k = dbg.hasher().getK();
-    std::vector<EdgePosition> break_positions;
-    logger.trace() << "Splitting graph edges" << std::endl;
+//Builds a new graph with the connections and realigns all reads to it
+static void RebuildWithConnections(logging::Logger &logger, size_t threads, SparseDBG &dbg,
+                                   const std::vector<RecordStorage *> &storages, const std::vector<Connection> &connections) {
+    logger.trace() << "Rebuilding graph with new connections" << std::endl;
     std::vector<Sequence> seqs;
     for(const Connection &connection : connections)
         seqs.emplace_back(connection.connection);
@@ -187,7 +186,6 @@ void AddConnections(logging::Logger &logger, size_t threads, SparseDBG &dbg, con
     mergeAll(logger, subgraph, threads);
     subgraph.fillAnchors(500, logger, threads);
     subgraph.checkConsistency(threads, logger);
-//    subgraph.checkDBGConsistency(threads, logger);
     GraphAligner aligner(subgraph);
     std::function<void(size_t, Edge &)> task = [&aligner](size_t num, Edge &edge) {
         GraphAlignment al = aligner.align(edge.start()->seq + edge.seq);
@@ -235,6 +233,24 @@ void AddConnections(logging::Logger &logger, size_t threads, SparseDBG &dbg, con
     dbg = std::move(subgraph);
 }
 
+void AddConnections(logging::Logger &logger, size_t threads, SparseDBG &dbg, const std::vector<RecordStorage *> &storages,
+               const std::vector<Connection> &connections) {
+    logger.info() << "Adding new connections to the graph" << std::endl;
+    GraphDelta delta;
+    for(const Connection &connection : connections) {
+        delta.split(connection.pos1);
+        delta.split(connection.pos2);
+        delta.insert(connection.connection);
+    }
+//    Connections that repeat k-mers of the graph or of each other can not be glued in place
+    if(!delta.fitsInPlace(logger, threads, dbg)) {
+        RebuildWithConnections(logger, threads, dbg, storages, connections);
+        return;
+    }
+    delta.fillAnchors(500);
+    delta.apply(logger, threads, dbg, storages);
+}
+
 Connection::Connection(dbg::EdgePosition pos1, dbg::EdgePosition pos2, Sequence connection) :
         pos1(pos1), pos2(pos2), connection(connection) {
     VERIFY(connection.startsWith(pos1.kmerSeq()));
@@ -7,6 +7,7 @@
 #include "common/rolling_hash.hpp"
 #include "common/hash_utils.hpp"
 #include "sequences/seqio.hpp"
+#include "sequences/read_cache.hpp"
 #include "common/logging.hpp"
 #include "common/omp_utils.hpp"
 
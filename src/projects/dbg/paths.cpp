@@ -67,12 +67,13 @@ double dbg::Path::minCoverage() const {
 }
 
 Sequence dbg::Path::Seq() const {
-    SequenceBuilder sb;
-    sb.append(start().seq);
+    std::vector<Sequence> parts;
+    parts.reserve(path.size() + 1);
+    parts.emplace_back(start().seq);
     for (const Edge *e : path) {
-        sb.append(e->seq);
+        parts.emplace_back(e->seq);
     }
-    return sb.BuildSequence();
+    return Sequence::Concat(parts);
 }
 
 Sequence dbg::Path::truncSeq() const {
@@ -460,10 +461,10 @@ dbg::GraphAlignment dbg::GraphAligner::align(const Sequence &seq) const {
     size_t k = dbg.hasher().getK();
     GraphAlignment res;
     if (kmers.size() == 0) {
-        hashing::KWH kwh(dbg.hasher(), seq, 0);
+        hashing::KmerCursor kwh(dbg.hasher(), seq, 0);
         while (true) {
             if (dbg.isAnchor(kwh.hash())) {
-                EdgePosition pos = dbg.getAnchor(kwh);
+                EdgePosition pos = dbg.getAnchor(kwh.kwh());
                 VERIFY(kwh.pos < pos.pos);
                 VERIFY(pos.pos + seq.size() - kwh.pos <= pos.edge->size() + k);
                 Segment<Edge> seg(*pos.edge, pos.pos - kwh.pos, pos.pos + seq.size() - kwh.pos - k);
@@ -478,7 +479,7 @@ dbg::GraphAlignment dbg::GraphAligner::align(const Sequence &seq) const {
                 };
                 return res;
             }
-            kwh = kwh.next();
+            kwh.next();
         }
     }
     Vertex *prestart = &dbg.getVertex(kmers.front());
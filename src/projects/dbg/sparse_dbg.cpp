@@ -1,21 +1,18 @@
 #include "sparse_dbg.hpp"
+#include "sequences/mapped_reader.hpp"
 using namespace dbg;
 
 Edge Edge::_fake = Edge(nullptr, nullptr, Sequence());
 
 size_t Edge::updateTipSize() const {
     size_t new_val = 0;
-    if(extraInfo == size_t(-1) && end_->inDeg() == 1) {
+    if(__atomic_load_n(&extraInfo, __ATOMIC_ACQUIRE) == size_t(-1) && end_->inDeg() == 1) {
         for (const Edge & other : *end_) {
-            other.end_->lock();
-            new_val = std::max(new_val, other.extraInfo);
-            other.end_->unlock();
+            new_val = std::max(new_val, __atomic_load_n(&other.extraInfo, __ATOMIC_ACQUIRE));
         }
         if(new_val != size_t(-1))
             new_val += size();
-        end_->lock();
-        extraInfo = new_val;
-        end_->unlock();
+        __atomic_store_n(&extraInfo, new_val, __ATOMIC_RELEASE);
     }
     return new_val;
 }
@@ -177,7 +174,6 @@ Sequence Edge::firstNucl() const {
 //}
 
 Vertex::Vertex(hashing::htype hash, Vertex *_rc) : hash_(hash), rc_(_rc), canonical(false) {
-    omp_init_lock(&writelock);
 }
 
 bool Vertex::isCanonical() const {
@@ -199,7 +195,7 @@ bool Vertex::isCanonical(const Edge &edge) const {
 }
 
 void Vertex::checkConsistency() const {
-    for (const Edge &edge : outgoing_) {
+    for (const Edge &edge : *this) {
         if (edge.end() != nullptr) {
             if (edge.rc().end() != &(this->rc())) {
                 std::cout << this << " " << seq << " " << edge.seq << " " << edge.rc().end() << " "
@@ -240,26 +236,22 @@ void Vertex::incCoverage() {
     rc().coverage_ += 1;
 }
 
-void Vertex::setSequence(const Sequence &_seq) {
-    lock();
-    if (seq.empty()) {
+void Vertex::setSequence(const Sequence &_seq, NuclArena *arena) {
+    Vertex &owner = canonical ? *this : *rc_;
+    unsigned char state = 0;
+    if (owner.seq_state_.compare_exchange_strong(state, 1, std::memory_order_acq_rel)) {
         if (seq.empty()) {
-            seq = Sequence(_seq.str());
-            unlock();
-            rc_->lock();
-            rc_->seq = !_seq;
-            rc_->unlock();
-        } else {
-            unlock();
+            seq = arena == nullptr ? Sequence(_seq.str()) : _seq.copy(*arena);
+            rc_->seq = !seq;
         }
+        owner.seq_state_.store(2, std::memory_order_release);
     } else {
-//            if(seq != _seq) {
-//                std::cout << seq << std::endl << _seq << std::endl;
-//                VERIFY(false);
-//            }
-//            VERIFY(_seq == seq);
-        unlock();
+        while (owner.seq_state_.load(std::memory_order_acquire) != 2);
     }
+#ifdef LJA_HASH64
+    VERIFY_MSG(seq == _seq, "Hash collision for vertex " << hash_ << ": " << seq << " and " << _seq
+               << ". Rebuild without LJA_HASH64 or use a different hash base.");
+#endif
 }
 
 void Vertex::clearSequence() {
@@ -267,51 +259,133 @@ void Vertex::clearSequence() {
         seq = Sequence();
         rc_->seq = Sequence();
     }
+    (canonical ? *this : *rc_).seq_state_ = 0;
+}
+
+//Walks the chain of the slot and either finds an edge that starts with the new one, appends a new edge with CAS or
+//replaces an edge that is a prefix of the new one. Replacement first marks the next link of the old edge, so that it
+//can not change, and then swings the link pointing to the old edge to its longer copy. Threads that meet a marked
+//link start over from the slot since the edge owning it is about to be replaced.
+Edge &Vertex::insertEdge(const Edge &edge) {
+    VERIFY(edge.size() > 0);
+    Edge *created = new Edge(edge);
+    Edge *replaced = nullptr;
+    while(true) {
+        Edge **link = &outgoing_[edge.seq[0]];
+        Edge *e = Edge::load(*link);
+        while(!Edge::isMarked(e)) {
+            if (replaced != nullptr) {
+                VERIFY(e != nullptr);
+                if (e == replaced) {
+                    created->next_ = Edge::unmarked(Edge::load(replaced->next_));
+                    if (!Edge::exchange(*link, replaced, created))
+                        break;
+                    RetiredEdge *node = new RetiredEdge{replaced, __atomic_load_n(&retired_, __ATOMIC_ACQUIRE)};
+                    while (!__atomic_compare_exchange_n(&retired_, &node->next, node, false,
+                                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+                    return *created;
+                }
+            } else if (e == nullptr) {
+                created->next_ = nullptr;
+                if (Edge::exchange(*link, nullptr, created)) {
+                    out_deg_.fetch_add(1, std::memory_order_acq_rel);
+                    return *created;
+                }
+                e = Edge::load(*link);
+                continue;
+            } else if (edge.size() <= e->size()) {
+                if (edge.seq == e->seq.Subseq(0, edge.size())) {
+                    if (Edge::isMarked(Edge::load(e->next_)))
+                        break;
+                    delete created;
+                    return *e;
+                }
+            } else if (edge.seq.Subseq(0, e->size()) == e->seq) {
+                Edge *next = Edge::load(e->next_);
+                if (Edge::isMarked(next) ||
+                        !Edge::exchange(e->next_, next, reinterpret_cast<Edge *>(uintptr_t(next) | 1u)))
+                    break;
+                replaced = e;
+                continue;
+            }
+            link = &e->next_;
+            e = Edge::load(*link);
+        }
+    }
 }
 
 Edge &Vertex::addEdgeLockFree(const Edge &edge) {
-    for (Edge &e : outgoing_) {
-        if (edge.size() <= e.size()) {
-            if (edge.seq == e.seq.Subseq(0, edge.size())) {
-                return e;
-            }
-        } else if (edge.seq.Subseq(0, e.size()) == e.seq) {
-            e = edge;
-            return e;
+    return insertEdge(edge);
+}
+
+void Vertex::addEdge(const Edge &edge) {
+    insertEdge(edge);
+}
+
+void Vertex::releaseEdges() {
+    for (Edge *&slot : outgoing_) {
+        Edge *e = slot;
+        slot = nullptr;
+        while (e != nullptr) {
+            Edge *next = e->next_;
+            delete e;
+            e = next;
         }
     }
-    outgoing_.emplace_back(edge);
-    return outgoing_.back();
+    out_deg_ = 0;
+    releaseRetired();
 }
 
-void Vertex::addEdge(const Edge &e) {
-    omp_set_lock(&writelock);
-    addEdgeLockFree(e);
-    omp_unset_lock(&writelock);
+void Vertex::releaseRetired() {
+    while (retired_ != nullptr) {
+        RetiredEdge *next = retired_->next;
+        delete retired_->edge;
+        delete retired_;
+        retired_ = next;
+    }
 }
 
-Edge &Vertex::getOutgoing(unsigned char c) const {
-    for (Edge &edge : outgoing_) {
-        if (edge.seq[0] == c) {
-            return edge;
+//Not thread safe. The edge is retired like a replaced one, so its address is not reused until releaseRetired.
+void Vertex::removeOutgoing(Edge &edge) {
+    for (Edge **link = &outgoing_[edge.seq[0]]; *link != nullptr; link = &(*link)->next_) {
+        if (*link == &edge) {
+            __atomic_store_n(link, edge.next_, __ATOMIC_RELEASE);
+            retired_ = new RetiredEdge{&edge, retired_};
+            out_deg_--;
+            return;
         }
     }
+    VERIFY(false);
+}
+
+Edge &Vertex::operator[](size_t ind) const {
+//    Edges of junction graphs occupy one slot each, so only chains of sparse graphs are walked
+    for (Edge *head : outgoing_) {
+        for (Edge *e = Edge::load(head); e != nullptr; e = e->next()) {
+            if (ind == 0)
+                return *e;
+            ind--;
+        }
+    }
+    VERIFY(false);
+    return Edge::fake();
+}
+
+Edge &Vertex::getOutgoing(unsigned char c) const {
+    Edge *res = Edge::load(outgoing_[c]);
+    if (res != nullptr)
+        return *res;
     std::cout << seq << std::endl;
     std::cout << size_t(c) << std::endl;
-    for (const Edge &edge : outgoing_) {
+    for (const Edge &edge : *this) {
         std::cout << edge.seq << std::endl;
     }
     VERIFY(false);
-    return outgoing_[0];
+    return Edge::fake();
 }
 
 bool Vertex::hasOutgoing(unsigned char c) const {
-    for (const Edge &edge : outgoing_) {
-        if (edge.seq[0] == c) {
-            return true;
-        }
-    }
-    return false;
+    return Edge::load(outgoing_[c]) != nullptr;
 }
 
 bool Vertex::operator<(const Vertex &other) const {
@@ -323,19 +397,19 @@ bool Vertex::operator>(const Vertex &other) const {
 }
 
 void Vertex::clear() {
-    outgoing_.clear();
-    rc_->outgoing_.clear();
+    releaseEdges();
+    rc_->releaseEdges();
 }
 
 void Vertex::clearOutgoing() {
-    outgoing_.clear();
+    releaseEdges();
 }
 
 Vertex::Vertex(hashing::htype hash) : hash_(hash), rc_(new Vertex(hash, this)), canonical(true) {
-    omp_init_lock(&writelock);
 }
 
 Vertex::~Vertex() {
+    releaseEdges();
     if (rc_ != nullptr) {
         rc_->rc_ = nullptr;
         delete rc_;
@@ -343,8 +417,20 @@ Vertex::~Vertex() {
     rc_ = nullptr;
 }
 
+//Slots are ordered by the first nucleotide already, only chains of edges in sparse graphs need sorting
 void Vertex::sortOutgoing() {
-    std::sort(outgoing_.begin(), outgoing_.end());
+    for (Edge *&slot : outgoing_) {
+        std::vector<Edge *> chain;
+        for (Edge *e = slot; e != nullptr; e = e->next_)
+            chain.emplace_back(e);
+        if (chain.size() < 2)
+            continue;
+        std::sort(chain.begin(), chain.end(), [](const Edge *a, const Edge *b) {return *a < *b;});
+        for (size_t i = 0; i + 1 < chain.size(); i++)
+            chain[i]->next_ = chain[i + 1];
+        chain.back()->next_ = nullptr;
+        slot = chain.front();
+    }
 }
 
 bool Vertex::isJunction() const {
@@ -383,6 +469,7 @@ void SparseDBG::checkSeqFilled(size_t threads, logging::Logger &logger) {
 
 SparseDBG SparseDBG::Subgraph(std::vector<Segment<Edge>> &pieces) {
     SparseDBG res(hasher_);
+    res.borrowArenas(*this);
     for(auto &it : v) {
         res.addVertex(it.second.seq);
     }
@@ -410,6 +497,7 @@ SparseDBG SparseDBG::Subgraph(std::vector<Segment<Edge>> &pieces) {
 
 SparseDBG SparseDBG::SplitGraph(const std::vector<EdgePosition> &breaks) {
     SparseDBG res(hasher_);
+    res.borrowArenas(*this);
     for(Vertex &it : verticesUnique()) {
         res.addVertex(it);
     }
@@ -437,6 +525,7 @@ SparseDBG SparseDBG::SplitGraph(const std::vector<EdgePosition> &breaks) {
 
 SparseDBG SparseDBG::AddNewSequences(logging::Logger &logger, size_t threads, const std::vector<Sequence> &new_seqs) {
     SparseDBG res(hasher_);
+    res.borrowArenas(*this);
     for(Vertex &it : verticesUnique()) {
         res.addVertex(it);
     }
@@ -537,10 +626,19 @@ void SparseDBG::checkDBGConsistency(size_t threads, logging::Logger &logger) {
     }
 }
 
+void SparseDBG::addVertices(std::vector<hashing::htype> hashs, size_t threads) {
+    omp_set_num_threads(threads);
+    __gnu_parallel::sort(hashs.begin(), hashs.end());
+    hashs.erase(std::unique(hashs.begin(), hashs.end()), hashs.end());
+    hashs.erase(std::remove_if(hashs.begin(), hashs.end(),
+                               [this](hashing::htype h) {return containsVertex(h);}), hashs.end());
+    v.emplaceDistinct(hashs, threads);
+}
+
 Vertex &SparseDBG::addVertex(const hashing::KWH &kwh) {
     Vertex &newVertex = innerAddVertex(kwh.hash());
     Vertex &res = kwh.isCanonical() ? newVertex : newVertex.rc();
-    res.setSequence(kwh.getSeq());
+    res.setSequence(kwh.getSeq(), arena_.get());
     return res;
 }
 
@@ -594,76 +692,97 @@ std::array<Vertex *, 2> SparseDBG::getVertices(hashing::htype hash) {
 
 void SparseDBG::fillAnchors(size_t w, logging::Logger &logger, size_t threads) {
     logger.trace() << "Adding anchors from long edges for alignment" << std::endl;
-    ParallelRecordCollector<std::pair<const hashing::htype, EdgePosition>> res(threads);
+    ParallelRecordCollector<std::pair<hashing::htype, AnchorPosition>> res(threads);
     std::function<void(size_t, Edge &)> task = [&res, w, this](size_t pos, Edge &edge) {
         Vertex &vertex = *edge.start();
         if (edge.size() > w) {
             Sequence seq = vertex.seq + edge.seq;
 //                    Does not run for the first and last kmers.
-            for (hashing::KWH kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer = kmer.next()) {
+            for (hashing::KmerCursor kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer.next()) {
                 if (kmer.pos % w == 0) {
                     EdgePosition ep(edge, kmer.pos);
                     if (kmer.isCanonical())
-                        res.emplace_back(kmer.hash(), ep);
+                        res.emplace_back(kmer.hash(), AnchorPosition(ep));
                     else {
-                        res.emplace_back(kmer.hash(), ep.RC());
+                        res.emplace_back(kmer.hash(), AnchorPosition(ep.RC()));
                     }
                 }
             }
         }
     };
     processObjects(edges().begin(), edges().end(), logger, threads, task);
-    for (auto &tmp : res) {
-        anchors.emplace(tmp);
-    }
+    anchors.add(res.collect(), threads);
     logger.trace() << "Added " << anchors.size() << " anchors" << std::endl;
 }
 
 void SparseDBG::fillAnchors(size_t w, logging::Logger &logger, size_t threads,
                             const std::unordered_set<hashing::htype, hashing::alt_hasher<hashing::htype>> &to_add) {
     logger.trace() << "Adding anchors from long edges for alignment" << std::endl;
-    ParallelRecordCollector<std::pair<const hashing::htype, EdgePosition>> res(threads);
+    ParallelRecordCollector<std::pair<hashing::htype, AnchorPosition>> res(threads);
     std::function<void(size_t, Edge &)> task = [&res, w, this, &to_add](size_t pos, Edge &edge) {
         Vertex &vertex = *edge.start();
         if (edge.size() > w || !to_add.empty()) {
             Sequence seq = vertex.seq + edge.seq;
 //                    Does not run for the first and last kmers.
-            for (hashing::KWH kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer = kmer.next()) {
+            for (hashing::KmerCursor kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer.next()) {
                 if (kmer.pos % w == 0 || to_add.find(kmer.hash()) != to_add.end()) {
                     EdgePosition ep(edge, kmer.pos);
                     if (kmer.isCanonical())
-                        res.emplace_back(kmer.hash(), ep);
+                        res.emplace_back(kmer.hash(), AnchorPosition(ep));
                     else {
-                        res.emplace_back(kmer.hash(), ep.RC());
+                        res.emplace_back(kmer.hash(), AnchorPosition(ep.RC()));
                     }
                 }
             }
         }
     };
     processObjects(edges().begin(), edges().end(), logger, threads, task);
-    for (auto &tmp : res) {
-        anchors.emplace(tmp);
-    }
+    anchors.add(res.collect(), threads);
     logger.trace() << "Added " << anchors.size() << " anchors" << std::endl;
 }
 
+void SparseDBG::fillAnchors(size_t w, logging::Logger &logger, size_t threads, const std::vector<Edge *> &edges) {
+    logger.trace() << "Adding anchors from " << edges.size() << " new edges" << std::endl;
+    ParallelRecordCollector<std::pair<hashing::htype, AnchorPosition>> res(threads);
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 16) shared(edges, res, w)
+    for(size_t i = 0; i < edges.size(); i++) {
+        Edge &edge = *edges[i];
+        if (edge.size() <= w)
+            continue;
+        Sequence seq = edge.start()->seq + edge.seq;
+        for (hashing::KmerCursor kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer.next()) {
+            if (kmer.pos % w == 0) {
+                EdgePosition ep(edge, kmer.pos);
+                if (kmer.isCanonical())
+                    res.emplace_back(kmer.hash(), AnchorPosition(ep));
+                else
+                    res.emplace_back(kmer.hash(), AnchorPosition(ep.RC()));
+            }
+        }
+    }
+    anchors.insert(res.collect(), threads);
+    logger.trace() << "Graph has " << anchors.size() << " anchors" << std::endl;
+}
+
 EdgePosition SparseDBG::getAnchor(const hashing::KWH &kwh) {
+    EdgePosition res = anchors.value(anchors.find(kwh.hash())).position();
     if (kwh.isCanonical())
-        return anchors.find(kwh.hash())->second;
+        return res;
     else
-        return anchors.find(kwh.hash())->second.RC();
+        return res.RC();
 }
 
 std::vector<hashing::KWH> SparseDBG::extractVertexPositions(const Sequence &seq, size_t max) const {
     std::vector<hashing::KWH> res;
-    hashing::KWH kwh(hasher(), seq, 0);
+    hashing::KmerCursor kwh(hasher(), seq, 0);
     while (true) {
         if (containsVertex(kwh.hash())) {
-            res.emplace_back(kwh);
+            res.emplace_back(kwh.kwh());
         }
         if (!kwh.hasNext() || res.size() == max)
             break;
-        kwh = kwh.next();
+        kwh.next();
     }
     return std::move(res);
 }
@@ -679,16 +798,22 @@ void SparseDBG::printFastaOld(const std::experimental::filesystem::path &out) {
 }
 
 void SparseDBG::processRead(const Sequence &seq) {
+    processRead(seq, [](const Vertex &) {return true;});
+}
+
+void SparseDBG::processRead(const Sequence &seq, const std::function<bool(const Vertex &)> &filter) {
     std::vector<hashing::KWH> kmers = extractVertexPositions(seq);
     if (kmers.size() == 0) {
         std::cout << seq << std::endl;
     }
     VERIFY(kmers.size() > 0);
     std::vector<Vertex *> vertices;
+    std::vector<bool> accepted;
     for (size_t i = 0; i < kmers.size(); i++) {
         vertices.emplace_back(&getVertex(kmers[i]));
-        if (i == 0 || vertices[i] != vertices[i - 1]) {
-            vertices.back()->setSequence(kmers[i].getSeq());
+        accepted.push_back(filter(*vertices.back()));
+        if (accepted.back() && (i == 0 || vertices[i] != vertices[i - 1])) {
+            vertices.back()->setSequence(kmers[i].getSeq(), arena_.get());
             vertices.back()->incCoverage();
         }
     }
@@ -700,18 +825,21 @@ void SparseDBG::processRead(const Sequence &seq) {
             kmers[i + 1].pos - kmers[i].pos < hasher_.getK()) {
             continue;
         }
-        vertices[i]->addEdge(Edge(vertices[i], vertices[i + 1], Sequence(seq.Subseq(kmers[i].pos + hasher_.getK(),
-                                                                                    kmers[i + 1].pos +
-                                                                                    hasher_.getK()).str())));
-        vertices[i + 1]->rc().addEdge(Edge(&vertices[i + 1]->rc(), &vertices[i]->rc(),
-                                           !Sequence(seq.Subseq(kmers[i].pos, kmers[i + 1].pos).str())));
+        if (accepted[i])
+            vertices[i]->addEdge(Edge(vertices[i], vertices[i + 1], copySequence(seq.Subseq(kmers[i].pos + hasher_.getK(),
+                                                                                            kmers[i + 1].pos +
+                                                                                            hasher_.getK()))));
+        if (accepted[i + 1])
+            vertices[i + 1]->rc().addEdge(Edge(&vertices[i + 1]->rc(), &vertices[i]->rc(),
+                                               !copySequence(seq.Subseq(kmers[i].pos, kmers[i + 1].pos))));
     }
-    if (kmers.front().pos > 0) {
-        vertices.front()->rc().addEdge(Edge(&vertices.front()->rc(), nullptr, !(seq.Subseq(0, kmers[0].pos))));
+//    Tips are copied like other edges, so that replaced tips do not keep the buffer of the read until they are freed
+    if (kmers.front().pos > 0 && accepted.front()) {
+        vertices.front()->rc().addEdge(Edge(&vertices.front()->rc(), nullptr, !copySequence(seq.Subseq(0, kmers[0].pos))));
     }
-    if (kmers.back().pos + hasher_.getK() < seq.size()) {
+    if (kmers.back().pos + hasher_.getK() < seq.size() && accepted.back()) {
         vertices.back()->addEdge(
-                Edge(vertices.back(), nullptr, seq.Subseq(kmers.back().pos + hasher_.getK(), seq.size())));
+                Edge(vertices.back(), nullptr, copySequence(seq.Subseq(kmers.back().pos + hasher_.getK(), seq.size()))));
     }
 }
 
@@ -759,6 +887,48 @@ void SparseDBG::processEdge(Edge &other_graph_edge) {
     }
 }
 
+void SparseDBG::moveToArena(logging::Logger &logger, size_t threads) {
+    enableArena();
+    NuclArena &arena = *arena_;
+    std::vector<Vertex *> vertices;
+    std::vector<std::pair<Edge *, Edge *>> edge_pairs;
+//    Every edge is copied together with its reverse complement by one thread, tips have no reverse complement
+    for(Vertex &vertex : verticesUnique()) {
+        vertices.emplace_back(&vertex);
+        for(Vertex *start : {&vertex, &vertex.rc()}) {
+            for(Edge &edge : *start) {
+                if(edge.end() == nullptr)
+                    edge_pairs.emplace_back(&edge, nullptr);
+                else if(&edge <= &edge.rc())
+                    edge_pairs.emplace_back(&edge, &edge.rc());
+            }
+        }
+    }
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(vertices, arena)
+    for(size_t i = 0; i < vertices.size(); i++) {
+        Vertex &vertex = *vertices[i];
+        vertex.seq = vertex.seq.copy(arena);
+        vertex.rc().seq = !vertex.seq;
+    }
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(edge_pairs, arena)
+    for(size_t i = 0; i < edge_pairs.size(); i++) {
+        Edge &edge = *edge_pairs[i].first;
+        Edge *rc = edge_pairs[i].second;
+        size_t k = edge.start()->seq.size();
+        if(rc != nullptr && edge.size() > k) {
+            Sequence full = (edge.start()->seq + edge.seq).copy(arena);
+            edge.seq = full.Subseq(k);
+            rc->seq = (!full).Subseq(k);
+        } else {
+            edge.seq = edge.seq.copy(arena);
+            if(rc != nullptr && rc != &edge)
+                rc->seq = rc->seq.copy(arena);
+        }
+    }
+    logger.trace() << "Graph sequence arena: " << arena << std::endl;
+}
+
 IterableStorage<ApplyingIterator<SparseDBG::vertex_iterator_type, Vertex, 2>> SparseDBG::vertices(bool unique) {
     std::function<std::array<Vertex*, 2>(std::pair<const hashing::htype, Vertex> &)> apply =
             [unique](std::pair<const hashing::htype, Vertex> &it) -> std::array<Vertex*, 2> {
@@ -803,6 +973,23 @@ IterableStorage<ApplyingIterator<SparseDBG::vertex_iterator_type, Edge, 8>> Spar
     return edges(true);
 }
 
+void SparseDBG::releaseRetiredEdges() {
+    for (auto &it : v) {
+        it.second.releaseRetired();
+        it.second.rc().releaseRetired();
+    }
+}
+
+void SparseDBG::releaseRetiredEdges(const std::vector<hashing::htype> &hashs) {
+    for (hashing::htype hash : hashs) {
+        auto it = v.find(hash);
+        if (it != v.end()) {
+            it->second.releaseRetired();
+            it->second.rc().releaseRetired();
+        }
+    }
+}
+
 void SparseDBG::removeIsolated() {
     vertex_map_type newv;
     std::vector<hashing::htype> todelete;
@@ -813,6 +1000,7 @@ void SparseDBG::removeIsolated() {
             ++it;
         }
     }
+    v.compact();
 }
 
 void SparseDBG::removeMarked() {
@@ -823,6 +1011,82 @@ void SparseDBG::removeMarked() {
             ++it;
         }
     }
+    v.compact();
+}
+
+std::vector<Edge *> SparseDBG::splitEdge(Edge &edge, std::vector<size_t> positions) {
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+    std::vector<Edge *> res = {&edge};
+    if(positions.empty())
+        return res;
+    VERIFY(positions.front() > 0 && positions.back() < edge.size());
+    std::function<std::vector<Edge *>(Edge &, const std::vector<size_t> &)> cut =
+            [this](Edge &e, const std::vector<size_t> &pos) {
+        std::vector<Vertex *> starts;
+        for(size_t p : pos)
+            starts.emplace_back(&addVertex(e.kmerSeq(p)));
+        Sequence seq = e.seq;
+        size_t cov = e.intCov();
+        std::vector<Edge *> pieces = {&e};
+        for(size_t i = 0; i < pos.size(); i++) {
+            Vertex *end = i + 1 < pos.size() ? starts[i + 1] : e.end_;
+            Edge piece(starts[i], end, seq.Subseq(pos[i], i + 1 < pos.size() ? pos[i + 1] : seq.size()));
+            piece.cov = cov * piece.size() / seq.size();
+            piece.is_reliable = e.is_reliable;
+            e.cov -= piece.cov;
+            pieces.emplace_back(&starts[i]->addEdgeLockFree(piece));
+        }
+        e.seq = seq.Subseq(0, pos.front());
+        e.end_ = starts.front();
+        return pieces;
+    };
+    Edge &rc = edge.rc();
+    std::vector<size_t> rc_positions;
+    for(auto it = positions.rbegin(); it != positions.rend(); ++it)
+        rc_positions.emplace_back(edge.size() - *it);
+    if(&rc == &edge) {
+        VERIFY(rc_positions == positions);
+        return cut(edge, positions);
+    }
+    res = cut(edge, positions);
+    cut(rc, rc_positions);
+    return res;
+}
+
+void SparseDBG::removeEdge(Edge &edge) {
+    Edge &rc = edge.rc();
+    if(&rc != &edge)
+        rc.start()->removeOutgoing(rc);
+    edge.start()->removeOutgoing(edge);
+}
+
+void SparseDBG::removeVertex(Vertex &vertex) {
+    auto it = v.find(vertex.hash());
+    VERIFY(it != v.end());
+    v.erase(it);
+}
+
+void SparseDBG::remapAnchors(const std::vector<Sequence> &old_seqs, const std::function<bool(EdgePosition &)> &remap) {
+    if(anchors.empty())
+        return;
+    std::vector<hashing::htype> hashs;
+    for(const Sequence &seq : old_seqs) {
+        for (hashing::KmerCursor kmer(this->hasher_, seq, 1); kmer.hasNext(); kmer.next()) {
+            if(anchors.contains(kmer.hash()))
+                hashs.emplace_back(kmer.hash());
+        }
+    }
+    std::sort(hashs.begin(), hashs.end());
+    hashs.erase(std::unique(hashs.begin(), hashs.end()), hashs.end());
+    for(hashing::htype hash : hashs) {
+        size_t i = anchors.find(hash);
+        EdgePosition ep = anchors.value(i).position();
+        if(remap(ep))
+            anchors.set(i, AnchorPosition(ep));
+        else
+            anchors.erase(i);
+    }
 }
 
 //const Vertex &SparseDBG::getVertex(const hashing::KWH &kwh) const {
@@ -846,3 +1110,230 @@ std::vector<EdgePosition> EdgePosition::step() const {
         return {{*edge, pos + 1}};
     }
 }
+
+namespace {
+//    Snapshot layout. All fields are 64-bit words, all sections are padded to 8 bytes:
+//    header, vertex hashes, vertex records, edge offsets of every vertex side, edge records,
+//    anchor hashes, anchor records, edge ids and packed sequences.
+//    The header keeps the size and modification time of the fasta file printed for the graph together with the snapshot,
+//    so that the snapshot can be validated against the fasta without reading it.
+//    Vertex side 0 is the canonical vertex stored in the map and side 1 is its reverse complement.
+//    Vertices and edge ends are referenced as vertex index * 2 + side, missing ends are all ones.
+    struct SnapshotHeader {
+        char magic[8];
+        uint64_t k;
+        uint64_t hash_base;
+        uint64_t hash_size;
+        uint64_t vertex_num;
+        uint64_t edge_num;
+        uint64_t anchor_num;
+        uint64_t ids_size;
+        uint64_t words_size;
+        uint64_t fasta_size;
+        uint64_t fasta_mtime;
+    };
+
+    struct SnapshotVertex {
+        uint64_t coverage;
+        uint64_t seq_size;
+        uint64_t seq_offset;
+    };
+
+    struct SnapshotEdge {
+        uint64_t end;
+        uint64_t cov;
+        uint64_t extra_info;
+        uint64_t is_reliable;
+        uint64_t seq_size;
+        uint64_t seq_offset;
+        uint64_t id_offset;
+        uint64_t id_size;
+    };
+
+    struct SnapshotAnchor {
+        uint64_t edge;
+        uint64_t pos;
+    };
+
+    const char *snapshotMagic() {
+        return "LJASDG03";
+    }
+
+    const uint64_t no_vertex = uint64_t(-1);
+
+    size_t snapshotWords(size_t bytes) {
+        return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    }
+
+    uint64_t fileMtime(const std::experimental::filesystem::path &path) {
+        return uint64_t(std::experimental::filesystem::last_write_time(path).time_since_epoch().count());
+    }
+
+    void writeSnapshotSection(std::ostream &os, const void *data, size_t bytes) {
+        static const char zeros[sizeof(uint64_t)] = {};
+        os.write(static_cast<const char *>(data), bytes);
+        os.write(zeros, snapshotWords(bytes) * sizeof(uint64_t) - bytes);
+    }
+}
+
+void SparseDBG::saveSnapshot(const std::experimental::filesystem::path &out,
+                             const std::experimental::filesystem::path &fasta) const {
+    SnapshotHeader header{};
+    header.fasta_size = std::experimental::filesystem::file_size(fasta);
+    header.fasta_mtime = fileMtime(fasta);
+    memcpy(header.magic, snapshotMagic(), sizeof(header.magic));
+    header.k = hasher_.getK();
+    header.hash_base = uint64_t(hasher_.getBase());
+    header.hash_size = sizeof(hashing::htype);
+    std::vector<const Vertex *> vertices;
+    std::unordered_map<const Vertex *, uint64_t> vertex_ids;
+    for(const auto &it : v) {
+        for(const Vertex *vertex : {&it.second, &it.second.rc()}) {
+            vertex_ids[vertex] = vertices.size();
+            vertices.emplace_back(vertex);
+        }
+    }
+    std::vector<hashing::htype> vertex_hashs;
+    std::vector<SnapshotVertex> vertex_records;
+    std::string ids;
+    std::vector<uint64_t> words;
+    for(size_t i = 0; i < vertices.size(); i += 2) {
+        const Vertex &vertex = *vertices[i];
+        std::vector<uint64_t> packed = vertex.seq.packed();
+        vertex_hashs.emplace_back(vertex.hash());
+        vertex_records.push_back({vertex.coverage(), vertex.seq.size(), words.size()});
+        words.insert(words.end(), packed.begin(), packed.end());
+    }
+    std::vector<uint64_t> edge_offsets = {0};
+    std::vector<SnapshotEdge> edge_records;
+    std::unordered_map<const Edge *, uint64_t> edge_ids;
+    for(const Vertex *vertex : vertices) {
+        for(const Edge &edge : *vertex) {
+            edge_ids[&edge] = edge_records.size();
+            std::vector<uint64_t> packed = edge.seq.packed();
+            edge_records.push_back({edge.end() == nullptr ? no_vertex : vertex_ids.find(edge.end())->second,
+                                    edge.intCov(), edge.extraInfo, edge.is_reliable, edge.size(), words.size(),
+                                    ids.size(), edge.id.size()});
+            words.insert(words.end(), packed.begin(), packed.end());
+            ids += edge.id;
+        }
+        edge_offsets.emplace_back(edge_records.size());
+    }
+//    Anchors pointing to edges that are no longer in the graph are not saved
+    std::vector<hashing::htype> anchor_hashs;
+    std::vector<SnapshotAnchor> anchor_records;
+    for(size_t i = 0; i < anchors.size(); i++) {
+        const AnchorPosition &ep = anchors.value(i);
+        auto edge_it = edge_ids.find(ep.edge);
+        if(edge_it == edge_ids.end() || ep.pos > ep.edge->size())
+            continue;
+        anchor_hashs.emplace_back(anchors.key(i));
+        anchor_records.push_back({edge_it->second, ep.pos});
+    }
+    header.vertex_num = vertex_hashs.size();
+    header.edge_num = edge_records.size();
+    header.anchor_num = anchor_hashs.size();
+    header.ids_size = ids.size();
+    header.words_size = words.size();
+    std::ofstream os;
+    os.open(out, std::ios::binary);
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeSnapshotSection(os, vertex_hashs.data(), vertex_hashs.size() * sizeof(hashing::htype));
+    writeSnapshotSection(os, vertex_records.data(), vertex_records.size() * sizeof(SnapshotVertex));
+    writeSnapshotSection(os, edge_offsets.data(), edge_offsets.size() * sizeof(uint64_t));
+    writeSnapshotSection(os, edge_records.data(), edge_records.size() * sizeof(SnapshotEdge));
+    writeSnapshotSection(os, anchor_hashs.data(), anchor_hashs.size() * sizeof(hashing::htype));
+    writeSnapshotSection(os, anchor_records.data(), anchor_records.size() * sizeof(SnapshotAnchor));
+    writeSnapshotSection(os, ids.data(), ids.size());
+    writeSnapshotSection(os, words.data(), words.size() * sizeof(uint64_t));
+    os.close();
+    VERIFY_MSG(!os.fail(), "Failed to write graph snapshot to " << out);
+}
+
+bool SparseDBG::snapshotMatches(const std::experimental::filesystem::path &snapshot,
+                                const std::experimental::filesystem::path &fasta, const hashing::RollingHash &hasher) {
+    SnapshotHeader header{};
+    std::ifstream is(snapshot, std::ios::binary);
+    if(!is.read(reinterpret_cast<char *>(&header), sizeof(header)) || memcmp(header.magic, snapshotMagic(), 8) != 0 ||
+            header.hash_size != sizeof(hashing::htype) || header.k != hasher.getK() || header.hash_base != uint64_t(hasher.getBase()))
+        return false;
+    return std::experimental::filesystem::exists(fasta) &&
+           std::experimental::filesystem::file_size(fasta) == header.fasta_size && fileMtime(fasta) == header.fasta_mtime;
+}
+
+SparseDBG SparseDBG::loadSnapshot(const std::experimental::filesystem::path &in, logging::Logger &logger, size_t threads) {
+    logger.info() << "Loading graph from snapshot " << in << std::endl;
+    io::MappedFile file(in);
+    VERIFY_MSG(file.size() >= sizeof(SnapshotHeader) && memcmp(file.data(), snapshotMagic(), 8) == 0,
+               "File " << in << " is not a graph snapshot");
+    SnapshotHeader header{};
+    memcpy(&header, file.data(), sizeof(header));
+    VERIFY_MSG(header.hash_size == sizeof(hashing::htype), "Graph snapshot was saved with " << header.hash_size * 8 << "-bit hashes");
+    const char *ptr = file.data() + sizeof(header);
+    auto section = [&ptr](size_t bytes) {
+        const char *res = ptr;
+        ptr += snapshotWords(bytes) * sizeof(uint64_t);
+        return res;
+    };
+    const auto *vertex_hashs = reinterpret_cast<const hashing::htype *>(section(header.vertex_num * sizeof(hashing::htype)));
+    const auto *vertex_records = reinterpret_cast<const SnapshotVertex *>(section(header.vertex_num * sizeof(SnapshotVertex)));
+    const auto *edge_offsets = reinterpret_cast<const uint64_t *>(section((header.vertex_num * 2 + 1) * sizeof(uint64_t)));
+    const auto *edge_records = reinterpret_cast<const SnapshotEdge *>(section(header.edge_num * sizeof(SnapshotEdge)));
+    const auto *anchor_hashs = reinterpret_cast<const hashing::htype *>(section(header.anchor_num * sizeof(hashing::htype)));
+    const auto *anchor_records = reinterpret_cast<const SnapshotAnchor *>(section(header.anchor_num * sizeof(SnapshotAnchor)));
+    const char *ids = section(header.ids_size);
+    const auto *words = reinterpret_cast<const uint64_t *>(section(header.words_size * sizeof(uint64_t)));
+    VERIFY_MSG(ptr == file.data() + file.size(), "Graph snapshot " << in << " is corrupted");
+
+    SparseDBG res(hashing::RollingHash(header.k, hashing::htype(header.hash_base)));
+    std::vector<hashing::htype> hashs(header.vertex_num);
+    memcpy(hashs.data(), vertex_hashs, header.vertex_num * sizeof(hashing::htype));
+    res.v.emplaceDistinct(hashs, threads);
+    std::vector<Vertex *> vertices;
+    vertices.reserve(header.vertex_num);
+    for(auto &it : res.v)
+        vertices.emplace_back(&it.second);
+    std::vector<Edge *> edges(header.edge_num);
+//    Vertex and edge sequences are allocated in the arena of the graph instead of a buffer each
+    res.enableArena();
+    NuclArena &arena = *res.arena_;
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 1000) shared(header, vertices, edges, vertex_records, edge_offsets, edge_records, ids, words, arena)
+    for(size_t i = 0; i < header.vertex_num; i++) {
+        Vertex &vertex = *vertices[i];
+        const SnapshotVertex &rec = vertex_records[i];
+        vertex.coverage_ = rec.coverage;
+        vertex.rc().coverage_ = rec.coverage;
+        if(rec.seq_size > 0) {
+            vertex.seq = Sequence::FromPacked(words + rec.seq_offset, rec.seq_size, arena);
+            vertex.rc().seq = !vertex.seq;
+        }
+        for(size_t side = 0; side < 2; side++) {
+            Vertex &start = side == 0 ? vertex : vertex.rc();
+            for(size_t j = edge_offsets[i * 2 + side]; j < edge_offsets[i * 2 + side + 1]; j++) {
+                const SnapshotEdge &erec = edge_records[j];
+                Vertex *end = nullptr;
+                if(erec.end != no_vertex)
+                    end = erec.end % 2 == 0 ? vertices[erec.end / 2] : &vertices[erec.end / 2]->rc();
+                Edge &edge = start.addEdgeLockFree(Edge(&start, end, Sequence::FromPacked(words + erec.seq_offset, erec.seq_size, arena)));
+                edge.incCov(erec.cov);
+                edge.extraInfo = erec.extra_info;
+                edge.is_reliable = erec.is_reliable != 0;
+                edge.id = std::string(ids + erec.id_offset, erec.id_size);
+                edges[j] = &edge;
+            }
+        }
+    }
+    std::vector<std::pair<hashing::htype, AnchorPosition>> anchor_list(header.anchor_num);
+#pragma omp parallel for default(none) shared(header, anchor_hashs, anchor_records, anchor_list, edges)
+    for(size_t i = 0; i < header.anchor_num; i++) {
+        hashing::htype hash;
+        memcpy(&hash, anchor_hashs + i, sizeof(hash));
+        anchor_list[i] = {hash, AnchorPosition(EdgePosition(*edges[anchor_records[i].edge], anchor_records[i].pos))};
+    }
+    res.anchors.add(std::move(anchor_list), threads);
+    logger.info() << "Loaded graph with " << res.size() << " vertices, " << header.edge_num << " edges and "
+                  << header.anchor_num << " anchors" << std::endl;
+    logger.trace() << "Graph sequence arena: " << arena << std::endl;
+    return res;
+}
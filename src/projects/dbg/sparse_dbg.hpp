@@ -5,12 +5,17 @@
 #pragma once
 #include "sequences/sequence.hpp"
 #include "sequences/seqio.hpp"
+#include "sequences/read_cache.hpp"
 #include "common/omp_utils.hpp"
 #include "common/logging.hpp"
 #include "common/rolling_hash.hpp"
 #include "common/hash_utils.hpp"
+#include "common/concurrent_hash_map.hpp"
+#include "common/flat_hash_index.hpp"
 #include <common/oneline_utils.hpp>
 #include <common/iterator_utils.hpp>
+#include <array>
+#include <atomic>
 #include <vector>
 #include <numeric>
 #include <unordered_map>
@@ -26,12 +31,24 @@ namespace dbg {
         Vertex *start_;
         Vertex *end_;
         mutable size_t cov;
+//        Next outgoing edge of the same vertex starting with the same nucleotide. The lowest bit marks an edge that is
+//        being replaced by a longer one, nothing can be appended after a marked edge.
+        Edge *next_ = nullptr;
         static Edge _fake;
+        static bool isMarked(const Edge *link) {return (uintptr_t(link) & 1u) != 0;}
+        static Edge *unmarked(Edge *link) {return reinterpret_cast<Edge *>(uintptr_t(link) & ~uintptr_t(1));}
+        static Edge *load(Edge *const &link) {return __atomic_load_n(&link, __ATOMIC_ACQUIRE);}
+        static bool exchange(Edge *&link, Edge *expected, Edge *desired) {
+            return __atomic_compare_exchange_n(&link, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+        Edge *next() const {return unmarked(load(next_));}
     public:
         mutable size_t extraInfo;
         Sequence seq;
         std::string id = "";
         friend class Vertex;
+        friend class OutgoingIterator;
+        friend class SparseDBG;
         bool is_reliable = false;
         Edge(Vertex *_start, Vertex *_end, const Sequence &_seq) :
                 start_(_start), end_(_end), cov(0), extraInfo(-1), seq(_seq) {
@@ -67,17 +84,69 @@ namespace dbg {
 
 
 
+//    Iterates over outgoing edges of a vertex in the order of their first nucleotide
+    class OutgoingIterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Edge value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Edge *pointer;
+        typedef Edge &reference;
+    private:
+        Edge *const *slots;
+        size_t pos;
+        Edge *cur = nullptr;
+
+        void seek() {
+            while(cur == nullptr && pos < 4) {
+                cur = Edge::load(slots[pos]);
+                if(cur == nullptr)
+                    pos++;
+            }
+        }
+    public:
+        OutgoingIterator(Edge *const *slots, size_t pos) : slots(slots), pos(pos) {seek();}
+        Edge &operator*() const {return *cur;}
+        Edge *operator->() const {return cur;}
+        OutgoingIterator &operator++() {
+            cur = cur->next();
+            if(cur == nullptr) {
+                pos++;
+                seek();
+            }
+            return *this;
+        }
+        bool operator==(const OutgoingIterator &other) const {return pos == other.pos && cur == other.cur;}
+        bool operator!=(const OutgoingIterator &other) const {return !operator==(other);}
+    };
+
     class Vertex {
     private:
         friend class SparseDBG;
-        mutable std::vector<Edge> outgoing_{};
+//        Outgoing edges are indexed by their first nucleotide. In a junction graph there is at most one edge per slot,
+//        sparse graphs built from reads may chain several edges with the same first nucleotide.
+//        Edges are added without locks: empty slots and chain ends are filled with CAS. Published edges are never
+//        changed by addEdge, an edge is extended by installing a longer copy in its place. Replaced and removed edges stay
+//        readable until releaseRetired is called at a point where no other thread can hold them.
+        struct RetiredEdge {
+            Edge *edge;
+            RetiredEdge *next;
+        };
+        mutable Edge *outgoing_[4] = {};
+        RetiredEdge *retired_ = nullptr;
         Vertex *rc_;
         hashing::htype hash_;
-        omp_lock_t writelock = {};
+        std::atomic<size_t> out_deg_{0};
+//        Sequence of the canonical vertex and its reverse complement is set once: 0 - not set, 1 - being set, 2 - set
+        std::atomic<unsigned char> seq_state_{0};
         size_t coverage_ = 0;
         bool canonical = false;
         bool mark_ = false;
         explicit Vertex(hashing::htype hash, Vertex *_rc);
+        Edge &insertEdge(const Edge &edge);
+        void releaseEdges();
+        void releaseRetired();
+        void removeOutgoing(Edge &edge);
     public:
         Sequence seq;
 
@@ -91,14 +160,13 @@ namespace dbg {
         hashing::htype hash() const {return hash_;}
         Vertex &rc() {return *rc_;}
         const Vertex &rc() const {return *rc_;}
-        void setSequence(const Sequence &_seq);
-        void lock() {omp_set_lock(&writelock);}
-        void unlock() {omp_unset_lock(&writelock);}
-        std::vector<Edge>::iterator begin() const {return outgoing_.begin();}
-        std::vector<Edge>::iterator end() const {return outgoing_.end();}
-        size_t outDeg() const {return outgoing_.size();}
-        size_t inDeg() const {return rc_->outgoing_.size();}
-        Edge &operator[](size_t ind) const {return outgoing_[ind];}
+//        The sequence is copied, into the arena if it is given
+        void setSequence(const Sequence &_seq, NuclArena *arena = nullptr);
+        OutgoingIterator begin() const {return {outgoing_, 0};}
+        OutgoingIterator end() const {return {outgoing_, 4};}
+        size_t outDeg() const {return out_deg_.load(std::memory_order_acquire);}
+        size_t inDeg() const {return rc_->outDeg();}
+        Edge &operator[](size_t ind) const;
 
 
         size_t coverage() const;
@@ -113,6 +181,8 @@ namespace dbg {
         std::string getShortId() const;
         void incCoverage();
         void clearSequence();
+//        Both add the edge unless an edge with the same prefix is present and replace a shorter edge that is a prefix
+//        of the new one. addEdgeLockFree returns the edge that ends up in the graph.
         Edge &addEdgeLockFree(const Edge &edge);
         void addEdge(const Edge &e);
         Edge &getOutgoing(unsigned char c) const;
@@ -140,52 +210,90 @@ namespace dbg {
         EdgePosition RC() const {return {edge->rc(), edge->size() - pos};}
     };
 
+//    Value of the anchor index. Positions within an edge fit in 32 bits and the struct is packed, so that an anchor
+//    takes 12 bytes next to its hash instead of 16.
+#pragma pack(push, 4)
+    struct AnchorPosition {
+        Edge *edge = nullptr;
+        uint32_t pos = 0;
+
+        AnchorPosition() = default;
+        explicit AnchorPosition(const EdgePosition &ep) : edge(ep.edge), pos(ep.pos) {VERIFY(ep.pos <= uint32_t(-1));}
+
+//        Not checked against the edge, since anchors of edges changed in place are read before they are remapped
+        EdgePosition position() const {
+            EdgePosition res;
+            res.edge = edge;
+            res.pos = pos;
+            return res;
+        }
+    };
+#pragma pack(pop)
+
     class SparseDBG {
     public:
-        typedef std::unordered_map<hashing::htype , Vertex, hashing::alt_hasher<hashing::htype>> vertex_map_type;
-        typedef std::unordered_map<hashing::htype, Vertex, hashing::alt_hasher<hashing::htype>>::iterator vertex_iterator_type;
-        typedef std::unordered_map<hashing::htype, EdgePosition, hashing::alt_hasher<hashing::htype>> anchor_map_type;
+        typedef ConcurrentHashMap<hashing::htype, Vertex, hashing::alt_hasher<hashing::htype>> vertex_map_type;
+        typedef vertex_map_type::iterator vertex_iterator_type;
+        typedef FlatHashIndex<hashing::htype, AnchorPosition, hashing::alt_hasher<hashing::htype>> anchor_map_type;
     private:
-//    TODO: replace with perfect hash map? It is parallel, maybe faster and compact.
         vertex_map_type v;
         anchor_map_type anchors;
         hashing::RollingHash hasher_;
+//        Arena that vertex and edge sequences are copied to when they are added, if the graph has one. Graphs derived
+//        from this one share sequences of its edges and keep its arenas alive in borrowed_arenas_.
+        std::shared_ptr<NuclArena> arena_;
+        std::vector<std::shared_ptr<NuclArena>> borrowed_arenas_;
+
+        Sequence copySequence(const Sequence &seq) const {
+            return arena_ == nullptr ? Sequence(seq.str()) : seq.copy(*arena_);
+        }
+
+        void borrowArenas(const SparseDBG &other) {
+            borrowed_arenas_ = other.borrowed_arenas_;
+            if(other.arena_ != nullptr)
+                borrowed_arenas_.emplace_back(other.arena_);
+        }
 
 //    Be careful since hash does not define vertex. Rc vertices share the same hash
         Vertex &innerAddVertex(hashing::htype h) {
-            return v.emplace(std::piecewise_construct, std::forward_as_tuple(h),
-                             std::forward_as_tuple(h)).first->second;
+            return v.emplace(h, h).first->second;
         }
 
     public:
 
+//        Vertices are created in parallel in the order of sorted hashes
         template<class Iterator>
-        SparseDBG(Iterator begin, Iterator end, hashing::RollingHash _hasher) : hasher_(_hasher) {
-            while (begin != end) {
-                hashing::htype hash = *begin;
-                if (v.find(hash) == v.end())
-                    addVertex(hash);
-                ++begin;
-            }
+        SparseDBG(Iterator begin, Iterator end, hashing::RollingHash _hasher, size_t threads = 1) : hasher_(_hasher) {
+            std::vector<hashing::htype> hashs(begin, end);
+            __gnu_parallel::sort(hashs.begin(), hashs.end());
+            hashs.erase(std::unique(hashs.begin(), hashs.end()), hashs.end());
+            v.emplaceDistinct(hashs, threads);
         }
         explicit SparseDBG(hashing::RollingHash _hasher) : hasher_(_hasher) {}
         SparseDBG(SparseDBG &&other) = default;
         SparseDBG &operator=(SparseDBG &&other) = default;
         SparseDBG(const SparseDBG &other) noexcept = delete;
 
+//        Sequences added to the graph from now on are stored in an arena freed with the graph and its derived graphs
+        void enableArena() {arena_ = std::make_shared<NuclArena>();}
+        const NuclArena *arena() const {return arena_.get();}
+//        Copies all vertex and edge sequences into a new arena, which also receives the sequences added later. An edge
+//        longer than k shares its words with its reverse complement, as after a merge.
+        void moveToArena(logging::Logger &logger, size_t threads);
+
         SparseDBG Subgraph(std::vector<Segment<Edge>> &pieces);
         SparseDBG SplitGraph(const std::vector<EdgePosition> &breaks);
         SparseDBG AddNewSequences(logging::Logger &logger, size_t threads, const std::vector<Sequence> &new_seqs);
 
         const hashing::RollingHash &hasher() const {return hasher_;}
-        bool containsVertex(const hashing::htype &hash) const {return v.find(hash) != v.end();}
+        bool containsVertex(const hashing::htype &hash) const {return v.contains(hash);}
         Vertex &getVertex(const hashing::KWH &kwh);
         Vertex &getVertex(const Sequence &seq);
         Vertex &getVertex(hashing::htype hash, bool canonical = true) {return canonical ? v.find(hash)->second : v.find(hash)->second.rc();}
         Vertex &getVertex(const Vertex &other_graph_vertex);
         std::array<Vertex *, 2> getVertices(hashing::htype hash);
 //        const Vertex &getVertex(const hashing::KWH &kwh) const;
-        bool isAnchor(hashing::htype hash) const {return anchors.find(hash) != anchors.end();}
+        bool isAnchor(hashing::htype hash) const {return anchors.contains(hash);}
         EdgePosition getAnchor(const hashing::KWH &kwh);
         size_t size() const {return v.size();}
 
@@ -194,14 +302,37 @@ namespace dbg {
         void checkSeqFilled(size_t threads, logging::Logger &logger);
         void fillAnchors(size_t w, logging::Logger &logger, size_t threads);
         void fillAnchors(size_t w, logging::Logger &logger, size_t threads, const std::unordered_set<hashing::htype, hashing::alt_hasher<hashing::htype>> &to_add);
+//        Adds anchors of the given edges only, without rebuilding the index. Anchors already in the graph are kept.
+        void fillAnchors(size_t w, logging::Logger &logger, size_t threads, const std::vector<Edge *> &edges);
         void processRead(const Sequence &seq);
+//        Adds only the edges that start at vertices accepted by the filter. A vertex and its reverse complement are
+//        accepted together, so after all reads are processed accepted vertices have all their edges.
+        void processRead(const Sequence &seq, const std::function<bool(const Vertex &)> &filter);
         void processEdge(Vertex &vertex, Sequence old_seq);
         void processEdge(Edge &other_graph_edge);
         Vertex &bindTip(Vertex &start, Edge &tip);
+//        Frees edges replaced by longer ones. No other thread may use the graph and no references to replaced edges may
+//        be kept, e.g. after parallel filling or merging.
+        void releaseRetiredEdges();
+//        Same for the given vertices and their reverse complements only, missing vertices are skipped
+        void releaseRetiredEdges(const std::vector<hashing::htype> &hashs);
         void removeIsolated();
         void removeMarked();
+//        In place modifications. splitEdge cuts an edge and its reverse complement at the given inner positions and
+//        returns the pieces of the edge in order; the first piece is the edge object itself. Removed edges are retired
+//        and freed by releaseRetiredEdges or with their start vertex, removed vertices are deleted immediately. No
+//        other thread may access the graph concurrently.
+        std::vector<Edge *> splitEdge(Edge &edge, std::vector<size_t> positions);
+        void removeEdge(Edge &edge);
+        void removeVertex(Vertex &vertex);
+//        Updates anchors found among the k-mers of edges that were changed in place. old_seqs are the sequences of the
+//        edges before the change including their start vertices. Every anchor is passed to remap once; remap moves it
+//        to its new position or returns false if the anchor has to be removed and must not dereference the old edge.
+        void remapAnchors(const std::vector<Sequence> &old_seqs, const std::function<bool(EdgePosition &)> &remap);
 
         void addVertex(hashing::htype h) {innerAddVertex(h);}
+//        Adds vertices in parallel after all existing ones. Hashes may repeat or be present in the graph already.
+        void addVertices(std::vector<hashing::htype> hashs, size_t threads);
         Vertex &addVertex(const hashing::KWH &kwh);
         Vertex &addVertex(const Sequence &seq);
         Vertex &addVertex(const Vertex &other_graph_vertex);
@@ -209,6 +340,14 @@ namespace dbg {
 
         std::vector<hashing::KWH> extractVertexPositions(const Sequence &seq, size_t max = size_t(-1)) const;
         void printFastaOld(const std::experimental::filesystem::path &out);
+//        Binary snapshot of the graph with edge coverage, flags and anchors. Loading does not rehash sequences. fasta is
+//        the file just printed for the graph by printFastaOld; its size and modification time are kept in the snapshot.
+        void saveSnapshot(const std::experimental::filesystem::path &out, const std::experimental::filesystem::path &fasta) const;
+        static SparseDBG loadSnapshot(const std::experimental::filesystem::path &in, logging::Logger &logger, size_t threads);
+//        Checks that the snapshot was saved with the given hasher together with the fasta file in its current state.
+//        Only the size and modification time of the fasta are compared, so the check does not read it.
+        static bool snapshotMatches(const std::experimental::filesystem::path &snapshot,
+                                    const std::experimental::filesystem::path &fasta, const hashing::RollingHash &hasher);
 
         IterableStorage<ApplyingIterator<vertex_iterator_type, Vertex, 2>> vertices(bool unique = false);
         IterableStorage<ApplyingIterator<vertex_iterator_type, Vertex, 2>> verticesUnique();
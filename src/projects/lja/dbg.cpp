@@ -140,6 +140,9 @@ std::string constructMessage() {
     ss << "  -w <int> (or --window <int>`)                 The window size to be used for sparse de Bruijn graph construction. The default value is 2000. Note that all reads of length less than k + w are ignored during graph construction.\n";
     ss << "  --compress                                    Compress all homolopymers in reads.\n";
     ss << "  --coverage                                    Calculate edge coverage of edges in the constructed de Bruijn graph.\n";
+    ss << "  --exact-junctions                             Find junction k-mers by sorting k-mers instead of using a Bloom filter.\n";
+    ss << "  --max-memory <int>                            Memory limit in Gb for sparse de Bruijn graph construction. The default value 0 means no limit.\n";
+    ss << "  --no-fork                                     Construct disjointigs in this process instead of a child process and use them without reloading.\n";
     return ss.str();
 }
 
@@ -149,7 +152,7 @@ int main(int argc, char **argv) {
                      "simplify", "coverage", "cov-threshold=2", "rel-threshold=10", "tip-correct",
                      "initial-correct", "mult-correct", "mult-analyse", "compress", "dimer-compress=1000000000,1000000000,1", "help", "genome-path",
                      "dump", "extension-size=none", "print-all", "extract-subdatasets", "print-alignments", "subdataset-radius=10000",
-                     "split", "diploid"},
+                     "split", "diploid", "max-memory=0", "exact-junctions", "no-fork"},
                     {"reads", "pseudo-reads", "align", "paths", "print-segment"},
                     {"h=help", "o=output-dir", "t=threads", "k=k-mer-size","w=window"},
                     constructMessage());
@@ -200,12 +203,14 @@ int main(int argc, char **argv) {
     io::Library construction_lib = reads_lib + pseudo_reads_lib + genome_lib;
     size_t threads = std::stoi(parser.getValue("threads"));
     omp_set_num_threads(threads);
+    forkIsolation() = !parser.getCheck("no-fork");
 
     std::string disjointigs_file = parser.getValue("disjointigs");
     std::string vertices_file = parser.getValue("vertices");
     std::string dbg_file = parser.getValue("dbg");
     SparseDBG dbg = dbg_file == "none" ?
-                    DBGPipeline(logger, hasher, w, construction_lib, dir, threads, disjointigs_file, vertices_file) :
+                    DBGPipeline(logger, hasher, w, construction_lib, dir, threads, disjointigs_file, vertices_file,
+                                std::stoull(parser.getValue("max-memory")) << 30u, parser.getCheck("exact-junctions")) :
                     LoadDBGFromFasta({std::experimental::filesystem::path(dbg_file)}, hasher, logger, threads);
 
     bool calculate_alignments = parser.getCheck("initial-correct") ||
@@ -529,7 +534,7 @@ int main(int argc, char **argv) {
             if (add)
                 vertices_again.push_back(vert.hash());
         }
-        SparseDBG simp_dbg(vertices_again.begin(), vertices_again.end(), hasher);
+        SparseDBG simp_dbg(vertices_again.begin(), vertices_again.end(), hasher, threads);
         FillSparseDBGEdges(simp_dbg, edges.begin(), edges.end(), logger, threads, 0);
         for(auto & it : simp_dbg) {
             Vertex &vert = it.second;
@@ -4,7 +4,8 @@
 
 bool GapCloser::HasInnerDuplications(const Sequence &seq, const hashing::RollingHash &hasher) {
     std::vector<hashing::htype> hashs;
-    for(hashing::KWH kwh(hasher, seq, 0);; kwh = kwh.next()) {
+    hashs.reserve(seq.size() - hasher.getK() + 1);
+    for(hashing::KmerCursor kwh(hasher, seq, 0);; kwh.next()) {
         hashs.emplace_back(kwh.hash());
         if(!kwh.hasNext())
             break;
@@ -28,12 +29,12 @@ std::vector<Connection> GapCloser::GapPatches(logging::Logger &logger, dbg::Spar
 #pragma omp parallel for default(none) shared(tips, candidates, dbg, smallHasher)
     for (size_t i = 0; i < tips.size(); i++) {
         size_t max_len = std::min(tips[i]->size(), max_overlap);
-        hashing::KWH kwh(smallHasher, tips[i]->seq, tips[i]->size() - max_len);
+        hashing::KmerCursor kwh(smallHasher, tips[i]->seq, tips[i]->size() - max_len);
         while (true) {
             candidates.emplace_back(kwh.hash(), i);
             if (!kwh.hasNext())
                 break;
-            kwh = kwh.next();
+            kwh.next();
         }
     }
     logger.trace() << "Sorting k-mers from tips" << std::endl;
@@ -15,6 +15,7 @@
 #include "common/dir_utils.hpp"
 #include "common/cl_parser.hpp"
 #include "common/logging.hpp"
+#include "common/background_jobs.hpp"
 #include <wait.h>
 #include <error_correction/dimer_correction.hpp>
 #include <polishing/homopolish.hpp>
@@ -67,11 +68,98 @@ void PrintPaths(logging::Logger &logger, const std::experimental::filesystem::pa
     ref_os.close();
 }
 
+//Construction files of a previous run for --load. Output directories of older versions only have the legacy text files.
+static std::string checkpointFile(const std::experimental::filesystem::path &dir, const std::string &name,
+                                  const std::string &legacy_name) {
+    if(!std::experimental::filesystem::exists(dir / name) && std::experimental::filesystem::exists(dir / legacy_name))
+        return (dir / legacy_name).string();
+    return (dir / name).string();
+}
+
+//Graph of a correction phase together with read alignments to it. Read storages are created by the phase.
+struct PhaseGraph {
+    SparseDBG dbg;
+    ReadLogger readLogger;
+    std::unique_ptr<RecordStorage> readStorage;
+    std::unique_ptr<RecordStorage> extra_reads;
+
+    PhaseGraph(SparseDBG &&_dbg, size_t threads, const std::experimental::filesystem::path &read_log) :
+            dbg(std::move(_dbg)), readLogger(threads, read_log) {}
+};
+
+//Results that phases pass to each other in memory when all phases run in one process. Corrected reads are registered
+//in io::MemoryFiles and the final graph is kept for repeat resolution. Result files are still written by background
+//jobs for restarts and for the user. Without handoff every phase reads the files of the previous one.
+struct PhaseHandoff {
+    bool enabled = false;
+    std::unique_ptr<PhaseGraph> graph;
+    BackgroundJobs archive;
+};
+
+//Passes corrected reads to the next phase or prints them to fasta. Reads are stored in the same form as in the file.
+static void HandOffReads(logging::Logger &logger, size_t threads, PhaseHandoff &handoff,
+                         const RecordStorage &readStorage, const std::experimental::filesystem::path &path) {
+    if(!handoff.enabled) {
+        readStorage.printReadFasta(logger, path);
+        return;
+    }
+    logger.info() << "Passing corrected reads to the next phase in memory. Archive copy is printed to " << path << std::endl;
+    std::vector<StringContig> records(readStorage.size());
+    omp_set_num_threads(threads);
+#pragma omp parallel for default(none) schedule(dynamic, 100) shared(readStorage, records)
+    for(size_t i = 0; i < readStorage.size(); i++) {
+        const AlignedRead &read = readStorage[i];
+        if(read.path.valid())
+            records[i] = StringContig(read.path.getAlignment().Seq().str(), std::string(read.id));
+    }
+    records.erase(std::remove_if(records.begin(), records.end(), [](const StringContig &read) {return read.isNull();}),
+                  records.end());
+    io::MemoryFiles::Records shared = std::make_shared<const std::vector<StringContig>>(std::move(records));
+    io::MemoryFiles::add(path, shared);
+    handoff.archive.add([path, shared] {
+        std::ofstream os;
+        os.open(path);
+        for(const StringContig &read : *shared)
+            os << ">" << read.id << "\n" << read.seq << "\n";
+        os.close();
+    });
+}
+
+//Prints the final graph of a correction phase with its snapshot, read alignments and corrected reads. The snapshot is
+//written right after the fasta it is validated against. With handoff the files are written by a background job and
+//the graph is kept for repeat resolution, which must wait for the archive before changing or destroying it.
+static void HandOffGraph(logging::Logger &logger, size_t threads, PhaseHandoff &handoff,
+                         const std::experimental::filesystem::path &dir, std::unique_ptr<PhaseGraph> &graph) {
+    SparseDBG &dbg = graph->dbg;
+    RecordStorage &readStorage = *graph->readStorage;
+    RecordStorage &extra_reads = *graph->extra_reads;
+    if(!handoff.enabled) {
+        dbg.printFastaOld(dir / "final_dbg.fasta");
+        dbg.saveSnapshot(dir / "final_dbg.sdbg", dir / "final_dbg.fasta");
+        printDot(dir / "final_dbg.dot", Component(dbg), readStorage.labeler());
+        printGFA(dir / "final_dbg.gfa", Component(dbg), true);
+        SaveAllReads(dir/"final_dbg.aln", {&readStorage, &extra_reads});
+    } else {
+        logger.info() << "Passing graph and read alignments to repeat resolution in memory" << std::endl;
+        handoff.archive.add([&dbg, &readStorage, &extra_reads, dir] {
+            dbg.printFastaOld(dir / "final_dbg.fasta");
+            dbg.saveSnapshot(dir / "final_dbg.sdbg", dir / "final_dbg.fasta");
+            printDot(dir / "final_dbg.dot", Component(dbg), readStorage.labeler());
+            printGFA(dir / "final_dbg.gfa", Component(dbg), true);
+            SaveAllReads(dir/"final_dbg.aln", {&readStorage, &extra_reads});
+        });
+    }
+    HandOffReads(logger, threads, handoff, readStorage, dir / "corrected_reads.fasta");
+    if(handoff.enabled)
+        handoff.graph = std::move(graph);
+}
+
 std::pair<std::experimental::filesystem::path, std::experimental::filesystem::path>
 AlternativeCorrection(logging::Logger &logger, const std::experimental::filesystem::path &dir,
             const io::Library &reads_lib, const io::Library &pseudo_reads_lib, const io::Library &paths_lib,
         size_t threads, size_t k, size_t w, double threshold, double reliable_coverage,
-bool close_gaps, bool remove_bad, bool skip, bool debug, bool load) {
+bool close_gaps, bool remove_bad, bool skip, bool debug, bool load, bool cache_reads, size_t max_memory, bool exact_junctions,
+        PhaseHandoff &handoff) {
     logger.info() << "Performing initial correction with k = " << k << std::endl;
     if (k % 2 == 0) {
         logger.info() << "Adjusted k from " << k << " to " << (k + 1) << " to make it odd" << std::endl;
@@ -79,18 +167,22 @@ bool close_gaps, bool remove_bad, bool skip, bool debug, bool load) {
     }
     ensure_dir_existance(dir);
     hashing::RollingHash hasher(k, 239);
-    std::function<void()> ic_task = [&dir, &logger, &hasher, close_gaps, load, remove_bad, k, w, &reads_lib,
-            &pseudo_reads_lib, &paths_lib, threads, threshold, reliable_coverage, debug] {
+    std::function<void()> ic_task = [&dir, &logger, &hasher, close_gaps, load, remove_bad, k, w, &reads_lib, cache_reads,
+            max_memory, exact_junctions, &pseudo_reads_lib, &paths_lib, threads, threshold, reliable_coverage, debug, &handoff] {
         io::Library construction_lib = reads_lib + pseudo_reads_lib;
-        SparseDBG dbg = load ? DBGPipeline(logger, hasher, w, reads_lib, dir, threads, (dir/"disjointigs.fasta").string(), (dir/"vertices.save").string()) :
-                        DBGPipeline(logger, hasher, w, reads_lib, dir, threads);
+        io::Library lib = cache_reads && !io::MemoryFiles::contains(reads_lib) ?
+                          io::ReadCache::prepare(logger, threads, reads_lib, dir / "reads.hpc",
+                                                 io::ReadCache::splitLength((k + w) * 20, (k + w) * 4)) : reads_lib;
+        SparseDBG dbg = load ? DBGPipeline(logger, hasher, w, lib, dir, threads, checkpointFile(dir, "disjointigs.bin", "disjointigs.fasta"), checkpointFile(dir, "vertices.bin", "vertices.save")) :
+                        DBGPipeline(logger, hasher, w, lib, dir, threads, "none", "none", max_memory, exact_junctions);
         dbg.fillAnchors(w, logger, threads);
         size_t extension_size = std::max<size_t>(k * 2, 1000);
         ReadLogger readLogger(threads, dir/"read_log.txt");
         RecordStorage readStorage(dbg, 0, extension_size, threads, readLogger, true, true, false);
         RecordStorage refStorage(dbg, 0, extension_size, threads, readLogger, false, false);
-        io::SeqReader reader(reads_lib);
-        readStorage.fill(reader.begin(), reader.end(), dbg, w + k - 1, logger, threads);
+        io::ProcessReads(lib, [&](auto begin, auto end) {
+            readStorage.fill(begin, end, dbg, w + k - 1, logger, threads);
+        });
         coverageStats(logger, dbg);
         if(debug) {
             PrintPaths(logger, dir / "state_dump", "initial", dbg, readStorage, paths_lib, true);
@@ -116,13 +208,13 @@ bool close_gaps, bool remove_bad, bool skip, bool debug, bool load) {
         coverageStats(logger, dbg);
         if(debug)
             PrintPaths(logger, dir/ "state_dump", "mk3500", dbg, readStorage, paths_lib, false);
-        readStorage.printReadFasta(logger, dir / "corrected.fasta");
+        HandOffReads(logger, threads, handoff, readStorage, dir / "corrected.fasta");
         if(debug)
             DrawSplit(Component(dbg), dir / "split");
         dbg.printFastaOld(dir / "graph.fasta");
     };
     if(!skip)
-        runInFork(ic_task);
+        runIsolated(ic_task);
     std::experimental::filesystem::path res;
     res = dir / "corrected.fasta";
     logger.info() << "Initial correction results with k = " << k << " printed to " << res << std::endl;
@@ -131,7 +223,8 @@ bool close_gaps, bool remove_bad, bool skip, bool debug, bool load) {
 
 std::vector<std::experimental::filesystem::path> NoCorrection(logging::Logger &logger, const std::experimental::filesystem::path &dir,
                 const io::Library &reads_lib, const io::Library &pseudo_reads_lib, const io::Library &paths_lib,
-                size_t threads, size_t k, size_t w, bool skip, bool debug, bool load) {
+                size_t threads, size_t k, size_t w, bool skip, bool debug, bool load, bool cache_reads, size_t max_memory, bool exact_junctions,
+                PhaseHandoff &handoff) {
     logger.info() << "Performing initial correction with k = " << k << std::endl;
     if (k % 2 == 0) {
         logger.info() << "Adjusted k from " << k << " to " << (k + 1) << " to make it odd" << std::endl;
@@ -139,30 +232,34 @@ std::vector<std::experimental::filesystem::path> NoCorrection(logging::Logger &l
     }
     ensure_dir_existance(dir);
     hashing::RollingHash hasher(k, 239);
-    std::function<void()> ic_task = [&dir, &logger, &hasher, load, k, w, &reads_lib,
-            &pseudo_reads_lib, &paths_lib, threads, debug] {
+    std::function<void()> ic_task = [&dir, &logger, &hasher, load, k, w, &reads_lib, cache_reads, max_memory,
+            exact_junctions, &pseudo_reads_lib, &paths_lib, threads, debug, &handoff] {
         io::Library construction_lib = reads_lib + pseudo_reads_lib;
-        SparseDBG dbg = load ? DBGPipeline(logger, hasher, w, reads_lib, dir, threads, (dir/"disjointigs.fasta").string(), (dir/"vertices.save").string()) :
-                        DBGPipeline(logger, hasher, w, reads_lib, dir, threads);
+        io::Library lib = cache_reads && !io::MemoryFiles::contains(reads_lib) ?
+                          io::ReadCache::prepare(logger, threads, reads_lib, dir / "reads.hpc",
+                                                 io::ReadCache::splitLength((k + w) * 20, (k + w) * 4)) : reads_lib;
+        std::unique_ptr<PhaseGraph> graph = std::make_unique<PhaseGraph>(
+                load ? DBGPipeline(logger, hasher, w, lib, dir, threads, checkpointFile(dir, "disjointigs.bin", "disjointigs.fasta"), checkpointFile(dir, "vertices.bin", "vertices.save")) :
+                DBGPipeline(logger, hasher, w, lib, dir, threads, "none", "none", max_memory, exact_junctions),
+                threads, dir/"read_log.txt");
+        SparseDBG &dbg = graph->dbg;
         dbg.fillAnchors(w, logger, threads);
         size_t extension_size = std::max<size_t>(k * 2, 1000);
-        ReadLogger readLogger(threads, dir/"read_log.txt");
-        RecordStorage readStorage(dbg, 0, extension_size, threads, readLogger, true, true, false);
-        RecordStorage extra_reads(dbg, 0, extension_size, threads, readLogger, false, true, false);
-        io::SeqReader reader(reads_lib);
-        readStorage.fill(reader.begin(), reader.end(), dbg, w + k - 1, logger, threads);
+        ReadLogger &readLogger = graph->readLogger;
+        graph->readStorage = std::make_unique<RecordStorage>(dbg, 0, extension_size, threads, readLogger, true, true, false);
+        graph->extra_reads = std::make_unique<RecordStorage>(dbg, 0, extension_size, threads, readLogger, false, true, false);
+        RecordStorage &readStorage = *graph->readStorage;
+        io::ProcessReads(lib, [&](auto begin, auto end) {
+            readStorage.fill(begin, end, dbg, w + k - 1, logger, threads);
+        });
         coverageStats(logger, dbg);
         if(debug) {
             PrintPaths(logger, dir / "state_dump", "initial", dbg, readStorage, paths_lib, true);
         }
-        dbg.printFastaOld(dir / "final_dbg.fasta");
-        printDot(dir / "final_dbg.dot", Component(dbg), readStorage.labeler());
-        printGFA(dir / "final_dbg.gfa", Component(dbg), true);
-        SaveAllReads(dir/"final_dbg.aln", {&readStorage, &extra_reads});
-        readStorage.printReadFasta(logger, dir / "corrected_reads.fasta");
+        HandOffGraph(logger, threads, handoff, dir, graph);
     };
     if(!skip)
-        runInFork(ic_task);
+        runIsolated(ic_task);
 
     return {dir/"corrected_reads.fasta", dir / "final_dbg.fasta", dir / "final_dbg.aln"};
 }
@@ -171,7 +268,8 @@ std::vector<std::experimental::filesystem::path> SecondPhase(
     logging::Logger &logger, const std::experimental::filesystem::path &dir,
     const io::Library &reads_lib, const io::Library &pseudo_reads_lib,
     const io::Library &paths_lib, size_t threads, size_t k, size_t w, double threshold, double reliable_coverage,
-    size_t unique_threshold, bool diploid, bool skip, bool debug, bool load) {
+    size_t unique_threshold, bool diploid, bool skip, bool debug, bool load, bool cache_reads, size_t max_memory, bool exact_junctions,
+    PhaseHandoff &handoff) {
     logger.info() << "Performing second phase of error correction using k = " << k << std::endl;
     if (k%2==0) {
         logger.info() << "Adjusted k from " << k << " to " << (k + 1)
@@ -183,21 +281,29 @@ std::vector<std::experimental::filesystem::path> SecondPhase(
     std::function<void()> ic_task = [&dir, &logger, &hasher, load, k, w,
                                      &reads_lib, &pseudo_reads_lib, &paths_lib,
                                      threads, threshold, reliable_coverage,
-                                     debug, unique_threshold, diploid]
+                                     debug, unique_threshold, diploid, cache_reads, max_memory,
+                                     exact_junctions, &handoff]
                                      {
         io::Library construction_lib = reads_lib + pseudo_reads_lib;
-        SparseDBG dbg =
-            load ? DBGPipeline(logger, hasher, w, reads_lib, dir, threads,
-                               (dir/"disjointigs.fasta").string(),
-                               (dir/"vertices.save").string())
-                 : DBGPipeline(logger, hasher, w, reads_lib, dir, threads);
+        io::Library lib = cache_reads && !io::MemoryFiles::contains(reads_lib) ?
+                          io::ReadCache::prepare(logger, threads, reads_lib, dir / "reads.hpc",
+                                                 io::ReadCache::splitLength((k + w) * 20, (k + w) * 4)) : reads_lib;
+        std::unique_ptr<PhaseGraph> graph = std::make_unique<PhaseGraph>(
+            load ? DBGPipeline(logger, hasher, w, lib, dir, threads,
+                               checkpointFile(dir, "disjointigs.bin", "disjointigs.fasta"),
+                               checkpointFile(dir, "vertices.bin", "vertices.save"))
+                 : DBGPipeline(logger, hasher, w, lib, dir, threads, "none", "none", max_memory, exact_junctions),
+            threads, dir/"read_log.txt");
+        SparseDBG &dbg = graph->dbg;
         dbg.fillAnchors(w, logger, threads);
         size_t extension_size = 10000000;
-        ReadLogger readLogger(threads, dir/"read_log.txt");
-        RecordStorage readStorage(dbg, 0, extension_size, threads, readLogger, true, debug);
+        ReadLogger &readLogger = graph->readLogger;
+        graph->readStorage = std::make_unique<RecordStorage>(dbg, 0, extension_size, threads, readLogger, true, debug);
+        RecordStorage &readStorage = *graph->readStorage;
         RecordStorage refStorage(dbg, 0, extension_size, threads, readLogger, false, false);
-        io::SeqReader reader(reads_lib);
-        readStorage.fill(reader.begin(), reader.end(), dbg, w + k - 1, logger, threads);
+        io::ProcessReads(lib, [&](auto begin, auto end) {
+            readStorage.fill(begin, end, dbg, w + k - 1, logger, threads);
+        });
         if(debug) {
             DrawSplit(Component(dbg), dir / "before_figs", readStorage.labeler(), 25000);
             PrintPaths(logger, dir / "state_dump", "initial", dbg, readStorage, paths_lib, false);
@@ -215,7 +321,9 @@ std::vector<std::experimental::filesystem::path> SecondPhase(
         RemoveUncovered(logger, threads, dbg, {&readStorage, &refStorage});
         if(debug)
             PrintPaths(logger, dir/ "state_dump", "uncovered1", dbg, readStorage, paths_lib, false);
-        RecordStorage extra_reads = MultCorrect(dbg, logger, dir, readStorage, unique_threshold, threads, diploid, debug);
+        graph->extra_reads = std::make_unique<RecordStorage>(
+                MultCorrect(dbg, logger, dir, readStorage, unique_threshold, threads, diploid, debug));
+        RecordStorage &extra_reads = *graph->extra_reads;
         MRescue(logger, threads, dbg, readStorage, unique_threshold, 0.05);
         if(debug)
             PrintPaths(logger, dir/ "state_dump", "mult", dbg, readStorage, paths_lib, false);
@@ -227,14 +335,10 @@ std::vector<std::experimental::filesystem::path> SecondPhase(
             PrintPaths(logger, dir / "state_dump", "gap2", dbg, readStorage, paths_lib, false);
             DrawSplit(Component(dbg), dir / "split_figs", readStorage.labeler());
         }
-        dbg.printFastaOld(dir / "final_dbg.fasta");
-        printDot(dir / "final_dbg.dot", Component(dbg), readStorage.labeler());
-        printGFA(dir / "final_dbg.gfa", Component(dbg), true);
-        SaveAllReads(dir/"final_dbg.aln", {&readStorage, &extra_reads});
-        readStorage.printReadFasta(logger, dir / "corrected_reads.fasta");
+        HandOffGraph(logger, threads, handoff, dir, graph);
     };
     if(!skip)
-        runInFork(ic_task);
+        runIsolated(ic_task);
     std::experimental::filesystem::path res;
     res = dir / "corrected_reads.fasta";
     logger.info() << "Second phase results with k = " << k << " printed to "
@@ -246,23 +350,49 @@ std::vector<std::experimental::filesystem::path> MDBGPhase(
         logging::Logger &logger, size_t threads, size_t k, size_t kmdbg, size_t w, size_t unique_threshold, bool diploid,
         const std::experimental::filesystem::path &dir,
         const std::experimental::filesystem::path &graph_fasta,
-        const std::experimental::filesystem::path &read_paths, bool skip, bool debug) {
+        const std::experimental::filesystem::path &read_paths, bool skip, bool debug, PhaseHandoff &handoff) {
     logger.info() << "Performing repeat resolution by transforming de Bruijn graph into Multiplex de Bruijn graph" << std::endl;
-    std::function<void()> ic_task = [&logger, threads, debug, k, kmdbg, &graph_fasta, unique_threshold, diploid, &read_paths, &dir] {
+    std::function<void()> ic_task = [&logger, threads, debug, k, kmdbg, &graph_fasta, unique_threshold, diploid, &read_paths, &dir, &handoff] {
+        if(handoff.graph != nullptr) {
+            std::unique_ptr<PhaseGraph> graph = std::move(handoff.graph);
+//            Archive jobs read the graph and the alignments, which suffix tracking and repeat resolution change,
+//            e.g. by marking reliable edges
+            handoff.archive.wait();
+//            Storages loaded from file track suffixes, the graph without correction comes without them
+            for(RecordStorage *storage : {graph->readStorage.get(), graph->extra_reads.get()}) {
+                if(!storage->isTrackingSuffixes())
+                    storage->trackSuffixes(logger, threads);
+            }
+            repeat_resolution::RepeatResolver rr(graph->dbg, graph->readStorage.get(), {graph->extra_reads.get()},
+                                                 k, kmdbg, dir, unique_threshold,
+                                                 diploid, debug, logger);
+            rr.ResolveRepeats(logger, threads);
+            return;
+        }
         hashing::RollingHash hasher(k, 239);
-        SparseDBG dbg = dbg::LoadDBGFromFasta({graph_fasta}, hasher, logger, threads);
+        std::experimental::filesystem::path snapshot = graph_fasta;
+        snapshot.replace_extension(".sdbg");
+        bool from_snapshot = std::experimental::filesystem::exists(snapshot);
+        if(from_snapshot && !SparseDBG::snapshotMatches(snapshot, graph_fasta, hasher)) {
+            logger.info() << "Graph snapshot " << snapshot << " does not match " << graph_fasta << ". Ignoring it." << std::endl;
+            from_snapshot = false;
+        }
+        SparseDBG dbg = from_snapshot ?
+                        SparseDBG::loadSnapshot(snapshot, logger, threads) :
+                        dbg::LoadDBGFromFasta({graph_fasta}, hasher, logger, threads);
         size_t extension_size = 10000000;
         ReadLogger readLogger(threads, dir/"read_log.txt");
         RecordStorage readStorage(dbg, 0, extension_size, threads, readLogger, true, debug);
         RecordStorage extra_reads(dbg, 0, extension_size, threads, readLogger, false, debug);
-        LoadAllReads(read_paths, {&readStorage, &extra_reads}, dbg);
+//        Snapshot keeps the edge coverage, the graph loaded from fasta gets it from the alignments
+        LoadAllReads(read_paths, {&readStorage, &extra_reads}, dbg, threads, !from_snapshot);
         repeat_resolution::RepeatResolver rr(dbg, &readStorage, {&extra_reads},
                                              k, kmdbg, dir, unique_threshold,
                                              diploid, debug, logger);
         rr.ResolveRepeats(logger, threads);
     };
     if(!skip)
-        runInFork(ic_task);
+        runIsolated(ic_task);
     return {dir / "assembly.hpc.fasta", dir / "mdbg.hpc.gfa"};
 }
 
@@ -292,7 +422,7 @@ std::vector<std::experimental::filesystem::path> PolishingPhase(
         os_cut.close();
     };
     if(!skip)
-        runInFork(ic_task);
+        runIsolated(ic_task);
     return {output_dir / "assembly.fasta", output_dir / "mdbg.gfa"};
 }
 
@@ -309,6 +439,10 @@ std::string constructMessage() {
     ss << "  -k <int>                                      Value of k used for initial error correction.\n";
     ss << "  -K <int>                                      Value of k used for final error correction and initialization of multiDBG.\n";
     ss << "  --diploid                                     Use this option for diploid genomes. By default LJA assumes that the genome is haploid or inbred.\n";
+    ss << "  --cache-reads                                 Store compressed reads in a binary cache in the output folder and read them from there in all subsequent passes and restarts.\n";
+    ss << "  --exact-junctions                             Find junction k-mers of the de Bruijn graph by sorting k-mers instead of using a Bloom filter. This avoids spurious junctions caused by false positives.\n";
+    ss << "  --max-memory <int>                            Memory limit in Gb for sparse de Bruijn graph construction. If the graph does not fit, its edges are built for one range of minimizers at a time with a separate pass over the reads for every range. The default value 0 means no limit.\n";
+    ss << "  --no-fork                                     Run all stages in one process instead of separate child processes. Free heap pages are returned to the system after every stage, but unlike separate processes this does not undo heap fragmentation, so memory left fragmented by one stage stays resident in the next. Disjointigs, corrected reads, graphs and read alignments are passed to the next stage in memory and result files of stages are written in the background.\n";
     return ss.str();
 }
 
@@ -330,6 +464,10 @@ int main(int argc, char **argv) {
                      "restart-from=none",
                      "load",
                      "noec",
+                     "cache-reads",
+                     "max-memory=0",
+                     "exact-junctions",
+                     "no-fork",
                      "alternative",
                      "diploid",
                      "debug",
@@ -374,6 +512,12 @@ int main(int argc, char **argv) {
     bool skip = first_stage != "none";
     bool load = parser.getCheck("load");
     bool noec = parser.getCheck("noec");
+    bool cache_reads = parser.getCheck("cache-reads");
+    size_t max_memory = std::stoull(parser.getValue("max-memory")) << 30u;
+    bool exact_junctions = parser.getCheck("exact-junctions");
+    forkIsolation() = !parser.getCheck("no-fork");
+    PhaseHandoff handoff;
+    handoff.enabled = !forkIsolation();
     logger.info() << "LJA pipeline started" << std::endl;
 
     size_t threads = std::stoi(parser.getValue("threads"));
@@ -395,7 +539,7 @@ int main(int argc, char **argv) {
     std::vector<std::experimental::filesystem::path> corrected_final;
     if(noec) {
         corrected_final = NoCorrection(logger, dir / ("k" + itos(K)), lib, {}, paths, threads, K, W,
-                                       skip, debug, load);
+                                       skip, debug, load, cache_reads, max_memory, exact_junctions, handoff);
     } else {
         double threshold = std::stod(parser.getValue("cov-threshold"));
         double reliable_coverage = std::stod(parser.getValue("rel-threshold"));
@@ -403,7 +547,7 @@ int main(int argc, char **argv) {
         if (first_stage == "alternative")
             skip = false;
         corrected1 = AlternativeCorrection(logger, dir / ("k" + itos(k)), lib, {}, paths, threads, k, w,
-                                           threshold, reliable_coverage, false, false, skip, debug, load);
+                                           threshold, reliable_coverage, false, false, skip, debug, load, cache_reads, max_memory, exact_junctions, handoff);
         if (first_stage == "alternative" || first_stage == "none")
             load = false;
 
@@ -413,7 +557,8 @@ int main(int argc, char **argv) {
         if (first_stage == "phase2")
             skip = false;
         corrected_final = SecondPhase(logger, dir / ("k" + itos(K)), {corrected1.first}, {corrected1.second}, paths,
-                            threads, K, W, Threshold, Reliable_coverage, unique_threshold, diploid, skip, debug, load);
+                            threads, K, W, Threshold, Reliable_coverage, unique_threshold, diploid, skip, debug, load, cache_reads, max_memory, exact_junctions, handoff);
+        io::MemoryFiles::remove(corrected1.first);
         if (first_stage == "phase2")
             load = false;
     }
@@ -421,7 +566,7 @@ int main(int argc, char **argv) {
         skip = false;
     std::vector<std::experimental::filesystem::path> resolved =
             MDBGPhase(logger, threads, K, KmDBG, W, unique_threshold, diploid, dir / "mdbg", corrected_final[1],
-                      corrected_final[2], skip, debug);
+                      corrected_final[2], skip, debug, handoff);
     if(first_stage == "rr")
         load = false;
 
@@ -433,6 +578,8 @@ int main(int argc, char **argv) {
                            lib, StringContig::max_dimer_size / 2, K, skip, debug);
     if(first_stage == "polishing")
         load = false;
+    io::MemoryFiles::remove(corrected_final[0]);
+    handoff.archive.wait();
     logger.info() << "Final homopolymer compressed and corrected reads can be found here: " << corrected_final[0] << std::endl;
     logger.info() << "Final graph with homopolymer compressed edges can be found here: " << resolved[1] << std::endl;
     logger.info() << "Final graph can be found here: " << uncompressed_results[1] << std::endl;
@@ -0,0 +1,86 @@
+//Measures throughput of read compression and packing kernels for all architectures supported by the CPU.
+//Usage: nucl_kernels_benchmark [total_length_in_Mb]
+
+#include "sequences/nucl_kernels.hpp"
+#include "sequences/contigs.hpp"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//HiFi-like reads: random sequence with homopolymers and occasional long dimer runs
+std::vector<std::string> generateReads(size_t total_length) {
+    std::mt19937 gen(239);
+    std::vector<std::string> reads;
+    size_t cur_length = 0;
+    while(cur_length < total_length) {
+        size_t len = 10000 + gen() % 10000;
+        std::string read;
+        read.reserve(len);
+        while(read.size() < len) {
+            char c = "ACGT"[gen() % 4];
+            if(gen() % 200 == 0) {
+                char d = "ACGT"[(c + 1 + gen() % 3) % 4];
+                for(size_t i = 0, run = 20 + gen() % 100; i < run; i++)
+                    read += i % 2 == 0 ? c : d;
+            } else {
+                read += std::string(1 + gen() % 3, c);
+            }
+        }
+        cur_length += read.size();
+        reads.emplace_back(std::move(read));
+    }
+    return reads;
+}
+
+double measure(const std::vector<std::string> &reads, const std::function<void(std::string &)> &f) {
+    std::vector<std::string> copy = reads;
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(std::string &read : copy) {
+        total += read.size();
+        f(read);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return double(total) / seconds;
+}
+
+int main(int argc, char **argv) {
+    size_t total_length = (argc > 1 ? std::stoull(argv[1]) : 200) * 1000000;
+    std::vector<std::string> reads = generateReads(total_length);
+    std::cout << "Generated " << reads.size() << " reads" << std::endl;
+    std::cout << std::setw(10) << "arch" << std::setw(12) << "upper" << std::setw(12) << "homopol"
+              << std::setw(12) << "dimers" << std::setw(12) << "pack" << std::setw(12) << "packRC"
+              << "  (Mb/s)" << std::endl;
+    std::vector<u_int64_t> words;
+    for(nucl_kernels::Architecture arch : nucl_kernels::SupportedArchitectures()) {
+        const nucl_kernels::Kernels &kernels = nucl_kernels::GetKernels(arch);
+        double upper = measure(reads, [&](std::string &s) {kernels.toUpper(&s[0], s.size());});
+        double homopolymers = measure(reads, [&](std::string &s) {kernels.collapseHomopolymers(&s[0], s.size());});
+        double dimers = measure(reads, [&](std::string &s) {kernels.compressDimers(&s[0], s.size(), 32);});
+        double pack = measure(reads, [&](std::string &s) {
+            words.resize((s.size() + 31) / 32);
+            kernels.pack(s.data(), s.size(), words.data());
+        });
+        double pack_rc = measure(reads, [&](std::string &s) {
+            words.resize((s.size() + 31) / 32);
+            kernels.packRC(s.data(), s.size(), words.data());
+        });
+        std::cout << std::setw(10) << nucl_kernels::ArchitectureName(arch) << std::fixed << std::setprecision(0)
+                  << std::setw(12) << upper / 1e6 << std::setw(12) << homopolymers / 1e6
+                  << std::setw(12) << dimers / 1e6 << std::setw(12) << pack / 1e6 << std::setw(12) << pack_rc / 1e6
+                  << std::endl;
+    }
+    StringContig::homopolymer_compressing = true;
+    StringContig::SetDimerParameters("32,32,1");
+    double full = measure(reads, [](std::string &s) {
+        StringContig contig(std::move(s), "read");
+        contig.makeSequence();
+    });
+    std::cout << "StringContig::makeSequence with " << nucl_kernels::ArchitectureName(nucl_kernels::BestArchitecture())
+              << " kernels: " << std::fixed << std::setprecision(0) << full / 1e6 << " Mb/s" << std::endl;
+    return 0;
+}
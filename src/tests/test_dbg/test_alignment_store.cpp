@@ -0,0 +1,56 @@
+#include "gtest/gtest.h"
+#include "dbg/graph_alignment_storage.hpp"
+#include "test_graphs.hpp"
+
+TEST(AlignmentStoreTest, RoundTrip) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    Sequence seq(RandomNucls(gen, 5000));
+//    Vertices are dense enough for paths to take several words of edge choices
+    std::vector<size_t> positions;
+    for(size_t pos = 0; pos + hasher.getK() <= seq.size(); pos += 60)
+        positions.emplace_back(pos);
+    dbg::SparseDBG dbg = LinearGraph(hasher, seq, positions, logger);
+    std::experimental::filesystem::path dir = std::experimental::filesystem::temp_directory_path();
+    ReadLogger readLogger(1, dir / "lja_test_alignment_store.log");
+    RecordStorage reads(dbg, 0, 100000, 1, readLogger, true);
+    RecordStorage extra_reads(dbg, 0, 100000, 1, readLogger, true);
+    for(size_t i = 0; i < 20; i++) {
+        size_t from = gen() % 4000;
+        size_t to = from + 100 + gen() % (seq.size() - from - 100);
+        Sequence read = i % 2 == 0 ? seq.Subseq(from, to) : !seq.Subseq(from, to);
+        RecordStorage &storage = i % 3 == 0 ? extra_reads : reads;
+        storage.addRead(AlignedRead("read" + std::to_string(i), dbg::CompactPath(dbg::GraphAligner(dbg).align(read))));
+    }
+    reads.addRead(AlignedRead("invalid"));
+    std::experimental::filesystem::path path = dir / "lja_test_alignments.aln";
+    SaveAllReads(path, {&reads, &extra_reads});
+    std::unordered_map<const dbg::Edge *, size_t> cov;
+    for(dbg::Edge &edge : dbg.edges()) {
+        cov[&edge] = edge.intCov();
+        edge.incCov(-edge.intCov());
+    }
+    RecordStorage loaded_reads(dbg, 0, 100000, 1, readLogger, true);
+    RecordStorage loaded_extra_reads(dbg, 0, 100000, 1, readLogger, true);
+    LoadAllReads(path, {&loaded_reads, &loaded_extra_reads}, dbg, 2);
+    for(const std::pair<RecordStorage *, RecordStorage *> &pair : {std::make_pair(&reads, &loaded_reads),
+                                                                  std::make_pair(&extra_reads, &loaded_extra_reads)}) {
+        const RecordStorage &expected = *pair.first;
+        const RecordStorage &loaded = *pair.second;
+        ASSERT_EQ(loaded.size(), expected.size());
+        for(size_t i = 0; i < expected.size(); i++) {
+            ASSERT_EQ(loaded[i].id, expected[i].id);
+            ASSERT_EQ(loaded[i].valid(), expected[i].valid());
+            if(!expected[i].valid())
+                continue;
+            ASSERT_EQ(&loaded[i].path.start(), &expected[i].path.start());
+            ASSERT_EQ(loaded[i].path.cpath(), expected[i].path.cpath());
+            ASSERT_EQ(loaded[i].path.leftSkip(), expected[i].path.leftSkip());
+            ASSERT_EQ(loaded[i].path.rightSkip(), expected[i].path.rightSkip());
+        }
+    }
+    for(dbg::Edge &edge : dbg.edges())
+        ASSERT_EQ(edge.intCov(), cov[&edge]);
+    std::experimental::filesystem::remove(path);
+}
@@ -0,0 +1,35 @@
+#include "gtest/gtest.h"
+#include "common/bloom_filter.hpp"
+#include "common/rolling_hash.hpp"
+#include <random>
+
+TEST(BlockedBloomFilterTest, InsertAndBatchLookup) {
+    std::mt19937_64 gen(239);
+    bloom_parameters parameters;
+    parameters.projected_element_count = 100000;
+    parameters.false_positive_probability = 0.0001;
+    parameters.compute_optimal_parameters();
+    BlockedBloomFilter filter(parameters);
+    std::vector<hashing::htype> keys;
+    for(size_t i = 0; i < 100000; i++)
+        keys.emplace_back(hashing::htype(gen()) * 1000003 + gen());
+    filter.insert(keys.data(), keys.size() / 2);
+    for(size_t i = keys.size() / 2; i < keys.size(); i++)
+        filter.insert(keys[i]);
+    for(size_t i = 0; i + 8 <= keys.size(); i += 8)
+        ASSERT_EQ(filter.containsBatch(keys.data() + i, 8), 0xffu);
+    size_t false_positives = 0;
+    std::vector<hashing::htype> other;
+    for(size_t i = 0; i < 1000000; i++)
+        other.emplace_back(hashing::htype(gen()) * 1000003 + gen());
+    for(size_t i = 0; i + 8 <= other.size(); i += 8) {
+        uint32_t found = filter.containsBatch(other.data() + i, 8);
+        for(size_t j = 0; j < 8; j++) {
+            ASSERT_EQ(bool((found >> j) & 1u), filter.contains(other[i + j]));
+            false_positives += (found >> j) & 1u;
+        }
+    }
+//    The filter is sized for the target rate, so the observed rate must stay close to it: 100 false positives expected
+    ASSERT_LT(false_positives, 2 * parameters.false_positive_probability * other.size());
+    ASSERT_GT(filter.count_bits().first, 0);
+}
@@ -0,0 +1,36 @@
+#include "gtest/gtest.h"
+#include "dbg/dbg_construction.hpp"
+#include "test_graphs.hpp"
+#include <fstream>
+
+TEST(BucketedConstructionTest, SameGraph) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    size_t w = 100;
+    std::string s = RandomNucls(gen, 20000);
+    s += s.substr(5000, 2000);
+    s += RandomNucls(gen, 5000);
+    Sequence genome(s);
+    std::experimental::filesystem::path path = std::experimental::filesystem::temp_directory_path() / "lja_test_bucketed.fasta";
+    std::ofstream os(path);
+    for(size_t i = 0; i < 100; i++) {
+        size_t pos = gen() % (genome.size() - 3000);
+        Sequence read = genome.Subseq(pos, pos + 1000 + gen() % 2000);
+        os << ">" << i << "\n" << (i % 2 == 0 ? read : !read) << "\n";
+    }
+    os.close();
+    io::Library lib = {path};
+    std::vector<hashing::htype> hash_list = constructMinimizers(logger, lib, 2, hasher, w);
+    std::vector<Sequence> disjointigs = constructDisjointigs(hasher, w, lib, hash_list, 2, logger);
+    std::vector<Sequence> bucketed = constructDisjointigsInBuckets(hasher, w, lib, hash_list, 2, logger, 1u << 16u,
+                                                                   std::experimental::filesystem::temp_directory_path());
+    ASSERT_NE(bucketed, disjointigs);
+//    Edge disjointigs are glued back, so they are only a few k-mers longer than the regular ones
+    ASSERT_LE(total_size(bucketed), total_size(disjointigs) + hasher.getK() * disjointigs.size());
+    dbg::SparseDBG dbg = constructDBG(logger, findJunctions(logger, disjointigs, hasher, 2), disjointigs, hasher, 2);
+    dbg::SparseDBG bdbg = constructDBG(logger, findJunctions(logger, bucketed, hasher, 2), bucketed, hasher, 2);
+    ASSERT_EQ(dbg.size(), bdbg.size());
+    ASSERT_EQ(EdgeSeqs(dbg), EdgeSeqs(bdbg));
+    std::experimental::filesystem::remove(path);
+}
@@ -0,0 +1,35 @@
+#include "gtest/gtest.h"
+#include "dbg/dbg_checkpoint.hpp"
+#include "test_graphs.hpp"
+
+namespace {
+    std::experimental::filesystem::path TempPath(const std::string &name) {
+        return std::experimental::filesystem::temp_directory_path() / name;
+    }
+}
+
+TEST(CheckpointTest, RoundTrip) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher(501, 239);
+    std::vector<Sequence> disjointigs;
+    for(size_t len : {1, 31, 32, 33, 64, 1000, 5000})
+        disjointigs.emplace_back(RandomNucls(gen, len));
+    disjointigs.emplace_back((!disjointigs.back()).Subseq(7, 2000));
+    std::vector<hashing::htype> hashs;
+    for(size_t i = 0; i < 1000; i++)
+        hashs.emplace_back(hashing::KWH(hasher, disjointigs.back(), i).hash());
+    std::experimental::filesystem::path dpath = TempPath("lja_test_disjointigs.bin");
+    std::experimental::filesystem::path hpath = TempPath("lja_test_vertices.bin");
+    dbg::ConstructionCheckpoint::writeDisjointigs(dpath, hasher, 2000, disjointigs);
+    dbg::ConstructionCheckpoint::writeHashs(hpath, hasher, 2000, hashs);
+    ASSERT_TRUE(dbg::ConstructionCheckpoint::isDisjointigs(dpath));
+    ASSERT_FALSE(dbg::ConstructionCheckpoint::isHashs(dpath));
+    ASSERT_TRUE(dbg::ConstructionCheckpoint::isHashs(hpath));
+    ASSERT_EQ(dbg::ConstructionCheckpoint::readDisjointigs(dpath, hasher, 2000), disjointigs);
+    ASSERT_EQ(dbg::ConstructionCheckpoint::readHashs(hpath, hasher, 2000), hashs);
+    hashing::RollingHash other(1001, 239);
+    ASSERT_DEATH(dbg::ConstructionCheckpoint::readHashs(hpath, other, 2000), "");
+    ASSERT_DEATH(dbg::ConstructionCheckpoint::readDisjointigs(dpath, hasher, 500), "");
+    std::experimental::filesystem::remove(dpath);
+    std::experimental::filesystem::remove(hpath);
+}
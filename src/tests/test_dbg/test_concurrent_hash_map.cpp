@@ -0,0 +1,92 @@
+#include "gtest/gtest.h"
+#include "common/concurrent_hash_map.hpp"
+#include "common/hash_utils.hpp"
+#include <random>
+#include <unordered_map>
+
+TEST(ConcurrentHashMapTest, SameAsUnorderedMap) {
+    typedef ConcurrentHashMap<uint64_t, uint64_t, hashing::alt_hasher<uint64_t>> Map;
+    std::mt19937_64 gen(239);
+    std::vector<uint64_t> keys;
+    for(size_t i = 0; i < 100000; i++)
+        keys.emplace_back(gen() % 50000);
+    Map map;
+    map.reserve(keys.size());
+#pragma omp parallel for default(none) shared(keys, map) num_threads(4)
+    for(size_t i = 0; i < keys.size(); i++)
+        map.emplace(keys[i], keys[i] * 3);
+    std::unordered_map<uint64_t, uint64_t> expected;
+    for(uint64_t key : keys)
+        expected.emplace(key, key * 3);
+    ASSERT_EQ(map.size(), expected.size());
+    std::unordered_map<uint64_t, const uint64_t *> addresses;
+    for(auto &it : map) {
+        ASSERT_EQ(expected[it.first], it.second);
+        addresses[it.first] = &it.second;
+    }
+    for(auto it = map.begin(); it != map.end();) {
+        if(it->first % 3 == 0)
+            it = map.erase(it);
+        else
+            ++it;
+    }
+    for(size_t i = 0; i < 100000; i++)
+        map.emplace(50000 + i, 0);
+    for(uint64_t key = 0; key < 50000; key++) {
+        ASSERT_EQ(map.contains(key), key % 3 != 0 && expected.find(key) != expected.end());
+        if(map.contains(key))
+            ASSERT_EQ(&map.find(key)->second, addresses[key]);
+    }
+    ASSERT_EQ(map.size(), size_t(std::distance(map.begin(), map.end())));
+}
+
+TEST(ConcurrentHashMapTest, ReuseAndCompact) {
+    typedef ConcurrentHashMap<uint64_t, uint64_t, hashing::alt_hasher<uint64_t>> Map;
+    Map map;
+    for(uint64_t key = 0; key < 20000; key++)
+        map.emplace(key, key);
+    std::unordered_map<uint64_t, const uint64_t *> addresses;
+    for(auto &it : map)
+        addresses[it.first] = &it.second;
+//    Erased values leave holes that are taken by the next insertions
+    std::vector<const uint64_t *> erased;
+    for(auto it = map.begin(); it != map.end();) {
+        if(it->first >= 5000 && it->first < 15000) {
+            erased.emplace_back(&it->second);
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    map.compact();
+    for(uint64_t key = 0; key < 20000; key++)
+        ASSERT_EQ(map.contains(key), key < 5000 || key >= 15000);
+#pragma omp parallel for default(none) shared(map) num_threads(4)
+    for(uint64_t key = 100000; key < 101000; key++)
+        map.emplace(key, key);
+    map.reserve(map.size() + 3000);
+#pragma omp parallel for default(none) shared(map) num_threads(4)
+    for(uint64_t key = 100000; key < 103000; key++)
+        map.emplace(key, key * 2);
+    ASSERT_EQ(map.size(), 13000);
+    ASSERT_EQ(map.size(), size_t(std::distance(map.begin(), map.end())));
+    std::sort(erased.begin(), erased.end());
+    size_t reused = 0;
+    for(auto &it : map) {
+        if(it.first < 100000)
+            ASSERT_EQ(&it.second, addresses[it.first]);
+        else
+            ASSERT_EQ(it.second, it.first < 101000 ? it.first : it.first * 2);
+        if(std::binary_search(erased.begin(), erased.end(), &it.second))
+            reused++;
+    }
+    ASSERT_EQ(reused, 3000);
+    for(uint64_t key = 0; key < 103000; key++)
+        ASSERT_EQ(map.contains(key), key < 5000 || (key >= 15000 && key < 20000) || key >= 100000);
+//    Blocks left without values are released and skipped
+    for(auto it = map.begin(); it != map.end();)
+        it = it->first < 100000 ? map.erase(it) : std::next(it);
+    map.compact();
+    ASSERT_EQ(map.size(), 3000);
+    ASSERT_EQ(map.size(), size_t(std::distance(map.begin(), map.end())));
+}
@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+#include "common/flat_hash_index.hpp"
+#include "common/hash_utils.hpp"
+#include <random>
+#include <unordered_map>
+
+TEST(FlatHashIndexTest, SameAsUnorderedMap) {
+    typedef FlatHashIndex<uint64_t, uint64_t, hashing::alt_hasher<uint64_t>> Index;
+    std::mt19937_64 gen(239);
+    Index index;
+    std::unordered_map<uint64_t, uint64_t> expected;
+    for(size_t batch = 0; batch < 3; batch++) {
+        std::vector<std::pair<uint64_t, uint64_t>> records;
+        for(size_t i = 0; i < 30000; i++) {
+            uint64_t key = gen() % 50000;
+            records.emplace_back(key, gen());
+            expected.emplace(records.back());
+        }
+        index.add(records, 4);
+    }
+    ASSERT_EQ(index.size(), expected.size());
+    for(uint64_t key = 0; key < 60000; key++) {
+        size_t i = index.find(key);
+        ASSERT_EQ(i != Index::none, expected.find(key) != expected.end());
+        if(i != Index::none) {
+            ASSERT_EQ(index.key(i), key);
+            ASSERT_EQ(index.value(i), expected[key]);
+        }
+    }
+}
+
+TEST(FlatHashIndexTest, InsertKeepsOldRecords) {
+    typedef FlatHashIndex<uint64_t, uint64_t, hashing::alt_hasher<uint64_t>> Index;
+    std::mt19937_64 gen(239);
+    Index index;
+    std::unordered_map<uint64_t, uint64_t> expected;
+    std::vector<std::pair<uint64_t, uint64_t>> records;
+    for(size_t i = 0; i < 20000; i++) {
+        records.emplace_back(gen() % 50000, gen());
+        expected.emplace(records.back());
+    }
+    index.add(records, 4);
+//    Small batches go to the overflow array until it outgrows an eighth of the index
+    for(size_t batch = 0; batch < 40; batch++) {
+        records.clear();
+        for(size_t i = 0; i < 100; i++) {
+            records.emplace_back(gen() % 60000, gen());
+            expected.emplace(records.back());
+        }
+        index.insert(records, 4);
+        if(batch % 10 == 0) {
+            size_t i = index.find(records[0].first);
+            index.erase(i);
+            expected.erase(records[0].first);
+        }
+    }
+    size_t found = 0;
+    for(uint64_t key = 0; key < 60000; key++) {
+        size_t i = index.find(key);
+        ASSERT_EQ(i != Index::none, expected.find(key) != expected.end());
+        if(i != Index::none) {
+            ASSERT_EQ(index.key(i), key);
+            ASSERT_EQ(index.value(i), expected[key]);
+            found++;
+        }
+    }
+    ASSERT_EQ(found, expected.size());
+}
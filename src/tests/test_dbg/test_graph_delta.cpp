@@ -0,0 +1,90 @@
+#include "gtest/gtest.h"
+#include "dbg/graph_delta.hpp"
+#include "test_graphs.hpp"
+
+static void CheckReads(dbg::SparseDBG &dbg, const RecordStorage &storage, const std::vector<Sequence> &reads) {
+    std::unordered_map<const dbg::Edge *, size_t> cov;
+    for(size_t i = 0; i < reads.size(); i++) {
+        dbg::GraphAlignment expected = dbg::GraphAligner(dbg).align(reads[i]);
+        dbg::GraphAlignment al = storage[i].path.getAlignment();
+        ASSERT_EQ(al.size(), expected.size());
+        for(size_t j = 0; j < al.size(); j++) {
+            ASSERT_EQ(&al[j].contig(), &expected[j].contig());
+            ASSERT_EQ(al[j].left, expected[j].left);
+            ASSERT_EQ(al[j].right, expected[j].right);
+        }
+        for(const dbg::GraphAlignment &path : {expected, expected.RC()}) {
+            for(const Segment<dbg::Edge> &seg : path)
+                cov[&seg.contig()] += seg.size();
+        }
+    }
+    for(dbg::Edge &edge : dbg.edges())
+        ASSERT_EQ(edge.intCov(), cov[&edge]);
+}
+
+TEST(GraphDeltaTest, SplitInsertRemove) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    std::string s = RandomNucls(gen, 3000);
+    Sequence seq(s);
+    dbg::SparseDBG dbg = LinearGraph(hasher, seq, {0, 1000, 2969}, logger);
+    ReadLogger readLogger(1, std::experimental::filesystem::temp_directory_path() / "lja_test_delta.log");
+    RecordStorage storage(dbg, 0, 100000, 1, readLogger, true);
+    std::vector<Sequence> reads = {seq.Subseq(200, 2500), seq.Subseq(1100, 1800), seq.Subseq(0, 900), seq.Subseq(1300, 3000)};
+    std::vector<AlignedRead> aligned;
+    for(size_t i = 0; i < reads.size(); i++)
+        aligned.emplace_back(std::to_string(i), dbg::CompactPath(dbg::GraphAligner(dbg).align(reads[i])));
+    storage.addReads(std::move(aligned), 1);
+    CheckReads(dbg, storage, reads);
+
+    std::string branch = s.substr(1400, 31) + "ACGT"[(seq[1431] + 1) % 4];
+    branch += RandomNucls(gen, 500);
+    branch += s.substr(2969);
+    dbg::Edge &e2 = dbg.getVertex(hashing::KWH(hasher, seq, 1000)).getOutgoing(seq[1031]);
+    dbg::GraphDelta delta;
+    delta.split(dbg::EdgePosition(e2, 400));
+    delta.insert(Sequence(branch));
+    delta.fillAnchors(50);
+    ASSERT_TRUE(delta.fitsInPlace(logger, 2, dbg));
+    dbg::ChangeLog log = delta.apply(logger, 2, dbg, {&storage});
+    ASSERT_EQ(dbg.size(), 4);
+    ASSERT_TRUE(log.changed(&e2));
+    dbg.checkConsistency(1, logger);
+    dbg.checkDBGConsistency(1, logger);
+    CheckReads(dbg, storage, reads);
+    hashing::KWH anchor(hasher, Sequence(branch), 100);
+    ASSERT_TRUE(dbg.isAnchor(anchor.hash()));
+    ASSERT_EQ(dbg.getAnchor(anchor).kmerSeq(), anchor.getSeq());
+
+    dbg::Vertex &junction = dbg.getVertex(hashing::KWH(hasher, seq, 1400));
+    ASSERT_EQ(junction.outDeg(), 2);
+    dbg::GraphDelta removal;
+    removal.remove(junction.getOutgoing(Sequence(branch)[31]));
+    removal.apply(logger, 2, dbg, {&storage});
+    ASSERT_EQ(dbg.size(), 2);
+    ASSERT_EQ(dbg.getVertex(hashing::KWH(hasher, seq, 0)).getOutgoing(seq[31]).size(), 2969);
+    dbg.checkConsistency(1, logger);
+    dbg.checkDBGConsistency(1, logger);
+    CheckReads(dbg, storage, reads);
+}
+
+TEST(GraphDeltaTest, RepeatedKmersDoNotFit) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    std::string s = RandomNucls(gen, 3000);
+    Sequence seq(s);
+    dbg::SparseDBG dbg = LinearGraph(hasher, seq, {0, 1000, 2969}, logger);
+    dbg::Edge &e2 = dbg.getVertex(hashing::KWH(hasher, seq, 1000)).getOutgoing(seq[1031]);
+    std::string start = s.substr(1400, 31) + "ACGT"[(seq[1431] + 1) % 4];
+    std::string branch = start + RandomNucls(gen, 200) + s.substr(2969);
+    std::string repeat = start + RandomNucls(gen, 100) + s.substr(500, 100) + RandomNucls(gen, 100) + s.substr(2969);
+    for(const std::vector<std::string> &insertions : std::vector<std::vector<std::string>>{{branch}, {repeat}, {branch, branch + "A"}}) {
+        dbg::GraphDelta delta;
+        delta.split(dbg::EdgePosition(e2, 400));
+        for(const std::string &insertion : insertions)
+            delta.insert(Sequence(insertion));
+        ASSERT_EQ(delta.fitsInPlace(logger, 2, dbg), insertions.size() == 1 && insertions[0] == branch);
+    }
+}
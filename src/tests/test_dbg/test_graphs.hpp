@@ -0,0 +1,39 @@
+#pragma once
+
+#include "dbg/sparse_dbg.hpp"
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+//Shared fixtures of graph tests. All of them use the same hasher and draw random sequences from a generator seeded by
+//the test, so that every test keeps its own deterministic input.
+inline hashing::RollingHash TestHasher() {
+    return hashing::RollingHash(31, 239);
+}
+
+inline std::string RandomNucls(std::mt19937 &gen, size_t len) {
+    std::string res;
+    for(size_t i = 0; i < len; i++)
+        res += "ACGT"[gen() % 4];
+    return res;
+}
+
+//Graph of a single sequence with vertices at the given k-mer positions and anchors every 50 k-mers
+inline dbg::SparseDBG LinearGraph(const hashing::RollingHash &hasher, const Sequence &seq,
+                                  const std::vector<size_t> &vertex_positions, logging::Logger &logger) {
+    dbg::SparseDBG dbg(hasher);
+    for(size_t pos : vertex_positions)
+        dbg.addVertex(hashing::KWH(hasher, seq, pos));
+    dbg.processRead(seq);
+    dbg.fillAnchors(50, logger, 1);
+    return std::move(dbg);
+}
+
+//Edge sequences with their start k-mers, to compare graphs built in different ways
+inline std::multiset<std::string> EdgeSeqs(dbg::SparseDBG &dbg) {
+    std::multiset<std::string> res;
+    for(dbg::Edge &edge : dbg.edges())
+        res.emplace((edge.start()->seq + edge.seq).str());
+    return std::move(res);
+}
@@ -0,0 +1,29 @@
+#include "gtest/gtest.h"
+#include "dbg/dbg_construction.hpp"
+#include "test_graphs.hpp"
+#include <algorithm>
+
+TEST(JunctionsTest, ExactMatchesBloom) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    std::string s = RandomNucls(gen, 30000);
+    s += s.substr(3000, 1000) + s.substr(10000, 2000);
+    s += RandomNucls(gen, 5000);
+    Sequence genome(s);
+    std::vector<Sequence> disjointigs;
+    for(size_t i = 0; i < 60; i++) {
+        size_t pos = gen() % (genome.size() - 3000);
+        Sequence seq = genome.Subseq(pos, pos + 500 + gen() % 2500);
+        disjointigs.emplace_back(i % 2 == 0 ? seq : !seq);
+    }
+    std::string cycle = RandomNucls(gen, 200);
+    disjointigs.emplace_back(cycle + cycle + cycle.substr(0, 40));
+    std::vector<hashing::htype> bloom = findJunctions(logger, disjointigs, hasher, 2);
+    std::vector<hashing::htype> exact = findJunctionsExact(logger, disjointigs, hasher, 2);
+    ASSERT_EQ(findJunctionsExact(logger, disjointigs, hasher, 3, 100000), exact);
+    ASSERT_TRUE(std::includes(bloom.begin(), bloom.end(), exact.begin(), exact.end()));
+    dbg::SparseDBG dbg = constructDBG(logger, bloom, disjointigs, hasher, 2);
+    dbg::SparseDBG edbg = constructDBG(logger, exact, disjointigs, hasher, 2);
+    ASSERT_EQ(EdgeSeqs(dbg), EdgeSeqs(edbg));
+}
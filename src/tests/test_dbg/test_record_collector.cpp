@@ -0,0 +1,38 @@
+#include "gtest/gtest.h"
+#include "common/omp_utils.hpp"
+#include "common/hash_utils.hpp"
+#include <random>
+#include <set>
+
+template<class T>
+static void CheckCollectUnique(bool unique, const std::function<T(uint64_t)> &make) {
+    ParallelRecordCollector<T> collector(4, unique);
+    std::set<T> expected;
+    std::vector<std::vector<T>> values(4);
+    std::mt19937_64 gen(239);
+    for(size_t t = 0; t < 4; t++) {
+        for(size_t i = 0; i < 50000 + t * 15000; i++) {
+            values[t].emplace_back(make(gen() % 75000));
+            expected.emplace(values[t].back());
+        }
+    }
+#pragma omp parallel for num_threads(4) schedule(static, 1)
+    for(size_t t = 0; t < 4; t++) {
+        for(size_t i = 0; i < values[t].size(); i += 10)
+            collector.addAll(values[t].begin() + i, values[t].begin() + std::min(i + 10, values[t].size()));
+    }
+    if(unique && RadixKey<T>::enabled)
+        ASSERT_LT(collector.size(), 290000);
+    std::vector<T> res = collector.collectUnique();
+    ASSERT_EQ(res, std::vector<T>(expected.begin(), expected.end()));
+    ASSERT_EQ(collector.size(), 0);
+}
+
+TEST(RecordCollectorTest, CollectUnique) {
+    CheckCollectUnique<uint64_t>(false, [](uint64_t x) {return x * 0x9E3779B97F4A7C15ull;});
+    CheckCollectUnique<uint64_t>(true, [](uint64_t x) {return x;});
+    CheckCollectUnique<unsigned __int128>(true, [](uint64_t x) {return (unsigned __int128)(x) << 70u | x;});
+    std::vector<int> objects(75000);
+    CheckCollectUnique<int *>(true, [&objects](uint64_t x) {return &objects[x];});
+    CheckCollectUnique<std::pair<uint64_t, uint64_t>>(false, [](uint64_t x) {return std::make_pair(x % 7, x);});
+}
@@ -0,0 +1,63 @@
+#include "gtest/gtest.h"
+#include "test_graphs.hpp"
+
+TEST(SnapshotTest, RoundTrip) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    Sequence seq(RandomNucls(gen, 3000));
+    dbg::SparseDBG dbg = LinearGraph(hasher, seq, {0, 1000, 1500, 2969}, logger);
+    size_t cnt = 0;
+    for(dbg::Edge &edge : dbg.edges()) {
+        edge.incCov(cnt * 7);
+        edge.is_reliable = cnt % 2 == 0;
+        edge.id = std::to_string(cnt);
+        cnt++;
+    }
+    std::experimental::filesystem::path path = std::experimental::filesystem::temp_directory_path() / "lja_test_graph.sdbg";
+    std::experimental::filesystem::path fasta = std::experimental::filesystem::temp_directory_path() / "lja_test_graph.fasta";
+    dbg.printFastaOld(fasta);
+    dbg.saveSnapshot(path, fasta);
+    dbg::SparseDBG loaded = dbg::SparseDBG::loadSnapshot(path, logger, 2);
+    ASSERT_EQ(loaded.size(), dbg.size());
+    for(dbg::Vertex &vertex : dbg.vertices()) {
+        dbg::Vertex &other = loaded.getVertex(vertex.hash(), vertex.isCanonical());
+        ASSERT_EQ(other.seq, vertex.seq);
+        ASSERT_EQ(other.coverage(), vertex.coverage());
+        ASSERT_EQ(other.outDeg(), vertex.outDeg());
+        for(size_t i = 0; i < vertex.outDeg(); i++) {
+            ASSERT_EQ(other[i].seq, vertex[i].seq);
+            ASSERT_EQ(other[i].intCov(), vertex[i].intCov());
+            ASSERT_EQ(other[i].is_reliable, vertex[i].is_reliable);
+            ASSERT_EQ(other[i].id, vertex[i].id);
+            ASSERT_EQ(other[i].start(), &other);
+            ASSERT_EQ(other[i].end() == nullptr, vertex[i].end() == nullptr);
+            if(vertex[i].end() != nullptr)
+                ASSERT_EQ(other[i].end(), &loaded.getVertex(vertex[i].end()->hash(), vertex[i].end()->isCanonical()));
+        }
+    }
+    for(size_t pos = 0; pos + hasher.getK() <= seq.size(); pos += 37) {
+        hashing::KWH kwh(hasher, seq, pos);
+        ASSERT_EQ(loaded.isAnchor(kwh.hash()), dbg.isAnchor(kwh.hash()));
+        if(dbg.isAnchor(kwh.hash())) {
+            ASSERT_EQ(loaded.getAnchor(kwh).pos, dbg.getAnchor(kwh).pos);
+            ASSERT_EQ(loaded.getAnchor(kwh).edge->seq, dbg.getAnchor(kwh).edge->seq);
+        }
+    }
+    ASSERT_TRUE(dbg::SparseDBG::snapshotMatches(path, fasta, hasher));
+    ASSERT_FALSE(dbg::SparseDBG::snapshotMatches(path, fasta, hashing::RollingHash(33, 239)));
+//    Fasta of the same size printed later
+    auto mtime = std::experimental::filesystem::last_write_time(fasta);
+    std::experimental::filesystem::last_write_time(fasta, mtime + std::chrono::seconds(1));
+    ASSERT_FALSE(dbg::SparseDBG::snapshotMatches(path, fasta, hasher));
+    std::experimental::filesystem::last_write_time(fasta, mtime);
+    ASSERT_TRUE(dbg::SparseDBG::snapshotMatches(path, fasta, hasher));
+    {
+        std::ofstream os(fasta, std::ios::app);
+        os << ">extra\nACGT\n";
+    }
+    std::experimental::filesystem::last_write_time(fasta, mtime);
+    ASSERT_FALSE(dbg::SparseDBG::snapshotMatches(path, fasta, hasher));
+    std::experimental::filesystem::remove(fasta);
+    std::experimental::filesystem::remove(path);
+}
@@ -0,0 +1,63 @@
+#include "gtest/gtest.h"
+#include "test_graphs.hpp"
+
+//Tips of different length are added to one vertex concurrently, shorter tips are prefixes of longer ones and
+//must be replaced by them
+TEST(VertexEdgesTest, ConcurrentPrefixes) {
+    std::mt19937 gen(239);
+    std::vector<std::string> tips;
+    for(size_t i = 0; i < 24; i++) {
+        tips.emplace_back(RandomNucls(gen, 200));
+    }
+    std::vector<std::pair<size_t, size_t>> tasks;
+    for(size_t i = 0; i < tips.size(); i++) {
+        for(size_t len = 1; len <= 200; len += 7)
+            tasks.emplace_back(i, len);
+    }
+    std::shuffle(tasks.begin(), tasks.end(), gen);
+    dbg::Vertex vertex(239);
+    vertex.setSequence(Sequence("ACGTACGTAC"));
+#pragma omp parallel for default(none) shared(tasks, tips, vertex) num_threads(8)
+    for(size_t i = 0; i < tasks.size(); i++) {
+        const std::pair<size_t, size_t> &task = tasks[i];
+        vertex.addEdge(dbg::Edge(&vertex, nullptr, Sequence(tips[task.first].substr(0, task.second))));
+    }
+    std::set<std::string> expected;
+    for(const std::string &tip : tips) {
+        bool maximal = true;
+        for(const std::string &other : tips) {
+            if(other != tip && other.substr(0, 197) == tip.substr(0, 197))
+                maximal = false;
+        }
+        if(maximal)
+            expected.emplace(tip.substr(0, 197));
+    }
+    std::set<std::string> result;
+    for(const dbg::Edge &edge : vertex)
+        result.emplace(edge.seq.str());
+    ASSERT_EQ(result, expected);
+    ASSERT_EQ(vertex.outDeg(), expected.size());
+    for(size_t i = 0; i < vertex.outDeg(); i++)
+        ASSERT_EQ(expected.count(vertex[i].seq.str()), 1);
+}
+
+//Sequences moved to the arena stay the same, edges longer than k share words with their reverse complements. Subgraphs
+//borrow the arena of the graph and keep it alive.
+TEST(VertexEdgesTest, MoveToArena) {
+    std::mt19937 gen(239);
+    hashing::RollingHash hasher = TestHasher();
+    logging::Logger logger(false);
+    Sequence seq(RandomNucls(gen, 3000));
+    dbg::SparseDBG dbg = LinearGraph(hasher, seq, {0, 10, 1000, 2969}, logger);
+    std::multiset<std::string> expected = EdgeSeqs(dbg);
+    dbg.moveToArena(logger, 2);
+    ASSERT_EQ(EdgeSeqs(dbg), expected);
+    for(dbg::Edge &edge : dbg.edges())
+        ASSERT_EQ(edge.rc().seq, (!(edge.start()->seq + edge.seq)).Subseq(hasher.getK()));
+    std::vector<Segment<dbg::Edge>> pieces;
+    for(dbg::Edge &edge : dbg.edgesUnique())
+        pieces.emplace_back(edge, 0, edge.size());
+    dbg::SparseDBG subgraph = dbg.Subgraph(pieces);
+    dbg = dbg::SparseDBG(hasher);
+    ASSERT_EQ(EdgeSeqs(subgraph), expected);
+}
@@ -0,0 +1,38 @@
+#include "gtest/gtest.h"
+#include "sequences/seqio.hpp"
+#include <fstream>
+#include <random>
+#include <string>
+
+TEST(MemoryFilesTest, SameAsFile) {
+    std::mt19937 gen(239);
+    std::vector<StringContig> records;
+    std::experimental::filesystem::path path = std::experimental::filesystem::temp_directory_path() / "lja_test_memory.fasta";
+    std::ofstream os(path);
+    for(size_t len : {10, 500, 3000, 12000}) {
+        std::string s;
+        for(size_t i = 0; i < len; i++)
+            s += "acgt"[gen() % 4];
+        std::string id = "read" + std::to_string(len);
+        os << ">" << id << "\n" << s << "\n";
+        records.emplace_back(std::move(s), std::move(id));
+    }
+    os.close();
+    io::MemoryFiles::Records shared = std::make_shared<const std::vector<StringContig>>(std::move(records));
+    std::experimental::filesystem::path memory_path = std::experimental::filesystem::temp_directory_path() / "lja_test_memory_only.fasta";
+    io::MemoryFiles::add(memory_path, shared);
+    ASSERT_TRUE(io::MemoryFiles::contains({memory_path}));
+    ASSERT_TRUE(io::CheckLibrary({memory_path}));
+    for(size_t min_read_size : {size_t(-1) / 2, size_t(2000)}) {
+        std::vector<StringContig> expected = io::SeqReader(path, min_read_size, 200).readAll();
+        std::vector<StringContig> res = io::SeqReader({memory_path, memory_path}, min_read_size, 200).readAll();
+        ASSERT_EQ(res.size(), expected.size() * 2);
+        for(size_t i = 0; i < res.size(); i++) {
+            ASSERT_EQ(res[i].id, expected[i % expected.size()].id);
+            ASSERT_EQ(res[i].seq, expected[i % expected.size()].seq);
+        }
+    }
+    io::MemoryFiles::remove(memory_path);
+    ASSERT_FALSE(io::MemoryFiles::contains({memory_path}));
+    std::experimental::filesystem::remove(path);
+}
@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "sequences/nucl_kernels.hpp"
+#include "sequences/sequence.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    //Random sequence with long homopolymers and dimer runs of different lengths
+    std::string RandomRead(std::mt19937 &gen, size_t len, bool lower) {
+        std::string res;
+        std::string alphabet = lower ? "ACGTacgtN" : "ACGT";
+        while(res.size() < len) {
+            size_t type = gen() % 4;
+            char c = alphabet[gen() % alphabet.size()];
+            if(type == 0) {
+                res += std::string(1 + gen() % 50, c);
+            } else if(type == 1) {
+                char d = "ACGT"[gen() % 4];
+                size_t run = 1 + gen() % 80;
+                for(size_t i = 0; i < run; i++)
+                    res += i % 2 == 0 ? c : d;
+            } else {
+                res += c;
+            }
+        }
+        res.resize(len);
+        return res;
+    }
+}
+
+TEST(NuclKernelsTest, SameAsScalar) {
+    std::mt19937 gen(239);
+    const nucl_kernels::Kernels &scalar = nucl_kernels::ScalarKernels();
+    for(nucl_kernels::Architecture arch : nucl_kernels::SupportedArchitectures()) {
+        const nucl_kernels::Kernels &kernels = nucl_kernels::GetKernels(arch);
+        ASSERT_EQ(kernels.arch, arch);
+        for(size_t iter = 0; iter < 2000; iter++) {
+            size_t len = iter < 300 ? iter : gen() % 5000;
+            std::string s = RandomRead(gen, len, true);
+            std::string expected = s;
+            scalar.toUpper(&expected[0], expected.size());
+            kernels.toUpper(&s[0], s.size());
+            ASSERT_EQ(s, expected);
+            expected.resize(scalar.collapseHomopolymers(&expected[0], expected.size()));
+            s.resize(kernels.collapseHomopolymers(&s[0], s.size()));
+            ASSERT_EQ(s, expected);
+            size_t max_dimer_size = 2 + gen() % 60;
+            expected.resize(scalar.compressDimers(&expected[0], expected.size(), max_dimer_size));
+            s.resize(kernels.compressDimers(&s[0], s.size(), max_dimer_size));
+            ASSERT_EQ(s, expected) << max_dimer_size;
+            std::vector<u_int64_t> expected_words((s.size() + 31) / 32), words((s.size() + 31) / 32);
+            scalar.pack(s.data(), s.size(), expected_words.data());
+            kernels.pack(s.data(), s.size(), words.data());
+            ASSERT_EQ(words, expected_words);
+            scalar.packRC(s.data(), s.size(), expected_words.data());
+            kernels.packRC(s.data(), s.size(), words.data());
+            ASSERT_EQ(words, expected_words);
+        }
+    }
+}
+
+TEST(NuclKernelsTest, PackedSequence) {
+    std::mt19937 gen(17);
+    std::vector<Sequence> from_arena;
+    std::unique_ptr<NuclArena> arena(new NuclArena());
+    for(size_t len : {1, 31, 32, 33, 64, 1000}) {
+        std::string s = RandomRead(gen, len, false);
+        Sequence seq(s);
+        Sequence rc(s, true);
+        ASSERT_EQ(seq.str(), s);
+        ASSERT_EQ(rc, !seq);
+        ASSERT_EQ(Sequence::FromPacked(seq.packed().data(), seq.size()), seq);
+        from_arena.emplace_back(Sequence::FromPacked(seq.packed().data(), seq.size(), *arena).Subseq(1));
+        ASSERT_EQ(from_arena.back(), seq.Subseq(1));
+        ASSERT_EQ(seq.Subseq(1).copy(*arena), seq.Subseq(1));
+        ASSERT_EQ((!seq).copy(*arena), !seq);
+    }
+    ASSERT_EQ(from_arena.back().size(), 999);
+    ASSERT_EQ(!!from_arena.back(), from_arena.back());
+}
+
+//Threads fill their own chunks, so sequences allocated concurrently never overlap
+TEST(NuclKernelsTest, ArenaFromThreads) {
+    std::mt19937 gen(23);
+    std::vector<Sequence> seqs;
+    for(size_t i = 0; i < 2000; i++)
+        seqs.emplace_back(RandomRead(gen, 100 + gen() % 3000, false));
+    NuclArena arena;
+    std::vector<Sequence> copies(seqs.size());
+#pragma omp parallel for default(none) shared(seqs, copies, arena) schedule(dynamic, 1) num_threads(8)
+    for(size_t i = 0; i < seqs.size(); i++)
+        copies[i] = seqs[i].copy(arena);
+    size_t words = 0;
+    for(size_t i = 0; i < seqs.size(); i++) {
+        ASSERT_EQ(copies[i], seqs[i]);
+        words += (seqs[i].size() + 31) / 32;
+    }
+    ASSERT_GE(arena.usedBytes(), words * sizeof(uint64_t));
+    ASSERT_LE(arena.usedBytes(), arena.allocatedBytes());
+}
+
+TEST(NuclKernelsTest, InlineSubsequences) {
+    std::mt19937 gen(19);
+    std::string s = RandomRead(gen, 300, false);
+    Sequence seq(s);
+    for(size_t from : {0, 1, 31, 32, 45, 200}) {
+        for(size_t len : {0, 1, 32, 33, 63, 64, 65, 100}) {
+            Sequence sub = seq.Subseq(from, from + len);
+            ASSERT_EQ(sub.str(), s.substr(from, len));
+            ASSERT_EQ((!sub).str(), (!seq).Subseq(300 - from - len, 300 - from).str());
+            ASSERT_EQ((!seq).Subseq(300 - from - len, 300 - from), !sub);
+            ASSERT_TRUE(seq.Subseq(from).startsWith(sub));
+            Sequence moved = std::move(sub);
+            ASSERT_EQ(moved.str(), s.substr(from, len));
+            ASSERT_EQ(Sequence::FromPacked(moved.packed().data(), len), moved);
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#include "gtest/gtest.h"
+#include "common/rolling_hash.hpp"
+#include <random>
+#include <string>
+
+namespace {
+    Sequence RandomSequence(std::mt19937 &gen, size_t len) {
+        std::string s;
+        for(size_t i = 0; i < len; i++)
+            s += "ACGT"[gen() % 4];
+        return Sequence(s);
+    }
+
+    template<class H>
+    void CheckRollingHash(size_t k) {
+        std::mt19937 gen(239);
+        hashing::BasicRollingHash<H> hasher(k, 239);
+        Sequence seq = RandomSequence(gen, 2000);
+        hashing::BasicKWH<H> kwh(hasher, seq, 0);
+        while(true) {
+            hashing::BasicKWH<H> direct(hasher, seq, kwh.pos);
+            ASSERT_EQ(kwh.fHash(), direct.fHash());
+            ASSERT_EQ(kwh.rHash(), direct.rHash());
+            ASSERT_EQ(kwh.hash(), hashing::BasicKWH<H>(hasher, !kwh.getSeq(), 0).hash());
+            if(kwh.pos > 0)
+                ASSERT_EQ(kwh.prev().fHash(), hasher.hash(seq, kwh.pos - 1));
+            if(!kwh.hasNext())
+                break;
+            kwh = kwh.next();
+        }
+        ASSERT_EQ(kwh.pos + k, seq.size());
+    }
+}
+
+TEST(RollingHashTest, Hash128) {
+    CheckRollingHash<unsigned __int128>(501);
+}
+
+TEST(RollingHashTest, Hash64) {
+    CheckRollingHash<uint64_t>(501);
+}
+
+TEST(RollingHashTest, Hash64IsTruncatedHash128) {
+    std::mt19937 gen(17);
+    Sequence seq = RandomSequence(gen, 1000);
+    hashing::BasicRollingHash<uint64_t> hasher64(31, 239);
+    hashing::BasicRollingHash<unsigned __int128> hasher128(31, 239);
+    for(size_t pos = 0; pos + 31 <= seq.size(); pos++)
+        ASSERT_EQ(hasher64.hash(seq, pos), uint64_t(hasher128.hash(seq, pos)));
+}
+
+TEST(RollingHashTest, MinimizerInEveryWindow) {
+    std::mt19937 gen(17);
+    Sequence seq = RandomSequence(gen, 10000);
+    hashing::BasicRollingHash<uint64_t> hasher(31, 239);
+    std::vector<hashing::BasicKWH<uint64_t>> minimizers = hashing::BasicMinimizerCalculator<uint64_t>(seq, hasher, 100).minimizers();
+    //MinimizerCalculator windows consist of w + 1 consecutive k-mers
+    ASSERT_LE(minimizers.front().pos, 100u);
+    for(size_t i = 1; i < minimizers.size(); i++)
+        ASSERT_LE(minimizers[i].pos - minimizers[i - 1].pos, 101u);
+    ASSERT_GE(minimizers.back().pos + 100, seq.size() - 31 + 1);
+}
+
+TEST(RollingHashTest, KmerCursorSameAsKWH) {
+    std::mt19937 gen(42);
+    hashing::RollingHash hasher(51, 239);
+    Sequence full = RandomSequence(gen, 3000);
+    //Cursor has to work on subsequences and reverse complements sharing a buffer
+    for(const Sequence &seq : {full, !full, full.Subseq(17, 2500), (!full).Subseq(3, 1001)}) {
+        hashing::KWH kwh(hasher, seq, 0);
+        hashing::KmerCursor cursor(hasher, seq, 0);
+        while(true) {
+            ASSERT_EQ(cursor.pos, kwh.pos);
+            ASSERT_EQ(cursor.fHash(), kwh.fHash());
+            ASSERT_EQ(cursor.rHash(), kwh.rHash());
+            for(unsigned char c = 0; c < 4; c++) {
+                ASSERT_EQ(cursor.extendRight(c), kwh.extendRight(c));
+                ASSERT_EQ(cursor.extendLeft(c), kwh.extendLeft(c));
+            }
+            if(!kwh.hasNext())
+                break;
+            ASSERT_TRUE(cursor.hasNext());
+            kwh = kwh.next();
+            cursor.next();
+        }
+        ASSERT_FALSE(cursor.hasNext());
+        hashing::KmerCursor batch_cursor(hasher, seq, 5);
+        std::vector<hashing::KmerHash> batch(100);
+        size_t total = 0;
+        size_t n;
+        while((n = batch_cursor.fill(batch.data(), batch.size())) > 0) {
+            for(size_t i = 0; i < n; i++) {
+                hashing::KWH expected(hasher, seq, 5 + total + i);
+                ASSERT_EQ(batch[i].pos, expected.pos);
+                ASSERT_EQ(batch[i].hash, expected.hash());
+                ASSERT_EQ(batch[i].canonical, expected.isCanonical());
+            }
+            total += n;
+        }
+        ASSERT_EQ(total, seq.size() - 51 + 1 - 5);
+    }
+}
+
+TEST(RollingHashTest, MinimizerEngineSameAsCalculator) {
+    std::mt19937 gen(7);
+    hashing::RollingHash hasher(31, 239);
+    hashing::MinimizerEngine engine(hasher, 50);
+    std::vector<hashing::htype> hashes;
+    std::vector<size_t> positions;
+    for(size_t iter = 0; iter < 50; iter++) {
+        //Low complexity sequences produce equal hashes in the same window
+        Sequence seq = iter % 5 == 0 ? Sequence(std::string(80 + iter * 7, 'A')) : RandomSequence(gen, 80 + gen() % 5000);
+        std::vector<hashing::htype> expected = hashing::MinimizerCalculator(seq, hasher, 50).minimizerHashs();
+        hashes.resize(engine.maxMinimizers(seq.size()));
+        positions.resize(engine.maxMinimizers(seq.size()));
+        size_t n = engine.process(seq, hashes.data(), positions.data());
+        hashes.resize(n);
+        for(size_t i = 0; i < n; i++) {
+            ASSERT_EQ(hashes[i], hashing::KWH(hasher, seq, positions[i]).hash());
+            if(i > 0)
+                ASSERT_GT(positions[i], positions[i - 1]);
+        }
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        ASSERT_EQ(hashes, expected);
+    }
+}
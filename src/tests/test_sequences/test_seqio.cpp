@@ -0,0 +1,168 @@
+#include "gtest/gtest.h"
+#include "sequences/seqio.hpp"
+#include "sequences/read_cache.hpp"
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace {
+    std::vector<std::pair<std::string, std::string>> RandomReads(size_t n, size_t min_len, size_t max_len) {
+        std::mt19937 gen(239);
+        std::vector<std::pair<std::string, std::string>> res;
+        for(size_t i = 0; i < n; i++) {
+            size_t len = min_len + gen() % (max_len - min_len + 1);
+            std::string seq(len, 'A');
+            for(char &c : seq)
+                c = "ACGT"[gen() % 4];
+            res.emplace_back("read" + std::to_string(i), seq);
+        }
+        return res;
+    }
+
+    void CheckReads(const std::experimental::filesystem::path &file,
+                    const std::vector<std::pair<std::string, std::string>> &reads) {
+        io::SeqReader reader(file);
+        size_t cnt = 0;
+        for(StringContig contig : reader) {
+            ASSERT_LT(cnt, reads.size());
+            ASSERT_EQ(contig.id, reads[cnt].first);
+            ASSERT_EQ(contig.seq, reads[cnt].second);
+            cnt++;
+        }
+        ASSERT_EQ(cnt, reads.size());
+    }
+
+    void WriteBGZF(std::ostream &os, const std::string &data) {
+        const size_t block_size = 65280;
+        for(size_t from = 0; from <= data.size(); from += block_size) {
+            size_t len = std::min(block_size, data.size() - from);
+            std::vector<unsigned char> cdata(compressBound(len) + 16);
+            z_stream strm{};
+            ASSERT_EQ(deflateInit2(&strm, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY), Z_OK);
+            strm.next_in = reinterpret_cast<unsigned char *>(const_cast<char *>(&data[from]));
+            strm.avail_in = len;
+            strm.next_out = cdata.data();
+            strm.avail_out = cdata.size();
+            ASSERT_EQ(deflate(&strm, Z_FINISH), Z_STREAM_END);
+            size_t clen = strm.total_out;
+            deflateEnd(&strm);
+            size_t bsize = 18 + clen + 8 - 1;
+            unsigned char header[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+                                        (unsigned char)(bsize & 255u), (unsigned char)(bsize >> 8u)};
+            uint32_t tail[2] = {uint32_t(crc32(0, reinterpret_cast<const unsigned char *>(data.data() + from), len)),
+                                uint32_t(len)};
+            os.write(reinterpret_cast<char *>(header), 18);
+            os.write(reinterpret_cast<char *>(cdata.data()), clen);
+            os.write(reinterpret_cast<char *>(tail), 8);
+        }
+    }
+
+    std::string Fastq(const std::vector<std::pair<std::string, std::string>> &reads, size_t from, size_t to) {
+        std::stringstream ss;
+        for(size_t i = from; i < to; i++)
+            ss << "@" << reads[i].first << "\n" << reads[i].second << "\n+\n" << std::string(reads[i].second.size(), 'I') << "\n";
+        return ss.str();
+    }
+}
+
+TEST(SeqReaderTest, MultilineFasta) {
+    std::vector<std::pair<std::string, std::string>> reads = RandomReads(300, 1, 30000);
+    std::experimental::filesystem::path file = std::experimental::filesystem::temp_directory_path() / "lja_test_reads.fasta";
+    std::ofstream os(file);
+    for(auto &read : reads) {
+        os << ">" << read.first << " comment\r\n";
+        for(size_t i = 0; i < read.second.size(); i += 77)
+            os << read.second.substr(i, 77) << "\r\n";
+        os << "\n";
+    }
+    os.close();
+    CheckReads(file, reads);
+    std::experimental::filesystem::remove(file);
+}
+
+TEST(SeqReaderTest, FastqWithAtQualities) {
+    std::vector<std::pair<std::string, std::string>> reads = RandomReads(400, 100, 20000);
+    std::experimental::filesystem::path file = std::experimental::filesystem::temp_directory_path() / "lja_test_reads.fastq";
+    std::ofstream os(file);
+    for(auto &read : reads) {
+        os << "@" << read.first << "\n" << read.second << "\n+\n" << std::string(read.second.size(), '@') << "\n";
+    }
+    os.close();
+    CheckReads(file, reads);
+    std::experimental::filesystem::remove(file);
+}
+
+TEST(SeqReaderTest, BGZFFastq) {
+    std::vector<std::pair<std::string, std::string>> reads = RandomReads(200, 100, 20000);
+    std::string data = Fastq(reads, 0, reads.size());
+    std::experimental::filesystem::path file = std::experimental::filesystem::temp_directory_path() / "lja_test_reads.fastq.gz";
+    std::ofstream os(file, std::ios::binary);
+    WriteBGZF(os, data);
+    os.close();
+    ASSERT_TRUE(io::ParallelGzStreambuf::isBGZF(file));
+    CheckReads(file, reads);
+    std::experimental::filesystem::remove(file);
+}
+
+//Concatenated gzip file with BGZF members followed by plain gzip members is read with gzread after the BGZF part.
+TEST(SeqReaderTest, BGZFFollowedByGzip) {
+    std::vector<std::pair<std::string, std::string>> reads = RandomReads(200, 100, 20000);
+    std::experimental::filesystem::path file = std::experimental::filesystem::temp_directory_path() / "lja_test_mixed.fastq.gz";
+    std::experimental::filesystem::path tail = std::experimental::filesystem::temp_directory_path() / "lja_test_tail.gz";
+    for(size_t part : {size_t(150), size_t(180)}) {
+        gzFile gz = gzopen(tail.c_str(), "wb");
+        std::string plain = Fastq(reads, part, reads.size());
+        ASSERT_EQ(gzwrite(gz, plain.data(), plain.size()), int(plain.size()));
+        gzclose(gz);
+        std::ofstream os(file, std::ios::binary);
+        WriteBGZF(os, Fastq(reads, 0, part));
+        std::ifstream is(tail, std::ios::binary);
+        os << is.rdbuf();
+        os.close();
+        ASSERT_TRUE(io::ParallelGzStreambuf::isBGZF(file));
+        CheckReads(file, reads);
+    }
+    std::experimental::filesystem::remove(tail);
+    std::experimental::filesystem::remove(file);
+}
+
+TEST(ReadCacheTest, SameReadsAsSeqReader) {
+    std::vector<std::pair<std::string, std::string>> reads = RandomReads(300, 1, 30000);
+    for(size_t i = 0; i < reads.size(); i += 7)
+        reads[i].second = reads[i].second.substr(0, reads[i].second.size() / 2) + std::string(20, 'A') + "ACACACACACACACACACACACAC" + reads[i].second;
+    std::experimental::filesystem::path dir = std::experimental::filesystem::temp_directory_path();
+    std::experimental::filesystem::path file = dir / "lja_test_cache_reads.fasta";
+    std::experimental::filesystem::path cache_file = dir / "lja_test_reads.hpc";
+    std::ofstream os(file);
+    for(auto &read : reads)
+        os << ">" << read.first << "\n" << read.second << "\n";
+    os.close();
+    StringContig::homopolymer_compressing = true;
+    StringContig::SetDimerParameters("8,12,1");
+    logging::Logger logger;
+    io::Library lib = io::ReadCache::prepare(logger, 4, {file}, cache_file, io::ReadCache::splitLength(5000, 1000));
+    ASSERT_TRUE(io::ReadCache::isValid(cache_file, {file}, io::ReadCache::splitLength(5000, 1000)));
+    ASSERT_FALSE(io::ReadCache::isValid(cache_file, {file}, io::ReadCache::splitLength(4000, 1000)));
+//    Pieces of split reads must be the same as pieces of raw reads compressed separately
+    for(size_t min_read_size : {size_t(-1) / 2, size_t(5000), size_t(7000)}) {
+        std::vector<std::pair<std::string, std::string>> actual;
+        io::ProcessReads(lib, min_read_size, 1000, [&](auto begin, auto end) {
+            for(; begin != end; ++begin) {
+                auto read = *begin;
+                actual.emplace_back(read.id, read.makeSequence().str());
+            }
+        });
+        std::vector<std::pair<std::string, std::string>> expected;
+        io::ProcessReads({file}, min_read_size, 1000, [&](auto begin, auto end) {
+            for(; begin != end; ++begin) {
+                auto read = *begin;
+                expected.emplace_back(read.id, read.makeSequence().str());
+            }
+        });
+        ASSERT_EQ(actual, expected);
+    }
+    StringContig::homopolymer_compressing = false;
+    StringContig::SetDimerParameters("1000000000,1000000000,1");
+    std::experimental::filesystem::remove(file);
+    std::experimental::filesystem::remove(cache_file);
+}
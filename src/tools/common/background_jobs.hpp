@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include <thread>
+#include <vector>
+
+//Jobs that run in separate threads while the pipeline goes on, such as writing files that are only kept as archives.
+//Jobs must only read data that stays unchanged until wait() returns. The destructor waits for all jobs.
+class BackgroundJobs {
+private:
+    std::vector<std::thread> jobs;
+public:
+    BackgroundJobs() = default;
+    BackgroundJobs(const BackgroundJobs &) = delete;
+    BackgroundJobs &operator=(const BackgroundJobs &) = delete;
+    ~BackgroundJobs() {wait();}
+
+    void add(std::function<void()> job) {
+        jobs.emplace_back(std::move(job));
+    }
+
+    void wait() {
+        for(std::thread &job : jobs)
+            job.join();
+        jobs.clear();
+    }
+};
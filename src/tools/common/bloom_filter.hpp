@@ -3,13 +3,19 @@
 //
 
 #pragma once
+#include "omp_utils.hpp"
+#include "verify.hpp"
 #include <algorithm>
-//#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 //#include <cstddef>
-//#include <cstdlib>
+#include <cstdlib>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 
 
@@ -93,46 +99,20 @@ public:
     {
         /*
           Note:
-          The following will attempt to find the number of hash functions
-          and minimum amount of storage bits required to construct a bloom
-          filter consistent with the user defined false positive probability
-          and estimated element insertion count.
+          The number of hash functions and the amount of storage bits are
+          fixed: 5 hashes and 32 bits per estimated element. The false
+          positive probability is not used here. BlockedBloomFilter sizes
+          itself from it instead.
         */
 
         if (!(*this))
             return false;
 
-        double min_m  = std::numeric_limits<double>::infinity();
-        double min_k  = 0.0;
-        double k      = 1.0;
-
-//        while (k < 1000.0)
-//        {
-//            const double numerator   = (- k * projected_element_count);
-//            const double denominator = std::log(1.0 - std::pow(false_positive_probability, 1.0 / k));
-//
-//            const double curr_m = numerator / denominator;
-//
-//            if (curr_m < min_m)
-//            {
-//                min_m = curr_m;
-//                min_k = k;
-//            }
-//
-//            k += 1.0;
-//        }
-//
         optimal_parameters_t& optp = optimal_parameters;
 
-//        optp.number_of_hashes = static_cast<unsigned int>(min_k);
         optp.number_of_hashes = 5;
-
-//        optp.table_size = static_cast<unsigned long long int>(min_m);
-//
-//        optp.table_size += (((optp.table_size % bits_per_char) != 0) ? (bits_per_char - (optp.table_size % bits_per_char)) : 0);
         optp.table_size = projected_element_count * 32;
 
-
         if (optp.number_of_hashes < minimum_number_of_hashes)
             optp.number_of_hashes = minimum_number_of_hashes;
         else if (optp.number_of_hashes > maximum_number_of_hashes)
@@ -669,4 +649,187 @@ public:
         }
         inserted_element_count_ += b.size();
     }
-};
\ No newline at end of file
+};
+
+//Bloom filter that keeps all probes of a key in one 64-byte block, so that an insert or a lookup touches a single
+//cache line. The block and the bits inside it are taken from different parts of one mixed 64-bit fingerprint of the
+//key. Sized by the same parameters as BloomFilter. Inserts are thread safe and can run concurrently with lookups.
+class BlockedBloomFilter {
+public:
+    static const size_t block_bits = 512;
+    static const size_t max_batch = 32;
+private:
+    struct alignas(64) Block {
+        uint64_t words[block_bits / 64];
+    };
+//    new does not honour the alignment of Block before C++17, so blocks are allocated with posix_memalign
+    struct BlockDeleter {
+        void operator()(Block *blocks) const {free(blocks);}
+    };
+    std::unique_ptr<Block[], BlockDeleter> blocks_;
+    size_t block_count_;
+    size_t probes_;
+
+    template<class T>
+    static uint64_t fingerprint(const T &key) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&key);
+        uint64_t res = 0;
+        for(size_t i = 0; i < sizeof(T); i += sizeof(uint64_t)) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + i, std::min(sizeof(uint64_t), sizeof(T) - i));
+            res = (res ^ word) * 0x9E3779B97F4A7C15ull;
+        }
+        res ^= res >> 31u;
+        res *= 0xBF58476D1CE4E5B9ull;
+        res ^= res >> 29u;
+        res *= 0x94D049BB133111EBull;
+        return res ^ (res >> 32u);
+    }
+
+    const Block &block(uint64_t fp) const {
+        return blocks_[size_t((unsigned __int128)(fp) * block_count_ >> 64u)];
+    }
+
+    Block &block(uint64_t fp) {
+        return blocks_[size_t((unsigned __int128)(fp) * block_count_ >> 64u)];
+    }
+
+//    Probes use double hashing: probe i is derived from h1 + i * h2, where h1 and h2 come from a second mix of the
+//    fingerprint, independent of the bits that chose the block. Inside 512 bits the progression itself has too few
+//    distinct patterns, so every value is finalized before its low 9 bits give the position.
+    static std::pair<uint64_t, uint64_t> probeHashes(uint64_t fp) {
+        uint64_t mix = (fp ^ 0x9E3779B97F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+        mix ^= mix >> 29u;
+        mix *= 0x165667B19E3779F9ull;
+        mix ^= mix >> 32u;
+        return {mix, (mix * 0x9FB21C651E98DF25ull) ^ (fp << 7u)};
+    }
+
+    static size_t probePosition(const std::pair<uint64_t, uint64_t> &h, size_t i) {
+        uint64_t x = h.first + i * h.second;
+        x ^= x >> 31u;
+        x *= 0xC2B2AE3D27D4EB4Full;
+        x ^= x >> 29u;
+        return x & (block_bits - 1);
+    }
+
+    bool test(const Block &b, uint64_t fp) const {
+        std::pair<uint64_t, uint64_t> h = probeHashes(fp);
+        for(size_t i = 0; i < probes_; i++) {
+            size_t pos = probePosition(h, i);
+            if(((b.words[pos >> 6u] >> (pos & 63u)) & 1u) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    void set(Block &b, uint64_t fp) {
+        std::pair<uint64_t, uint64_t> h = probeHashes(fp);
+        for(size_t i = 0; i < probes_; i++) {
+            size_t pos = probePosition(h, i);
+            __atomic_fetch_or(&b.words[pos >> 6u], uint64_t(1) << (pos & 63u), __ATOMIC_RELAXED);
+        }
+    }
+
+//    False positive rate of a blocked filter with load keys per block on average. Keys per block follow a Poisson
+//    distribution, and overfull blocks dominate the rate, so it is higher than for a classic filter of the same size.
+    static double blockedFalsePositiveRate(double load, size_t probes) {
+        double res = 0;
+        size_t last = size_t(load + 10 * std::sqrt(load) + 20);
+        for(size_t j = 0; j <= last; j++) {
+            double weight = std::exp(-load + j * std::log(load) - std::lgamma(j + 1.0));
+            double filled = 1 - std::pow(1 - 1.0 / block_bits, double(probes * j));
+            res += weight * std::pow(filled, double(probes));
+        }
+        return res;
+    }
+
+//    Finds the smallest number of bits per key (in steps of 1/4) and the number of probes for it that reach the target
+//    false positive rate of the parameters.
+    static std::pair<size_t, size_t> optimalSize(const bloom_parameters &p) {
+        const size_t max_probes = 16;
+        const double keys = std::max<double>(double(p.projected_element_count), 1.0);
+        double bits_per_key = 4;
+        size_t probes = max_probes;
+        for(; bits_per_key < 64; bits_per_key += 0.25) {
+            double best = 1;
+            for(size_t k = 1; k <= max_probes; k++) {
+                double rate = blockedFalsePositiveRate(block_bits / bits_per_key, k);
+                if(rate < best) {
+                    best = rate;
+                    probes = k;
+                }
+            }
+            if(best <= p.false_positive_probability)
+                break;
+        }
+        size_t count = std::max<size_t>(size_t(std::ceil(keys * bits_per_key / block_bits)), 1);
+        return {count, probes};
+    }
+
+public:
+//    Size and number of probes are derived from the projected element count and the target false positive rate for
+//    the blocked layout. The optimal parameters computed for the classic filter are not used.
+    explicit BlockedBloomFilter(const bloom_parameters &p) {
+        std::tie(block_count_, probes_) = optimalSize(p);
+        void *memory = nullptr;
+        VERIFY_MSG(posix_memalign(&memory, alignof(Block), block_count_ * sizeof(Block)) == 0,
+                   "Failed to allocate " << block_count_ * sizeof(Block) << " bytes for bloom filter");
+        std::memset(memory, 0, block_count_ * sizeof(Block));
+        blocks_.reset(static_cast<Block *>(memory));
+    }
+
+    template<class T>
+    void insert(const T &key) {
+        uint64_t fp = fingerprint(key);
+        set(block(fp), fp);
+    }
+
+//    Inserts n keys. Blocks are prefetched a few keys ahead of the writes.
+    template<class T>
+    void insert(const T *keys, size_t n) {
+        const size_t ahead = 8;
+        uint64_t fps[ahead];
+        for(size_t i = 0; i < n + ahead; i++) {
+            if(i >= ahead)
+                set(block(fps[i % ahead]), fps[i % ahead]);
+            if(i < n) {
+                fps[i % ahead] = fingerprint(keys[i]);
+                __builtin_prefetch(&block(fps[i % ahead]), 1);
+            }
+        }
+    }
+
+    template<class T>
+    bool contains(const T &key) const {
+        uint64_t fp = fingerprint(key);
+        return test(block(fp), fp);
+    }
+
+//    Looks up at most max_batch keys at once. All blocks are prefetched before the first probe so that their cache
+//    misses overlap. Bit i of the result is set if keys[i] may be in the filter.
+    template<class T>
+    uint32_t containsBatch(const T *keys, size_t n) const {
+        VERIFY(n <= max_batch);
+        uint64_t fps[max_batch];
+        for(size_t i = 0; i < n; i++) {
+            fps[i] = fingerprint(keys[i]);
+            __builtin_prefetch(&block(fps[i]));
+        }
+        uint32_t res = 0;
+        for(size_t i = 0; i < n; i++) {
+            if(test(block(fps[i]), fps[i]))
+                res |= uint32_t(1) << i;
+        }
+        return res;
+    }
+
+    std::pair<size_t, size_t> count_bits() const {
+        size_t res = 0;
+        for(size_t i = 0; i < block_count_; i++) {
+            for(uint64_t word : blocks_[i].words)
+                res += __builtin_popcountll(word);
+        }
+        return {res, block_count_ * block_bits};
+    }
+};
@@ -0,0 +1,391 @@
+#pragma once
+#include "verify.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Open addressing hash map with stable value addresses. Values live in fixed size blocks in insertion order and the
+//index is a flat table of 64-bit slots holding a hash tag and a value number, so most misses never touch the values.
+//Lookups are lock free. Emplace is lock free and can run concurrently with lookups and other emplaces as long as
+//enough space was reserved in advance; otherwise the map grows and emplace must not be called concurrently.
+//Erase and growth are not thread safe. Insertions reuse tombstones of erased keys in the index and the holes erased
+//values leave in the blocks, so values are in insertion order only until the first erase. compact() releases blocks
+//that hold no values and clears tombstones after a bulk removal.
+template<class K, class V, class Hash>
+class ConcurrentHashMap {
+public:
+    typedef std::pair<const K, V> value_type;
+private:
+    static const size_t block_size = 1u << 12u;
+//    Slot layout: 24 bits of hash tag followed by 40 bits of value number plus one. Zero is an empty slot.
+    static const size_t index_bits = 40;
+    static const uint64_t index_mask = (uint64_t(1) << index_bits) - 1;
+    static const uint64_t tombstone = uint64_t(-1);
+
+    struct Block {
+        typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type values[block_size];
+        bool alive[block_size] = {};
+    };
+
+    Hash hasher;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::unique_ptr<std::atomic<uint64_t>[]> index;
+    size_t capacity = 0;
+    size_t shift = 64;
+    std::atomic<size_t> used{0};
+    std::atomic<size_t> live{0};
+//    Number of index slots that are not empty, including tombstones
+    std::atomic<size_t> occupied{0};
+//    Numbers of erased values to be reused. Insertions take them from the back of the first free_holes elements.
+    std::vector<size_t> holes;
+    std::atomic<size_t> free_holes{0};
+
+    uint64_t mix(const K &key) const {
+        return uint64_t(hasher(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    size_t home(uint64_t h) const {
+        return capacity == 0 ? 0 : h >> shift;
+    }
+
+    static uint64_t tag(uint64_t h) {
+        return h << index_bits;
+    }
+
+    static uint64_t record(uint64_t h, size_t num) {
+        return tag(h) | (uint64_t(num) + 1);
+    }
+
+    static size_t number(uint64_t slot) {
+        return (slot & index_mask) - 1;
+    }
+
+    bool matches(uint64_t slot, uint64_t h, const K &key) const {
+        return slot != tombstone && (slot & ~index_mask) == tag(h) && valueAt(number(slot)).first == key;
+    }
+
+    value_type &valueAt(size_t num) const {
+        return *reinterpret_cast<value_type *>(&blocks[num / block_size]->values[num % block_size]);
+    }
+
+    bool isAlive(size_t num) const {
+        const std::unique_ptr<Block> &block = blocks[num / block_size];
+        return block != nullptr && block->alive[num % block_size];
+    }
+
+    void setAlive(size_t num, bool val) {
+        blocks[num / block_size]->alive[num % block_size] = val;
+    }
+
+    size_t findSlot(const K &key, uint64_t h) const {
+        if(capacity == 0)
+            return size_t(-1);
+        for(size_t pos = home(h);; pos = (pos + 1) & (capacity - 1)) {
+            uint64_t cur = index[pos].load(std::memory_order_acquire);
+            if(cur == 0)
+                return size_t(-1);
+            if(matches(cur, h, key))
+                return pos;
+        }
+    }
+
+    //Takes the number of a hole or a new value number. Returns size_t(-1) if there is no reserved space for a new value.
+    size_t takeNumber() {
+        size_t h = free_holes.load();
+        while(h > 0 && !free_holes.compare_exchange_weak(h, h - 1));
+        if(h > 0)
+            return holes[h - 1];
+        size_t num = used.fetch_add(1);
+        if(num < blocks.size() * block_size)
+            return num;
+        used--;
+        return size_t(-1);
+    }
+
+    void rebuildIndex(size_t new_capacity) {
+        capacity = new_capacity;
+        shift = 64;
+        while((size_t(1) << (64 - shift)) < capacity)
+            shift--;
+        index.reset(new std::atomic<uint64_t>[capacity]);
+        for(size_t i = 0; i < capacity; i++)
+            index[i].store(0, std::memory_order_relaxed);
+        for(size_t num = 0; num < used; num++) {
+            if(!isAlive(num))
+                continue;
+            uint64_t h = mix(valueAt(num).first);
+            size_t pos = home(h);
+            while(index[pos].load(std::memory_order_relaxed) != 0)
+                pos = (pos + 1) & (capacity - 1);
+            index[pos].store(record(h, num), std::memory_order_relaxed);
+        }
+        occupied = live.load();
+    }
+
+    //Makes sure that extra values can be added without any reallocation. Holes are not counted for values that have
+    //to get new numbers.
+    void ensureSpace(size_t extra, bool use_holes = true) {
+        size_t reused = use_holes ? std::min<size_t>(extra, free_holes) : 0;
+        size_t need = used + extra - reused;
+        while(blocks.size() * block_size < need)
+            blocks.emplace_back(new Block());
+//        Rebuilding the index drops tombstones, so it only has to grow for the values that are alive
+        if((occupied + extra) * 2 > capacity) {
+            size_t new_capacity = std::max<size_t>(capacity, 16);
+            while((live + extra) * 2 > new_capacity)
+                new_capacity *= 2;
+            rebuildIndex(new_capacity);
+        }
+    }
+
+public:
+    template<bool is_const>
+    class Iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename std::conditional<is_const, const typename ConcurrentHashMap::value_type,
+                typename ConcurrentHashMap::value_type>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type *pointer;
+        typedef value_type &reference;
+    private:
+        friend class ConcurrentHashMap;
+        typedef typename std::conditional<is_const, const ConcurrentHashMap, ConcurrentHashMap>::type map_type;
+        map_type *map;
+        size_t num;
+
+        void seek() {
+            while(num < map->used && !map->isAlive(num)) {
+                if(map->blocks[num / block_size] == nullptr)
+                    num = (num / block_size + 1) * block_size;
+                else
+                    num++;
+            }
+            num = std::min<size_t>(num, map->used);
+        }
+    public:
+        Iterator(map_type *map, size_t num) : map(map), num(num) {
+            seek();
+        }
+
+        reference operator*() const {return map->valueAt(num);}
+        pointer operator->() const {return &map->valueAt(num);}
+
+        Iterator &operator++() {
+            num++;
+            seek();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator res = *this;
+            ++*this;
+            return res;
+        }
+
+        bool operator==(const Iterator &other) const {return num == other.num;}
+        bool operator!=(const Iterator &other) const {return num != other.num;}
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    ConcurrentHashMap() = default;
+    ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+    ConcurrentHashMap &operator=(const ConcurrentHashMap &) = delete;
+
+    ConcurrentHashMap(ConcurrentHashMap &&other) noexcept : hasher(other.hasher), blocks(std::move(other.blocks)),
+            index(std::move(other.index)), capacity(other.capacity), shift(other.shift), used(other.used.load()),
+            live(other.live.load()), occupied(other.occupied.load()), holes(std::move(other.holes)),
+            free_holes(other.free_holes.load()) {
+        other.capacity = 0;
+        other.used = 0;
+        other.live = 0;
+        other.occupied = 0;
+        other.free_holes = 0;
+    }
+
+    ConcurrentHashMap &operator=(ConcurrentHashMap &&other) noexcept {
+        clear();
+        hasher = other.hasher;
+        blocks = std::move(other.blocks);
+        index = std::move(other.index);
+        capacity = other.capacity;
+        shift = other.shift;
+        used = other.used.load();
+        live = other.live.load();
+        occupied = other.occupied.load();
+        holes = std::move(other.holes);
+        free_holes = other.free_holes.load();
+        other.capacity = 0;
+        other.used = 0;
+        other.live = 0;
+        other.occupied = 0;
+        other.free_holes = 0;
+        return *this;
+    }
+
+    ~ConcurrentHashMap() {
+        clear();
+    }
+
+    size_t size() const {return live;}
+    bool empty() const {return live == 0;}
+
+    void reserve(size_t n) {
+        ensureSpace(n > live ? n - live : 0);
+    }
+
+    void clear() {
+        for(size_t num = 0; num < used; num++) {
+            if(isAlive(num)) {
+                valueAt(num).~value_type();
+                setAlive(num, false);
+            }
+        }
+        blocks.clear();
+        index.reset();
+        capacity = 0;
+        shift = 64;
+        used = 0;
+        live = 0;
+        occupied = 0;
+        holes.clear();
+        free_holes = 0;
+    }
+
+    iterator begin() {return {this, 0};}
+    iterator end() {return {this, used};}
+    const_iterator begin() const {return {this, 0};}
+    const_iterator end() const {return {this, used};}
+
+    iterator find(const K &key) {
+        size_t pos = findSlot(key, mix(key));
+        return pos == size_t(-1) ? end() : iterator(this, number(index[pos].load(std::memory_order_acquire)));
+    }
+
+    const_iterator find(const K &key) const {
+        size_t pos = findSlot(key, mix(key));
+        return pos == size_t(-1) ? end() : const_iterator(this, number(index[pos].load(std::memory_order_acquire)));
+    }
+
+    bool contains(const K &key) const {
+        return findSlot(key, mix(key)) != size_t(-1);
+    }
+
+    //Constructs value from args if the key is not present. The value is published only after it is fully constructed.
+    template<class... Args>
+    std::pair<iterator, bool> emplace(const K &key, Args&&... args) {
+        uint64_t h = mix(key);
+        size_t found = findSlot(key, h);
+        if(found != size_t(-1))
+            return {iterator(this, number(index[found].load(std::memory_order_acquire))), false};
+        if((used + 1 > blocks.size() * block_size && free_holes == 0) || (occupied + 1) * 2 > capacity)
+            ensureSpace(1);
+        size_t num = takeNumber();
+        size_t occ = occupied.fetch_add(1);
+        VERIFY_MSG(num != size_t(-1) && (occ + 1) * 2 <= capacity && num + 2 < index_mask,
+                   "Concurrent insertion into ConcurrentHashMap without reserved space");
+        new (&valueAt(num)) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                                       std::forward_as_tuple(std::forward<Args>(args)...));
+        setAlive(num, true);
+        uint64_t rec = record(h, num);
+//        Key is inserted into the first empty slot or tombstone of its chain. Slots only change once while insertions
+//        run, so two threads inserting the same key meet at the same slot and the one that loses the race sees the key.
+        for(size_t pos = home(h);; pos = (pos + 1) & (capacity - 1)) {
+            uint64_t cur = index[pos].load(std::memory_order_acquire);
+            if(cur == 0 || cur == tombstone) {
+                uint64_t prev = cur;
+                if(index[pos].compare_exchange_strong(cur, rec, std::memory_order_acq_rel)) {
+                    if(prev == tombstone)
+                        occupied--;
+                    break;
+                }
+            }
+            if(matches(cur, h, key)) {
+//                Lost the race to another thread inserting the same key. The value slot stays as a hole until compact().
+                occupied--;
+                valueAt(num).~value_type();
+                setAlive(num, false);
+                return {iterator(this, number(cur)), false};
+            }
+        }
+        live++;
+        return {iterator(this, num), true};
+    }
+
+    //Adds values constructed from keys in parallel. Keys must be distinct and absent from the map. Values are numbered
+    //in the order of keys, so iteration order does not depend on thread scheduling.
+    void emplaceDistinct(const std::vector<K> &keys, size_t threads) {
+        ensureSpace(keys.size(), false);
+        size_t base = used;
+        used += keys.size();
+        omp_set_num_threads(threads);
+#pragma omp parallel for default(none) shared(keys, base)
+        for(size_t i = 0; i < keys.size(); i++) {
+            new (&valueAt(base + i)) value_type(std::piecewise_construct, std::forward_as_tuple(keys[i]),
+                                                std::forward_as_tuple(keys[i]));
+            setAlive(base + i, true);
+            uint64_t h = mix(keys[i]);
+            uint64_t rec = record(h, base + i);
+            for(size_t pos = home(h);; pos = (pos + 1) & (capacity - 1)) {
+                uint64_t cur = index[pos].load(std::memory_order_acquire);
+                if((cur == 0 || cur == tombstone) && index[pos].compare_exchange_strong(cur, rec, std::memory_order_acq_rel)) {
+                    if(cur == 0)
+                        occupied++;
+                    break;
+                }
+                VERIFY(!matches(cur, h, keys[i]));
+            }
+        }
+        live += keys.size();
+    }
+
+    iterator erase(iterator it) {
+        size_t num = it.num;
+        size_t pos = findSlot(it->first, mix(it->first));
+        VERIFY(pos != size_t(-1));
+        index[pos].store(tombstone, std::memory_order_release);
+        valueAt(num).~value_type();
+        setAlive(num, false);
+        live--;
+        holes.resize(free_holes);
+        holes.emplace_back(num);
+        free_holes = holes.size();
+        return {this, num + 1};
+    }
+
+    //Releases blocks without values and clears tombstones from the index. Values keep their addresses, holes left in
+    //the other blocks are reused by later insertions, lowest numbers first. Not thread safe.
+    void compact() {
+        while(used > 0 && !isAlive(used - 1))
+            used--;
+        blocks.resize((used + block_size - 1) / block_size);
+        holes.clear();
+        for(size_t b = blocks.size(); b > 0; b--) {
+            std::unique_ptr<Block> &block = blocks[b - 1];
+            if(block == nullptr)
+                continue;
+            size_t from = (b - 1) * block_size;
+            size_t to = std::min<size_t>(b * block_size, used);
+            if(std::none_of(block->alive, block->alive + (to - from), [](bool val) {return val;})) {
+                block.reset();
+                continue;
+            }
+            for(size_t num = to; num > from; num--) {
+                if(!block->alive[num - 1 - from])
+                    holes.emplace_back(num - 1);
+            }
+        }
+        free_holes = holes.size();
+        if(occupied > live)
+            rebuildIndex(capacity);
+    }
+};
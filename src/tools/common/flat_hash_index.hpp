@@ -0,0 +1,176 @@
+#pragma once
+#include "verify.hpp"
+#include <parallel/algorithm>
+#include <omp.h>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//Immutable hash index stored in flat arrays. Records are sorted by mixed key hash so that the top bits of the hash
+//select a short range of records through a bucket directory. Keys and values are kept in separate arrays and there
+//are no per-record allocations. The index is built in parallel from a batch of records; adding more records rebuilds
+//it. Small batches can be inserted without a rebuild: they go to a sorted overflow array that is folded into the main
+//arrays once it grows past a fraction of them. Single records can be updated or erased in place. Lookups are lock free
+//and can run concurrently.
+template<class K, class V, class Hash>
+class FlatHashIndex {
+public:
+    static const size_t none = size_t(-1);
+private:
+    Hash hasher;
+    std::vector<K> keys;
+    std::vector<V> values;
+    std::vector<uint32_t> directory;
+    size_t shift = 64;
+//    Overflow records sorted by mixed hash and key. Their indices follow the ones of the main arrays.
+    std::vector<std::pair<K, V>> overflow;
+
+    uint64_t mix(const K &key) const {
+        return uint64_t(hasher(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    size_t bucket(const K &key) const {
+        return shift == 64 ? 0 : mix(key) >> shift;
+    }
+
+    bool less(const K &a, const K &b) const {
+        uint64_t ma = mix(a);
+        uint64_t mb = mix(b);
+        return ma < mb || (ma == mb && a < b);
+    }
+
+    typename std::vector<std::pair<K, V>>::const_iterator findOverflow(const K &key) const {
+        auto it = std::lower_bound(overflow.begin(), overflow.end(), key,
+                                   [this](const std::pair<K, V> &a, const K &b) {return less(a.first, b);});
+        return it != overflow.end() && it->first == key ? it : overflow.end();
+    }
+
+    void sortRecords(std::vector<std::pair<K, V>> &records, size_t threads) const {
+        const FlatHashIndex &self = *this;
+        auto compare = [&self](const std::pair<K, V> &a, const std::pair<K, V> &b) {
+            return self.less(a.first, b.first);
+        };
+        omp_set_num_threads(threads);
+        __gnu_parallel::stable_sort(records.begin(), records.end(), compare);
+        records.erase(std::unique(records.begin(), records.end(),
+                                  [](const std::pair<K, V> &a, const std::pair<K, V> &b) {return a.first == b.first;}),
+                      records.end());
+    }
+
+public:
+    FlatHashIndex() = default;
+    FlatHashIndex(FlatHashIndex &&other) = default;
+    FlatHashIndex &operator=(FlatHashIndex &&other) = default;
+    FlatHashIndex(const FlatHashIndex &other) = delete;
+
+//    Erased records of the main arrays keep their slots with a default value until the next add.
+    size_t size() const {return keys.size() + overflow.size();}
+    bool empty() const {return keys.empty() && overflow.empty();}
+    const K &key(size_t i) const {return i < keys.size() ? keys[i] : overflow[i - keys.size()].first;}
+    const V &value(size_t i) const {return i < values.size() ? values[i] : overflow[i - keys.size()].second;}
+
+    size_t find(const K &key) const {
+        if(!keys.empty()) {
+            size_t b = bucket(key);
+            for(size_t i = directory[b]; i < directory[b + 1]; i++) {
+                if(keys[i] == key)
+                    return i;
+            }
+        }
+        if(overflow.empty())
+            return none;
+        auto it = findOverflow(key);
+        return it == overflow.end() ? none : keys.size() + (it - overflow.begin());
+    }
+
+    bool contains(const K &key) const {return find(key) != none;}
+
+    //Adds records to the index. Records already in the index take precedence over new records with the same key,
+    //and among new records the first one wins.
+    void add(std::vector<std::pair<K, V>> records, size_t threads) {
+        std::vector<std::pair<K, V>> old;
+        old.reserve(size());
+        for(size_t i = 0; i < keys.size(); i++) {
+            if(find(keys[i]) == i)
+                old.emplace_back(keys[i], values[i]);
+        }
+        old.insert(old.end(), overflow.begin(), overflow.end());
+        overflow = {};
+        records.insert(records.begin(), old.begin(), old.end());
+        old = {};
+        VERIFY(records.size() < size_t(uint32_t(-1)));
+        sortRecords(records, threads);
+        shift = 64;
+        while((size_t(1) << (64 - shift)) < records.size())
+            shift--;
+        size_t buckets = size_t(1) << (64 - shift);
+        keys.resize(records.size());
+        values.resize(records.size());
+        directory.assign(buckets + 1, 0);
+//        Each record fills the directory entries of the empty buckets that precede it, so writes never overlap.
+#pragma omp parallel for default(none) shared(records, buckets)
+        for(size_t i = 0; i < records.size(); i++) {
+            keys[i] = records[i].first;
+            values[i] = records[i].second;
+            size_t from = i == 0 ? 0 : bucket(records[i - 1].first) + 1;
+            size_t to = bucket(records[i].first);
+            for(size_t b = from; b <= to; b++)
+                directory[b] = i;
+        }
+        size_t from = records.empty() ? 0 : bucket(records.back().first) + 1;
+        for(size_t b = from; b <= buckets; b++)
+            directory[b] = records.size();
+    }
+
+    //Inserts records without rebuilding the main arrays. The cost is proportional to the size of the batch and of the
+    //overflow array, and the index is rebuilt only when the overflow grows past an eighth of it. Precedence of records
+    //with equal keys is the same as in add.
+    void insert(std::vector<std::pair<K, V>> records, size_t threads) {
+        sortRecords(records, threads);
+        records.erase(std::remove_if(records.begin(), records.end(),
+                                     [this](const std::pair<K, V> &rec) {return find(rec.first) != none;}),
+                      records.end());
+        if(overflow.size() + records.size() > keys.size() / 8) {
+            add(std::move(records), threads);
+            return;
+        }
+        std::vector<std::pair<K, V>> merged;
+        merged.reserve(overflow.size() + records.size());
+        std::merge(overflow.begin(), overflow.end(), records.begin(), records.end(), std::back_inserter(merged),
+                   [this](const std::pair<K, V> &a, const std::pair<K, V> &b) {return less(a.first, b.first);});
+        overflow = std::move(merged);
+    }
+
+    void set(size_t i, const V &value) {
+        if(i < values.size())
+            values[i] = value;
+        else
+            overflow[i - keys.size()].second = value;
+    }
+
+    //Moves the record to the end of its bucket and shrinks the bucket. The slot becomes the first one of the next
+    //bucket, where it never matches a lookup since its key belongs to another bucket. Overflow records are removed, so
+    //indices of the overflow records that follow change.
+    void erase(size_t i) {
+        if(i >= keys.size()) {
+            overflow.erase(overflow.begin() + (i - keys.size()));
+            return;
+        }
+        size_t b = bucket(keys[i]);
+        size_t last = directory[b + 1] - 1;
+        std::swap(keys[i], keys[last]);
+        std::swap(values[i], values[last]);
+        values[last] = V();
+        directory[b + 1] = last;
+    }
+
+    void clear() {
+        keys = {};
+        values = {};
+        directory = {};
+        overflow = {};
+        shift = 64;
+    }
+};
@@ -1,9 +1,16 @@
 #pragma once
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
 namespace hashing {
+    //LJA_HASH64 switches k-mer hashes to 64 bits. This halves the memory of vertex and anchor tables
+    //but makes collisions possible on large genomes, so vertex sequences are verified on insertion.
+#ifdef LJA_HASH64
+    typedef uint64_t htype;
+#else
     typedef unsigned __int128 htype;
+#endif
 
     template<class Key>
     struct alt_hasher {
@@ -11,14 +18,21 @@ namespace hashing {
     };
 
     template<>
-    struct alt_hasher<htype> {
-        size_t operator()(const htype &x) const {
+    struct alt_hasher<unsigned __int128> {
+        size_t operator()(const unsigned __int128 &x) const {
             return (size_t(x) * 31) ^ size_t(x >> 64u);
         }
     };
+
+    template<>
+    struct alt_hasher<uint64_t> {
+        size_t operator()(const uint64_t &x) const {
+            return size_t(x) ^ size_t(x >> 29u);
+        }
+    };
 }
 
-inline std::ostream &operator<<(std::ostream &os, hashing::htype val) {
+inline std::ostream &operator<<(std::ostream &os, unsigned __int128 val) {
     std::vector<size_t> res;
     while (val != 0) {
         res.push_back(val % 10);
@@ -30,7 +44,7 @@ inline std::ostream &operator<<(std::ostream &os, hashing::htype val) {
     return os;
 }
 
-inline std::istream &operator>>(std::istream &is, hashing::htype &val) {
+inline std::istream &operator>>(std::istream &is, unsigned __int128 &val) {
     val = 0;
     std::string tmp;
     is >> tmp;
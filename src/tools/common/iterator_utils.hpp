@@ -2,6 +2,7 @@
 
 #include "verify.hpp"
 #include <functional>
+#include <array>
 
 template<class Iterator>
 class SkippingIterator {
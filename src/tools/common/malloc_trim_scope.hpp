@@ -0,0 +1,26 @@
+#pragma once
+#include <malloc.h>
+
+//Trims the heap when a pipeline stage that runs in the calling process finishes. Memory freed by glibc stays in its
+//malloc arenas, one of which is created for every OpenMP thread, and release() hands the free pages of all arenas back
+//to the OS with malloc_trim. This is not an allocator: pages still holding live objects stay, so fragmentation left by
+//a stage survives it. Graph and read path sequences live in NuclArena chunks that are freed in bulk with their owner,
+//so they do not fragment the heap as long as the owner is destroyed inside the scope.
+class MallocTrimScope {
+public:
+    MallocTrimScope() = default;
+    MallocTrimScope(const MallocTrimScope &) = delete;
+    MallocTrimScope &operator=(const MallocTrimScope &) = delete;
+    ~MallocTrimScope() {release();}
+
+    void release() {
+        malloc_trim(0);
+    }
+};
+
+//Stages isolated with runIsolated run in forked children by default. When this is switched off they run in the calling
+//process inside a MallocTrimScope and may hand their results over in memory.
+inline bool &forkIsolation() {
+    static bool enabled = true;
+    return enabled;
+}
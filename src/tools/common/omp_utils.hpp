@@ -3,6 +3,8 @@
 //
 #pragma once
 #include "logging.hpp"
+#include "malloc_trim_scope.hpp"
+#include "radix_sort.hpp"
 #include <parallel/algorithm>
 #include <omp.h>
 #include <utility>
@@ -33,9 +35,29 @@ public:
 
 typedef UniversalParallelCounter<size_t> ParallelCounter;
 
+//Collects records added from different threads into per thread rows. In unique mode every thread sorts and
+//deduplicates its own row whenever the row doubles since its last compaction, so rows stay close to the number of
+//distinct records seen by the thread. Unique mode only compacts records with a RadixKey.
 template<class T>
 class ParallelRecordCollector {
+    static const size_t min_compaction = size_t(1) << 16u;
     std::vector<std::vector<T>> recs;
+    std::vector<size_t> compacted;
+    bool unique;
+
+    void compact(size_t row, std::true_type) {
+        if(unique && recs[row].size() >= std::max(compacted[row] * 2, min_compaction)) {
+            sortUnique(recs[row]);
+            compacted[row] = recs[row].size();
+        }
+    }
+
+    void compact(size_t row, std::false_type) {
+    }
+
+    void compact(size_t row) {
+        compact(row, std::integral_constant<bool, RadixKey<T>::enabled>());
+    }
 public:
     friend class Iterator;
     class Iterator : public std::iterator<std::forward_iterator_tag, T, size_t,  T*, T&>{
@@ -71,21 +93,25 @@ public:
         }
 
     };
-    explicit ParallelRecordCollector(size_t thread_num) : recs(thread_num){
+    explicit ParallelRecordCollector(size_t thread_num, bool _unique = false) :
+            recs(thread_num), compacted(thread_num), unique(_unique) {
     }
 
     void add(const T &rec) {
         recs[omp_get_thread_num()].emplace_back(rec);
+        compact(omp_get_thread_num());
     }
 
     template<class I>
     void addAll(I begin, I end) {
         recs[omp_get_thread_num()].insert(recs[omp_get_thread_num()].end(), begin, end);
+        compact(omp_get_thread_num());
     }
 
     template< class... Args >
     void emplace_back( Args&&... args ) {
         recs[omp_get_thread_num()].emplace_back(args...);
+        compact(omp_get_thread_num());
     }
 
     Iterator begin() {
@@ -110,11 +136,12 @@ public:
 
     std::vector<T> collect() {
         std::vector<T> res;
+        res.reserve(size());
         for(std::vector<T> &row : recs) {
-            for(T &val : row)
-                res.emplace_back(std::move(val));
-            row.clear();
+            res.insert(res.end(), std::make_move_iterator(row.begin()), std::make_move_iterator(row.end()));
+            row = std::vector<T>();
         }
+        std::fill(compacted.begin(), compacted.end(), 0);
         return std::move(res);
     }
 
@@ -122,12 +149,59 @@ public:
         for(std::vector<T> &row : recs) {
             row.clear();
         }
+        std::fill(compacted.begin(), compacted.end(), 0);
     }
 
+//    Rows are sorted and deduplicated in parallel. Then the value range is cut by splitters taken from the largest
+//    row, and every part gathers its pieces of all rows directly into its slot of the result, where they are sorted
+//    and deduplicated again. Parts are finally moved together. Peak memory is the rows plus one result of their size.
     std::vector<T> collectUnique() {
-        std::vector<T> res = collect();
-        __gnu_parallel::sort(res.begin(), res.end());
-        res.erase(std::unique(res.begin(), res.end()), res.end());
+        std::vector<std::vector<T>> &rows = recs;
+        size_t threads = rows.size();
+#pragma omp parallel for default(none) schedule(dynamic, 1) shared(rows) num_threads(threads)
+        for(size_t i = 0; i < rows.size(); i++)
+            sortUnique(rows[i]);
+        size_t largest = 0;
+        for(size_t i = 0; i < rows.size(); i++) {
+            if(rows[i].size() > rows[largest].size())
+                largest = i;
+        }
+        std::vector<T> splitters;
+        size_t parts = threads * 8;
+        for(size_t p = 1; p < parts && !rows[largest].empty(); p++)
+            splitters.emplace_back(rows[largest][rows[largest].size() * p / parts]);
+        splitters.erase(std::unique(splitters.begin(), splitters.end()), splitters.end());
+        parts = splitters.size() + 1;
+        std::vector<std::vector<size_t>> bounds(rows.size(), std::vector<size_t>(parts + 1));
+        for(size_t r = 0; r < rows.size(); r++) {
+            for(size_t p = 1; p < parts; p++)
+                bounds[r][p] = std::lower_bound(rows[r].begin(), rows[r].end(), splitters[p - 1]) - rows[r].begin();
+            bounds[r][parts] = rows[r].size();
+        }
+        std::vector<size_t> offsets(parts + 1);
+        for(size_t p = 0; p < parts; p++) {
+            offsets[p + 1] = offsets[p];
+            for(size_t r = 0; r < rows.size(); r++)
+                offsets[p + 1] += bounds[r][p + 1] - bounds[r][p];
+        }
+        std::vector<T> res(offsets[parts]);
+        std::vector<size_t> sizes(parts);
+#pragma omp parallel for default(none) schedule(dynamic, 1) shared(rows, bounds, offsets, res, sizes, parts) num_threads(threads)
+        for(size_t p = 0; p < parts; p++) {
+            auto out = res.begin() + offsets[p];
+            for(size_t r = 0; r < rows.size(); r++)
+                out = std::move(rows[r].begin() + bounds[r][p], rows[r].begin() + bounds[r][p + 1], out);
+            sizes[p] = sortUnique(res.begin() + offsets[p], out) - (res.begin() + offsets[p]);
+        }
+        for(std::vector<T> &row : rows)
+            row = std::vector<T>();
+        std::fill(compacted.begin(), compacted.end(), 0);
+        size_t cur = 0;
+        for(size_t p = 0; p < parts; p++) {
+            std::move(res.begin() + offsets[p], res.begin() + offsets[p] + sizes[p], res.begin() + cur);
+            cur += sizes[p];
+        }
+        res.resize(cur);
         return std::move(res);
     }
 };
@@ -309,3 +383,14 @@ inline void runInFork(const std::function<void()>& f) {
         }
     }
 }
+
+//Runs a pipeline stage in a forked child or, if fork isolation is switched off, in the calling process inside a
+//MallocTrimScope. Results that the task stores outside of itself are only visible to the caller in the second case.
+inline void runIsolated(const std::function<void()>& f) {
+    if(forkIsolation()) {
+        runInFork(f);
+    } else {
+        MallocTrimScope scope;
+        f();
+    }
+}
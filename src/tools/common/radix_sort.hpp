@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Stable LSD radix sort of records by bytes [from_byte, to_byte) of an unsigned integer key, least significant first.
+//Bytes that are known to be equal for all records can be left out of the range. Uses one buffer of the input size
+//and skips passes where all records fall into the same bucket.
+template<class T, class Key>
+void radixSort(std::vector<T> &records, const Key &key, size_t from_byte, size_t to_byte) {
+    if(records.size() < 2)
+        return;
+    std::vector<T> buffer;
+    for(size_t byte = from_byte; byte < to_byte; byte++) {
+        size_t shift = byte * 8;
+        size_t count[257] = {};
+        for(const T &record : records)
+            count[(size_t(key(record) >> shift) & 0xffu) + 1]++;
+        if(count[(size_t(key(records.front()) >> shift) & 0xffu) + 1] == records.size())
+            continue;
+        for(size_t i = 1; i < 257; i++)
+            count[i] += count[i - 1];
+        buffer.resize(records.size());
+        for(T &record : records)
+            buffer[count[size_t(key(record) >> shift) & 0xffu]++] = std::move(record);
+        std::swap(records, buffer);
+    }
+}
+
+//Unsigned integer view of values that can be radix sorted. The order of keys must agree with std::less of values.
+template<class T, class Enable = void>
+struct RadixKey {
+    static const bool enabled = false;
+};
+
+template<class T>
+struct RadixKey<T, typename std::enable_if<std::is_unsigned<T>::value>::type> {
+    static const bool enabled = true;
+    static T get(const T &value) {return value;}
+};
+
+template<>
+struct RadixKey<unsigned __int128> {
+    static const bool enabled = true;
+    static unsigned __int128 get(const unsigned __int128 &value) {return value;}
+};
+
+template<class T>
+struct RadixKey<T *> {
+    static const bool enabled = true;
+    static uintptr_t get(T *const &value) {return reinterpret_cast<uintptr_t>(value);}
+};
+
+//In place MSD radix sort (American flag sort) of values with a RadixKey, starting from the given key byte. Bytes that
+//are equal for the whole range cost one counting pass and no moves. Small ranges are finished with std::sort.
+template<class Iterator>
+void inplaceRadixSort(Iterator begin, Iterator end, size_t byte) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    size_t n = end - begin;
+    if(n < 64) {
+        std::sort(begin, end, std::less<T>());
+        return;
+    }
+    size_t shift = byte * 8;
+    auto digit = [shift](const T &value) {return size_t(RadixKey<T>::get(value) >> shift) & 0xffu;};
+    size_t count[256] = {};
+    for(Iterator it = begin; it != end; ++it)
+        count[digit(*it)]++;
+    if(count[digit(*begin)] < n) {
+        size_t next[256];
+        size_t bucket_end[256];
+        size_t sum = 0;
+        for(size_t b = 0; b < 256; b++) {
+            next[b] = sum;
+            sum += count[b];
+            bucket_end[b] = sum;
+        }
+        for(size_t b = 0; b < 256; b++) {
+            while(next[b] < bucket_end[b]) {
+                size_t d = digit(begin[next[b]]);
+                if(d == b)
+                    next[b]++;
+                else
+                    std::swap(begin[next[b]], begin[next[d]++]);
+            }
+        }
+    }
+    if(byte == 0)
+        return;
+    size_t from = 0;
+    for(size_t b = 0; b < 256; from += count[b], b++) {
+        if(count[b] > 1)
+            inplaceRadixSort(begin + from, begin + from + count[b], byte - 1);
+    }
+}
+
+template<class Iterator>
+void sortRange(Iterator begin, Iterator end, std::true_type) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    inplaceRadixSort(begin, end, sizeof(RadixKey<T>::get(std::declval<const T &>())) - 1);
+}
+
+template<class Iterator>
+void sortRange(Iterator begin, Iterator end, std::false_type) {
+    std::sort(begin, end);
+}
+
+//Sorts a range in place and moves unique values to its beginning. Returns the end of unique values. Uses
+//inplaceRadixSort for values with a RadixKey.
+template<class Iterator>
+Iterator sortUnique(Iterator begin, Iterator end) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    sortRange(begin, end, std::integral_constant<bool, RadixKey<T>::enabled>());
+    return std::unique(begin, end);
+}
+
+template<class T>
+void sortUnique(std::vector<T> &values) {
+    values.erase(sortUnique(values.begin(), values.end()), values.end());
+}
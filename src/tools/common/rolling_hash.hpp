@@ -19,57 +19,66 @@ namespace hashing {
             return tmp * tmp;
     }
 
-    class RollingHash {
+    template<class H>
+    class BasicKmerCursor;
+
+    //Polynomial rolling hash of k-mers modulo 2^(8 * sizeof(H)). H is a 64 or 128 bit unsigned type, hbase must be odd.
+    template<class H>
+    class BasicRollingHash {
     private:
+        friend class BasicKmerCursor<H>;
         size_t k;
-        htype hbase;
-        htype kpow;
-        htype inv;
+        H hbase;
+        H kpow;
+        H inv;
     public:
-
-        RollingHash(size_t _k, htype _hbase) : k(_k), hbase(_hbase),
+        BasicRollingHash(size_t _k, H _hbase) : k(_k), hbase(_hbase),
                                                kpow(pow(hbase, k - 1)),
-                                               inv(pow(hbase, (htype(1u) << (sizeof(htype) * 8u - 1u)) - 1u)) {
-            VERIFY(inv * hbase == htype(1));
+                                               inv(pow(hbase, (H(1u) << (sizeof(H) * 8u - 1u)) - 1u)) {
+            VERIFY(H(inv * hbase) == H(1));
         }
 
         size_t getK() const {
             return k;
         }
 
-        RollingHash extensionHash() const {
-            return RollingHash(k + 1, hbase);
+        H getBase() const {
+            return hbase;
+        }
+
+        BasicRollingHash extensionHash() const {
+            return BasicRollingHash(k + 1, hbase);
         }
 
-        htype hash(const Sequence &seq, size_t pos) const {
-            htype hash = 0;
+        H hash(const Sequence &seq, size_t pos) const {
+            H hash = 0;
             for (size_t i = pos; i < pos + k; i++) {
                 hash = hash * hbase + seq[i];
             }
             return hash;
         }
 
-        htype extendRight(const Sequence &seq, size_t pos, htype hash, unsigned char c) const {
+        H extendRight(const Sequence &seq, size_t pos, H hash, unsigned char c) const {
             return hash * hbase + c;
         }
 
-        htype extendLeft(const Sequence &seq, size_t pos, htype hash, unsigned char c) const {
+        H extendLeft(const Sequence &seq, size_t pos, H hash, unsigned char c) const {
             return hash + c * kpow * hbase;
         }
 
-        htype shiftRight(const Sequence &seq, size_t pos, htype hash, unsigned char c) const {
+        H shiftRight(const Sequence &seq, size_t pos, H hash, unsigned char c) const {
             return (hash - kpow * seq[pos]) * hbase + c;
         }
 
-        htype shiftLeft(const Sequence &seq, size_t pos, htype hash, unsigned char c) const {
+        H shiftLeft(const Sequence &seq, size_t pos, H hash, unsigned char c) const {
             return (hash - seq[pos + k - 1]) * inv + c * kpow;
         }
 
-        htype next(const Sequence &seq, size_t pos, htype hash) const {
+        H next(const Sequence &seq, size_t pos, H hash) const {
             return shiftRight(seq, pos, hash, seq[pos + k]);
         }
 
-        htype prev(const Sequence &seq, size_t pos, htype hash) const {
+        H prev(const Sequence &seq, size_t pos, H hash) const {
             return shiftLeft(seq, pos, hash, seq[pos - 1]);
         }
 
@@ -82,62 +91,65 @@ namespace hashing {
         }
     };
 
-    class KWH {
+    template<class H>
+    class BasicKWH {
     private:
-        KWH(const RollingHash &_hasher, const Sequence &_seq, size_t _pos, htype _fhash, htype _rhash) :
+        friend class BasicKmerCursor<H>;
+
+        BasicKWH(const BasicRollingHash<H> &_hasher, const Sequence &_seq, size_t _pos, H _fhash, H _rhash) :
                 hasher(_hasher), seq(_seq), pos(_pos), fhash(_fhash), rhash(_rhash) {
         }
 
-        htype fhash;
-        htype rhash;
+        H fhash;
+        H rhash;
         Sequence seq;
     public:
-        const RollingHash &hasher;
+        const BasicRollingHash<H> &hasher;
         size_t pos;
 
-        KWH(const RollingHash &_hasher, const Sequence &_seq, size_t _pos) :
+        BasicKWH(const BasicRollingHash<H> &_hasher, const Sequence &_seq, size_t _pos) :
                 hasher(_hasher), seq(_seq), pos(_pos), fhash(_hasher.hash(_seq, _pos)),
                 rhash(_hasher.hash(!_seq, _seq.size() - _pos - _hasher.getK())) {
         }
 
-        KWH(const KWH &other) = default;
+        BasicKWH(const BasicKWH &other) = default;
 
         Sequence getSeq() const {
             return seq.Subseq(pos, pos + hasher.getK());
         }
 
-        KWH operator!() const {
-            return KWH(hasher, !seq, seq.size() - pos - hasher.getK(), rhash, fhash);
+        BasicKWH operator!() const {
+            return BasicKWH(hasher, !seq, seq.size() - pos - hasher.getK(), rhash, fhash);
         }
 
-        htype hash() const {
+        H hash() const {
             return std::min(fhash, rhash);
         }
 
-        htype fHash() const {
+        H fHash() const {
             return fhash;
         }
 
-        htype rHash() const {
+        H rHash() const {
             return rhash;
         }
 
-        htype extendRight(unsigned char c) const {
+        H extendRight(unsigned char c) const {
             return std::min(hasher.extendRight(seq, pos, fhash, c),
                             hasher.extendLeft(!seq, seq.size() - pos - hasher.getK(), rhash, c ^ 3u));
         }
 
-        htype extendLeft(unsigned char c) const {
+        H extendLeft(unsigned char c) const {
             return std::min(hasher.extendLeft(seq, pos, fhash, c),
                             hasher.extendRight(!seq, seq.size() - pos - hasher.getK(), rhash, c ^ 3u));
         }
 
-        KWH next() const {
+        BasicKWH next() const {
             return {hasher, seq, pos + 1, hasher.next(seq, pos, fhash),
                     hasher.prev(!seq, seq.size() - pos - hasher.getK(), rhash)};
         }
 
-        KWH prev() const {
+        BasicKWH prev() const {
             return {hasher, seq, pos - 1, hasher.prev(seq, pos, fhash),
                     hasher.next(!seq, seq.size() - pos - hasher.getK(), rhash)};
         }
@@ -150,7 +162,7 @@ namespace hashing {
             return hasher.hasPrev(seq, pos);
         }
 
-        KWH &operator=(const KWH &other) {
+        BasicKWH &operator=(const BasicKWH &other) {
             if (this == &other)
                 return *this;
             seq = other.seq;
@@ -166,12 +178,108 @@ namespace hashing {
     };
 
 
-    class MinQueue {
-        std::deque<KWH> q;
+    template<class H>
+    struct BasicKmerHash {
+        size_t pos;
+        H hash;
+        bool canonical;
+    };
+
+    //Streaming alternative to KWH for hot loops. The cursor borrows the sequence instead of copying it
+    //and keeps both hashes locally, so stepping does no reference counting or allocation.
+    //The sequence must outlive the cursor.
+    template<class H>
+    class BasicKmerCursor {
+    private:
+        const BasicRollingHash<H> &hasher;
+        const Sequence &seq;
+        Sequence::View view;
+        size_t k;
+        H hbase;
+        H kpow;
+        H inv;
+        H fhash;
+        H rhash;
+        bool finished;
     public:
-        MinQueue() = default;
+        size_t pos;
+
+        BasicKmerCursor(const BasicRollingHash<H> &_hasher, const Sequence &_seq, size_t _pos) :
+                hasher(_hasher), seq(_seq), view(_seq.view()), k(_hasher.k), hbase(_hasher.hbase),
+                kpow(_hasher.kpow), inv(_hasher.inv), fhash(0), rhash(0), finished(false), pos(_pos) {
+            VERIFY(pos + k <= seq.size());
+            for (size_t i = pos; i < pos + k; i++) {
+                fhash = fhash * hbase + view[i];
+                rhash = rhash * hbase + (view[2 * pos + k - 1 - i] ^ 3u);
+            }
+        }
 
-        void push(const KWH &kwh) {
+        BasicKmerCursor(const BasicKmerCursor &other) = delete;
+
+        H hash() const {
+            return std::min(fhash, rhash);
+        }
+
+        H fHash() const {
+            return fhash;
+        }
+
+        H rHash() const {
+            return rhash;
+        }
+
+        bool isCanonical() const {
+            return fhash < rhash;
+        }
+
+        H extendRight(unsigned char c) const {
+            return std::min(H(fhash * hbase + c), H(rhash + (c ^ 3u) * kpow * hbase));
+        }
+
+        H extendLeft(unsigned char c) const {
+            return std::min(H(fhash + c * kpow * hbase), H(rhash * hbase + (c ^ 3u)));
+        }
+
+        bool hasNext() const {
+            return pos + k < view.size();
+        }
+
+        void next() {
+            unsigned char out = view[pos];
+            unsigned char in = view[pos + k];
+            fhash = (fhash - kpow * out) * hbase + in;
+            rhash = (rhash - (out ^ 3u)) * inv + (in ^ 3u) * kpow;
+            pos++;
+        }
+
+        //Writes up to n consecutive k-mers starting from the current one and moves past them.
+        //Returns the number of k-mers written, 0 once the sequence is exhausted.
+        size_t fill(BasicKmerHash<H> *out, size_t n) {
+            size_t cnt = 0;
+            while (cnt < n && !finished) {
+                out[cnt] = {pos, hash(), isCanonical()};
+                cnt++;
+                if (hasNext())
+                    next();
+                else
+                    finished = true;
+            }
+            return cnt;
+        }
+
+        //Materializes the current k-mer as KWH. Only meant for k-mers that are actually used.
+        BasicKWH<H> kwh() const {
+            return {hasher, seq, pos, fhash, rhash};
+        }
+    };
+
+    template<class H>
+    class BasicMinQueue {
+        std::deque<BasicKWH<H>> q;
+    public:
+        BasicMinQueue() = default;
+
+        void push(const BasicKWH<H> &kwh) {
             while (!q.empty() && q.back().hash() > kwh.hash()) {
                 q.pop_back();
             }
@@ -188,7 +296,7 @@ namespace hashing {
             return q.empty();
         }
 
-        KWH get() const {
+        BasicKWH<H> get() const {
             return q.front();
         }
 
@@ -197,15 +305,16 @@ namespace hashing {
         }
     };
 
-    class MinimizerCalculator {
+    template<class H>
+    class BasicMinimizerCalculator {
     private:
         const Sequence seq;
         const size_t w;
-        KWH kwh;
+        BasicKWH<H> kwh;
         size_t pos;
-        MinQueue queue;
+        BasicMinQueue<H> queue;
     public:
-        MinimizerCalculator(const Sequence &_seq, const RollingHash &_hasher, size_t _w) :
+        BasicMinimizerCalculator(const Sequence &_seq, const BasicRollingHash<H> &_hasher, size_t _w) :
                 seq(_seq), w(_w), kwh(_hasher, seq, 0), pos(-1) {
             VERIFY(w >= 2); //This code does not work for w = 1
             VERIFY(seq.size() >= _hasher.getK() + w - 1)
@@ -216,7 +325,7 @@ namespace hashing {
             }
         }
 
-        KWH next() {
+        BasicKWH<H> next() {
             pos += 1;
             queue.pop(pos);
             kwh = kwh.next();
@@ -228,11 +337,11 @@ namespace hashing {
             return kwh.hasNext();
         }
 
-        std::vector<htype> minimizerHashs() {
-            std::vector<htype> res;
+        std::vector<H> minimizerHashs() {
+            std::vector<H> res;
             res.push_back(queue.get().hash());
             while (hasNext()) {
-                htype val = next().hash();
+                H val = next().hash();
                 if (val != res.back()) {
                     res.push_back(val);
                 }
@@ -240,11 +349,11 @@ namespace hashing {
             return std::move(res);
         }
 
-        std::vector<KWH> minimizers() {
-            std::vector<KWH> res;
+        std::vector<BasicKWH<H>> minimizers() {
+            std::vector<BasicKWH<H>> res;
             res.push_back(next());
             while (hasNext()) {
-                KWH val = next();
+                BasicKWH<H> val = next();
                 if (val.pos != res.back().pos) {
                     res.push_back(val);
                 }
@@ -252,4 +361,81 @@ namespace hashing {
             return std::move(res);
         }
     };
-}
\ No newline at end of file
+
+    //Computes minimizers of a whole sequence in one pass using a fixed ring buffer of (hash, pos) pairs.
+    //Selects the same minimizers as MinimizerCalculator::minimizerHashs: the minimum of the first w k-mers
+    //followed by minima of windows of w + 1 k-mers. Each selected k-mer is reported once.
+    //One engine should be used by one thread at a time.
+    template<class H>
+    class BasicMinimizerEngine {
+    private:
+        struct Entry {
+            H hash;
+            size_t pos;
+        };
+        const BasicRollingHash<H> &hasher;
+        const size_t w;
+        size_t mask;
+        std::vector<Entry> ring;
+    public:
+        BasicMinimizerEngine(const BasicRollingHash<H> &_hasher, size_t _w) : hasher(_hasher), w(_w), mask(1) {
+            VERIFY(w >= 2);
+            while (mask < w + 1)
+                mask <<= 1u;
+            ring.resize(mask);
+            mask -= 1;
+        }
+
+        size_t minReadSize() const {
+            return hasher.getK() + w - 1;
+        }
+
+        //Upper bound on the number of minimizers, buffers passed to process must be at least this large
+        size_t maxMinimizers(size_t seq_size) const {
+            return seq_size - hasher.getK() + 1;
+        }
+
+        //Writes hashes and (if positions is not null) positions of minimizers of seq and returns their number
+        size_t process(const Sequence &seq, H *hashes, size_t *positions) {
+            VERIFY(seq.size() >= minReadSize());
+            BasicKmerCursor<H> cursor(hasher, seq, 0);
+            BasicKmerHash<H> batch[256];
+            size_t head = 0;
+            size_t tail = 0;
+            size_t res = 0;
+            size_t last = size_t(-1);
+            size_t n;
+            while ((n = cursor.fill(batch, 256)) > 0) {
+                for (size_t i = 0; i < n; i++) {
+                    const size_t pos = batch[i].pos;
+                    const H hash = batch[i].hash;
+                    if (pos > w && ring[head & mask].pos < pos - w)
+                        head++;
+                    while (tail > head && ring[(tail - 1) & mask].hash > hash)
+                        tail--;
+                    ring[tail & mask] = {hash, pos};
+                    tail++;
+                    if (pos + 1 >= w) {
+                        const Entry &min = ring[head & mask];
+                        if (min.pos != last) {
+                            hashes[res] = min.hash;
+                            if (positions != nullptr)
+                                positions[res] = min.pos;
+                            res++;
+                            last = min.pos;
+                        }
+                    }
+                }
+            }
+            return res;
+        }
+    };
+
+    typedef BasicRollingHash<htype> RollingHash;
+    typedef BasicKWH<htype> KWH;
+    typedef BasicKmerHash<htype> KmerHash;
+    typedef BasicKmerCursor<htype> KmerCursor;
+    typedef BasicMinQueue<htype> MinQueue;
+    typedef BasicMinimizerCalculator<htype> MinimizerCalculator;
+    typedef BasicMinimizerEngine<htype> MinimizerEngine;
+}
@@ -2,6 +2,7 @@
 
 #include "sequence.hpp"
 #include "nucl.hpp"
+#include "nucl_kernels.hpp"
 #include "IntrusiveRefCntPtr.h"
 #include "common/string_utils.hpp"
 #include "common/verify.hpp"
@@ -252,10 +253,7 @@ private:
     }
 
     static std::string makeUpperCase(std::string &&s) {
-        for(size_t i = 0; i < s.size(); i++) {
-            if('a' <= s[i] && s[i] <= 'z')
-                s[i] += 'A' - 'a';
-        }
+        nucl_kernels::GetKernels().toUpper(&s[0], s.size());
         return std::move(s);
     }
 public:
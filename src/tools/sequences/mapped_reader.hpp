@@ -0,0 +1,250 @@
+#pragma once
+
+#include "contigs.hpp"
+#include "common/verify.hpp"
+#include <experimental/filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace io {
+
+    //Read-only memory mapping of a whole file. Pages are loaded lazily by the kernel.
+    class MappedFile {
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+    public:
+        explicit MappedFile(const std::experimental::filesystem::path &file_name) {
+            int fd = open(file_name.c_str(), O_RDONLY);
+            if(fd < 0) {
+                std::cerr << "Error: could not open file " << file_name << std::endl;
+            }
+            VERIFY(fd >= 0);
+            struct stat statbuf{};
+            VERIFY(fstat(fd, &statbuf) == 0);
+            size_ = statbuf.st_size;
+            if(size_ > 0) {
+                void *res = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(res == MAP_FAILED) {
+                    std::cerr << "Error: could not map file " << file_name << std::endl;
+                }
+                VERIFY(res != MAP_FAILED);
+//                Advice values are not flags and can not be combined. Failed advice only costs speed.
+                for(int advice : {MADV_SEQUENTIAL, MADV_WILLNEED}) {
+                    if(madvise(res, size_, advice) != 0)
+                        std::cerr << "Warning: madvise failed for file " << file_name << ": " << strerror(errno) << std::endl;
+                }
+                data_ = static_cast<const char *>(res);
+            }
+            close(fd);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept : data_(other.data_), size_(other.size_) {
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        ~MappedFile() {
+            if(data_ != nullptr)
+                munmap(const_cast<char *>(data_), size_);
+        }
+
+        const char *data() const {return data_;}
+        size_t size() const {return size_;}
+    };
+
+    //Fasta/fastq record as a view into mapped pages. Sequence may span several lines.
+    struct RecordView {
+        const char *header;
+        size_t header_size;
+        const char *seq;
+        size_t seq_size;
+
+        std::string id() const {
+            size_t from = 1;
+            size_t to = header_size;
+            while(from < to && std::isspace((unsigned char)header[from]))
+                from++;
+            while(to > from && std::isspace((unsigned char)header[to - 1]))
+                to--;
+            return {header + from, header + to};
+        }
+
+        //Copies sequence lines skipping line breaks. Single line records are copied with one memcpy.
+        std::string sequence() const {
+            std::string res;
+            res.reserve(seq_size);
+            const char *cur = seq;
+            const char *end = seq + seq_size;
+            while(cur < end) {
+                const char *eol = static_cast<const char *>(memchr(cur, '\n', end - cur));
+                if(eol == nullptr)
+                    eol = end;
+                const char *line_end = eol;
+                if(line_end > cur && *(line_end - 1) == '\r')
+                    line_end--;
+                res.append(cur, line_end);
+                cur = eol + 1;
+            }
+            return std::move(res);
+        }
+
+        StringContig makeStringContig() const {
+            return {sequence(), id()};
+        }
+    };
+
+    //Index of record boundaries of an uncompressed fasta/fastq file. Boundaries are found in parallel:
+    //the file is split into chunks, each thread synchronizes to the first record start inside its chunk
+    //and parses records that start before the end of the chunk.
+    class MappedRecords {
+    private:
+        struct Offsets {
+            size_t header;
+            size_t seq;
+            size_t seq_end;
+        };
+
+        MappedFile file;
+        bool fastq;
+        std::vector<Offsets> records;
+
+        size_t lineEnd(size_t pos) const {
+            const char *eol = static_cast<const char *>(memchr(file.data() + pos, '\n', file.size() - pos));
+            return eol == nullptr ? file.size() : eol - file.data();
+        }
+
+        size_t nextLine(size_t pos) const {
+            return std::min(lineEnd(pos) + 1, file.size());
+        }
+
+        bool isLineStart(size_t pos) const {
+            return pos == 0 || file.data()[pos - 1] == '\n';
+        }
+
+        bool isBlank(size_t from, size_t to) const {
+            for(size_t i = from; i < to; i++)
+                if(!std::isspace((unsigned char)file.data()[i]))
+                    return false;
+            return true;
+        }
+
+        bool isSeqLine(size_t from, size_t to) const {
+            if(to > from && file.data()[to - 1] == '\r')
+                to--;
+            if(from == to)
+                return false;
+            for(size_t i = from; i < to; i++)
+                if(!std::isalpha(file.data()[i]))
+                    return false;
+            return true;
+        }
+
+//        Fastq quality lines may start with '@' so candidate header has to be followed by sequence lines and a '+' line
+        bool isRecordStart(size_t pos) const {
+            const char *data = file.data();
+            if(!isLineStart(pos) || pos >= file.size())
+                return false;
+            if(!fastq)
+                return data[pos] == '>';
+            if(data[pos] != '@')
+                return false;
+            size_t cur = nextLine(pos);
+            if(cur >= file.size() || !isSeqLine(cur, lineEnd(cur)))
+                return false;
+            while(cur < file.size()) {
+                if(data[cur] == '+')
+                    return true;
+                if(!isSeqLine(cur, lineEnd(cur)))
+                    return false;
+                cur = nextLine(cur);
+            }
+            return false;
+        }
+
+        size_t synchronize(size_t pos) const {
+            if(pos > 0)
+                pos = nextLine(pos - 1);
+            while(pos < file.size() && !isRecordStart(pos)) {
+                pos = nextLine(pos);
+            }
+            return pos;
+        }
+
+        //Parses record starting at pos. Returns start of the next record.
+        size_t parseRecord(size_t pos, std::vector<Offsets> &res) const {
+            const char *data = file.data();
+            size_t header_end = lineEnd(pos);
+            size_t seq = std::min(header_end + 1, file.size());
+            size_t cur = seq;
+            size_t seq_end = seq;
+            size_t seq_len = 0;
+            char stop = fastq ? '+' : '>';
+            while(cur < file.size() && data[cur] != stop) {
+                size_t eol = lineEnd(cur);
+                if(!isBlank(cur, eol)) {
+                    seq_end = eol;
+                    seq_len += eol - cur;
+                }
+                cur = std::min(eol + 1, file.size());
+            }
+            if(fastq) {
+                cur = nextLine(cur);
+                size_t qlen = 0;
+                while(cur < file.size() && qlen < seq_len) {
+                    size_t eol = lineEnd(cur);
+                    qlen += eol - cur;
+                    cur = std::min(eol + 1, file.size());
+                }
+            }
+            while(seq_end > seq && std::isspace((unsigned char)data[seq_end - 1]))
+                seq_end--;
+            if(seq_end > seq)
+                res.push_back({pos, seq, seq_end});
+            return cur;
+        }
+
+    public:
+        MappedRecords(const std::experimental::filesystem::path &file_name, bool _fastq, size_t threads) :
+                file(file_name), fastq(_fastq) {
+            const size_t min_chunk = 1u << 20u;
+            size_t chunk_num = std::max<size_t>(1, std::min(threads * 4, file.size() / min_chunk));
+            size_t chunk_size = (file.size() + chunk_num - 1) / chunk_num;
+            std::vector<std::vector<Offsets>> parts(chunk_num);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads) default(none) shared(parts, chunk_num, chunk_size)
+            for(size_t chunk = 0; chunk < chunk_num; chunk++) {
+                size_t to = std::min(file.size(), (chunk + 1) * chunk_size);
+                size_t pos = synchronize(std::min(file.size(), chunk * chunk_size));
+                while(pos < to) {
+                    pos = parseRecord(pos, parts[chunk]);
+                }
+            }
+            size_t total = 0;
+            for(std::vector<Offsets> &part : parts)
+                total += part.size();
+            records.reserve(total);
+            for(std::vector<Offsets> &part : parts) {
+                records.insert(records.end(), part.begin(), part.end());
+                std::vector<Offsets>().swap(part);
+            }
+        }
+
+        size_t size() const {return records.size();}
+
+        RecordView operator[](size_t ind) const {
+            const Offsets &rec = records[ind];
+            return {file.data() + rec.header, lineEnd(rec.header) - rec.header,
+                    file.data() + rec.seq, rec.seq_end - rec.seq};
+        }
+    };
+}
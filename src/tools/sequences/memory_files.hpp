@@ -0,0 +1,60 @@
+#pragma once
+
+#include "contigs.hpp"
+#include <experimental/filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace io {
+
+    //Records of fasta files that a pipeline stage keeps in memory for the next stages of the same process.
+    //SeqReader reads registered files from memory, so the files on disk are only archives and may still be
+    //written in the background. Records are stored as they would be printed and are compressed again when read.
+    class MemoryFiles {
+    public:
+        typedef std::shared_ptr<const std::vector<StringContig>> Records;
+    private:
+        static std::mutex &lock() {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::unordered_map<std::string, Records> &files() {
+            static std::unordered_map<std::string, Records> storage;
+            return storage;
+        }
+
+        static std::string key(const std::experimental::filesystem::path &file_name) {
+            return std::experimental::filesystem::absolute(file_name).string();
+        }
+
+    public:
+        static void add(const std::experimental::filesystem::path &file_name, Records records) {
+            std::lock_guard<std::mutex> guard(lock());
+            files()[key(file_name)] = std::move(records);
+        }
+
+        //Returns nullptr if the file is not registered.
+        static Records get(const std::experimental::filesystem::path &file_name) {
+            std::lock_guard<std::mutex> guard(lock());
+            auto it = files().find(key(file_name));
+            return it == files().end() ? nullptr : it->second;
+        }
+
+        static bool contains(const std::vector<std::experimental::filesystem::path> &lib) {
+            for(const std::experimental::filesystem::path &file_name : lib) {
+                if(get(file_name) == nullptr)
+                    return false;
+            }
+            return !lib.empty();
+        }
+
+        static void remove(const std::experimental::filesystem::path &file_name) {
+            std::lock_guard<std::mutex> guard(lock());
+            files().erase(key(file_name));
+        }
+    };
+}
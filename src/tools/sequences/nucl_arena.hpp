@@ -0,0 +1,116 @@
+#pragma once
+
+#include "IntrusiveRefCntPtr.h"
+#include "common/verify.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <new>
+#include <vector>
+
+//Owner of packed nucleotide words referenced by Sequence. The owner is released when the last Sequence referencing
+//it is destroyed. Words allocated in a NuclArena have no owner.
+class NuclStorage : public llvm::ThreadSafeRefCountedBase<NuclStorage> {
+public:
+    virtual ~NuclStorage() = default;
+};
+
+//Words of a single sequence stored in the same allocation as the reference count.
+class ManagedNuclBuffer final : public NuclStorage {
+    uint64_t _data[1];
+
+    ManagedNuclBuffer() = default;
+public:
+    static ManagedNuclBuffer *create(size_t words) {
+        size_t bytes = sizeof(ManagedNuclBuffer) + (words > 0 ? words - 1 : 0) * sizeof(uint64_t);
+        return new (::operator new(bytes)) ManagedNuclBuffer();
+    }
+
+    static void operator delete(void *ptr) {
+        ::operator delete(ptr);
+    }
+
+    uint64_t *data() {return _data;}
+};
+
+//Slab allocator for packed nucleotide words of large structures that are freed together, such as the sequences of a
+//graph or the read paths of an alignment storage. Sequences allocated in an arena borrow its memory: they have no
+//reference count and copying them or taking subsequences is free, but none of them may be used after the arena is
+//destroyed. The owner of the arena is responsible for that, usually by keeping the arena alive as long as the
+//structure that holds the sequences.
+//Every thread fills its own chunk, so allocation only takes the lock when a thread needs a new chunk. Chunks are freed
+//in bulk when the arena is destroyed.
+class NuclArena {
+public:
+    static const size_t min_chunk_words = size_t(1) << 12u;
+    static const size_t chunk_words = size_t(1) << 20u;
+private:
+//    Chunk a thread is filling. It belongs to the arena with the given id, ids are never reused so that a cursor left
+//    by a destroyed arena is not taken for a chunk of a new one at the same address.
+    struct Cursor {
+        size_t arena_id = 0;
+        uint64_t *cur = nullptr;
+        size_t left = 0;
+    };
+
+    static Cursor &threadCursor() {
+        static thread_local Cursor cursor;
+        return cursor;
+    }
+
+    static size_t nextId() {
+        static std::atomic<size_t> ids(0);
+        return ++ids;
+    }
+
+    const size_t id;
+    std::mutex lock;
+    std::vector<std::unique_ptr<uint64_t[]>> chunks;
+    size_t allocated = 0;
+    size_t wasted = 0;
+
+    uint64_t *newChunk(size_t size) {
+        chunks.emplace_back(new uint64_t[size]);
+        allocated += size;
+        return chunks.back().get();
+    }
+
+public:
+    NuclArena() : id(nextId()) {}
+    NuclArena(const NuclArena &) = delete;
+    NuclArena &operator=(const NuclArena &) = delete;
+
+    //Chunk size doubles from min_chunk_words up to chunk_words so that small arenas stay small. Large requests get a
+    //dedicated chunk so that they do not waste the tail of the current one.
+    uint64_t *allocate(size_t words) {
+        Cursor &cursor = threadCursor();
+        if(cursor.arena_id != id || words > cursor.left) {
+            std::lock_guard<std::mutex> guard(lock);
+            if(words > chunk_words / 4)
+                return newChunk(words);
+            if(cursor.arena_id == id)
+                wasted += cursor.left;
+            size_t size = std::min(chunk_words, std::max(min_chunk_words, allocated));
+            cursor.arena_id = id;
+            cursor.cur = newChunk(size);
+            cursor.left = size;
+        }
+        uint64_t *res = cursor.cur;
+        cursor.cur += words;
+        cursor.left -= words;
+        return res;
+    }
+
+    //Tails of the chunks that threads are still filling count as used
+    size_t allocatedBytes() const {return allocated * sizeof(uint64_t);}
+    size_t usedBytes() const {return (allocated - wasted) * sizeof(uint64_t);}
+    size_t chunkCount() const {return chunks.size();}
+};
+inline std::ostream &operator<<(std::ostream &os, const NuclArena &arena) {
+    size_t allocated = arena.allocatedBytes();
+    return os << (allocated >> 20u) << "Mb in " << arena.chunkCount() << " chunks, "
+              << (allocated == 0 ? 100 : arena.usedBytes() * 100 / allocated) << "% occupied";
+}
@@ -0,0 +1,120 @@
+#include "nucl_kernels.hpp"
+#include "nucl.hpp"
+#include <algorithm>
+
+namespace nucl_kernels {
+namespace {
+    void toUpperScalar(char *s, size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            if('a' <= s[i] && s[i] <= 'z')
+                s[i] += 'A' - 'a';
+        }
+    }
+
+    size_t collapseHomopolymersScalar(char *s, size_t n) {
+        return std::unique(s, s + n) - s;
+    }
+
+    size_t compressDimersScalar(char *s, size_t n, size_t max_dimer_size) {
+        if(n < 2)
+            return n;
+        size_t cur = 2;
+        size_t at_len = 2;
+        for(size_t i = 2; i <= n; i++) {
+            if (i < n && s[i] == s[cur - 2]) {
+                s[cur] = s[i];
+                cur++;
+                at_len += 1;
+            } else {
+                if(at_len > max_dimer_size) {
+                    cur -= (at_len - max_dimer_size) / 2 * 2;
+                }
+                at_len = 2;
+                if(i < n) {
+                    s[cur] = s[i];
+                    cur++;
+                }
+            }
+        }
+        return cur;
+    }
+
+    void packScalar(const char *s, size_t n, u_int64_t *res) {
+        u_int64_t data = 0;
+        size_t cnt = 0;
+        for (size_t i = 0; i < n; ++i) {
+            data |= u_int64_t(dignucl(s[i])) << cnt;
+            cnt += 2;
+            if (cnt == 64) {
+                *res++ = data;
+                cnt = 0;
+                data = 0;
+            }
+        }
+        if (cnt != 0)
+            *res = data;
+    }
+
+    void packRCScalar(const char *s, size_t n, u_int64_t *res) {
+        u_int64_t data = 0;
+        size_t cnt = 0;
+        for (size_t i = n; i > 0; --i) {
+            data |= u_int64_t(complement(dignucl(s[i - 1]))) << cnt;
+            cnt += 2;
+            if (cnt == 64) {
+                *res++ = data;
+                cnt = 0;
+                data = 0;
+            }
+        }
+        if (cnt != 0)
+            *res = data;
+    }
+}
+
+    const Kernels &ScalarKernels() {
+        static const Kernels kernels = {Architecture::Scalar, &toUpperScalar, &collapseHomopolymersScalar,
+                                        &compressDimersScalar, &packScalar, &packRCScalar};
+        return kernels;
+    }
+
+    const char *ArchitectureName(Architecture arch) {
+        switch (arch) {
+            case Architecture::AVX2:
+                return "AVX2";
+            case Architecture::SSE4_1:
+                return "SSE4.1";
+            default:
+                return "scalar";
+        }
+    }
+
+    std::vector<Architecture> SupportedArchitectures() {
+        std::vector<Architecture> res = {Architecture::Scalar};
+#ifdef LJA_SIMD_DISPATCH
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse4.1"))
+            res.push_back(Architecture::SSE4_1);
+        if(__builtin_cpu_supports("avx2"))
+            res.push_back(Architecture::AVX2);
+#endif
+        return res;
+    }
+
+    Architecture BestArchitecture() {
+        return SupportedArchitectures().back();
+    }
+
+    const Kernels &GetKernels(Architecture arch) {
+        switch (arch) {
+#ifdef LJA_SIMD_DISPATCH
+            case Architecture::AVX2:
+                return AVX2Kernels();
+            case Architecture::SSE4_1:
+                return SSE41Kernels();
+#endif
+            default:
+                return ScalarKernels();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+//Low level kernels for read compression and 2-bit packing. SIMD versions are compiled in separate
+//translation units with corresponding instruction set flags and are selected at runtime.
+namespace nucl_kernels {
+    enum class Architecture {
+        Scalar, SSE4_1, AVX2
+    };
+
+    struct Kernels {
+        Architecture arch;
+        //Converts a-z to A-Z in place
+        void (*toUpper)(char *s, size_t n);
+        //Removes consecutive duplicate characters in place. Returns new length.
+        size_t (*collapseHomopolymers)(char *s, size_t n);
+        //Shortens every run of alternating dimer that is longer than max_dimer_size by the smallest even
+        //number of characters so that it becomes not longer than max_dimer_size. Returns new length.
+        size_t (*compressDimers)(char *s, size_t n, size_t max_dimer_size);
+        //Packs ACGTN string 2 bits per nucleotide into (n + 31) / 32 words, i-th nucleotide to bits 2*(i%32) of word i/32.
+        //N is packed as A. Unused bits of the last word are set to zero.
+        void (*pack)(const char *s, size_t n, u_int64_t *res);
+        //Same as pack for reverse complement of s
+        void (*packRC)(const char *s, size_t n, u_int64_t *res);
+    };
+
+    const char *ArchitectureName(Architecture arch);
+
+    //Best architecture supported by the current CPU and this build
+    Architecture BestArchitecture();
+
+    //Architectures supported by the current CPU and this build including scalar
+    std::vector<Architecture> SupportedArchitectures();
+
+    const Kernels &GetKernels(Architecture arch);
+
+    inline const Kernels &GetKernels() {
+        static const Kernels &kernels = GetKernels(BestArchitecture());
+        return kernels;
+    }
+
+    const Kernels &ScalarKernels();
+#ifdef LJA_SIMD_DISPATCH
+    const Kernels &SSE41Kernels();
+    const Kernels &AVX2Kernels();
+#endif
+}
@@ -0,0 +1,71 @@
+//This file is compiled with -mavx2 and is only called after runtime CPU check
+
+#include "nucl_kernels_impl.hpp"
+#include <immintrin.h>
+
+namespace nucl_kernels {
+namespace {
+    struct Arch {
+        static const size_t W = 32;
+
+        static __m256i load(const char *p) {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        }
+
+        static void toUpper(char *p) {
+            __m256i v = load(p);
+            __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+            v = _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8('a' - 'A')));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+        }
+
+        static uint32_t neq1Mask(const char *p) {
+            return ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(load(p), load(p - 1))));
+        }
+
+        static uint32_t eq2Mask(const char *p) {
+            return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(load(p), load(p - 2))));
+        }
+
+        static void compact8(const char *src, uint32_t mask, char *dst) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));
+            __m128i shuffle = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(impl::compact_table.v[mask]));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_shuffle_epi8(v, shuffle));
+        }
+
+        static __m256i codes(__m256i v) {
+            return _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(v, 1), _mm256_srli_epi16(v, 2)),
+                                    _mm256_set1_epi8(3));
+        }
+
+        //Codes are merged pairwise into 4 and 8 bit groups, then low bytes of 32 bit lanes are collected
+        static u_int64_t packCodes(__m256i codes) {
+            __m256i pairs = _mm256_maddubs_epi16(codes, _mm256_set1_epi16(0x0401));
+            __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00100001));
+            __m256i bytes = _mm256_shuffle_epi8(quads, _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                                                        -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                        0, 4, 8, 12, -1, -1, -1, -1,
+                                                                        -1, -1, -1, -1, -1, -1, -1, -1));
+            return u_int64_t(uint32_t(_mm256_extract_epi32(bytes, 0))) |
+                   (u_int64_t(uint32_t(_mm256_extract_epi32(bytes, 4))) << 32u);
+        }
+
+        static u_int64_t pack32(const char *p) {
+            return packCodes(codes(load(p)));
+        }
+
+        static u_int64_t pack32RC(const char *end) {
+            __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                               15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+            __m256i v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(load(end - 32), reverse), 0x4E);
+            return packCodes(_mm256_xor_si256(codes(v), _mm256_set1_epi8(3)));
+        }
+    };
+}
+
+    const Kernels &AVX2Kernels() {
+        static const Kernels kernels = impl::makeKernels<Arch>(Architecture::AVX2);
+        return kernels;
+    }
+}
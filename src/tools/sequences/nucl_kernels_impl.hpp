@@ -0,0 +1,187 @@
+#pragma once
+
+//Generic SIMD implementation of nucl_kernels. Included only by translation units that are compiled with
+//architecture specific flags. Every such unit defines its Arch struct in an anonymous namespace, so template
+//instances do not leak between units. Standard library templates are avoided here for the same reason.
+
+#include "nucl_kernels.hpp"
+#include <cstdint>
+#include <cstring>
+
+namespace nucl_kernels {
+namespace impl {
+    //Shuffle masks that move bytes with set mask bits to the beginning of 8 byte block
+    struct CompactTable {
+        unsigned char v[256][8];
+
+        constexpr CompactTable() : v() {
+            for(size_t mask = 0; mask < 256; mask++) {
+                size_t cur = 0;
+                for(size_t i = 0; i < 8; i++) {
+                    if((mask >> i) & 1u)
+                        v[mask][cur++] = i;
+                }
+                for(; cur < 8; cur++)
+                    v[mask][cur] = 0x80;
+            }
+        }
+    };
+
+    static constexpr CompactTable compact_table{};
+
+    //Arch must provide:
+    //  W - number of characters processed at once (at most 32)
+    //  toUpper(p) - in place conversion of W characters
+    //  neq1Mask(p) - bit b is set if p[b] != p[b - 1]
+    //  eq2Mask(p) - bit b is set if p[b] == p[b - 2]
+    //  compact8(src, mask, dst) - writes bytes of src[0..8) with set mask bits to dst, may write up to 8 bytes
+    //  pack32(p) - packed 32 nucleotides starting from p
+    //  pack32RC(p) - packed reverse complement of 32 nucleotides ending at p
+    template<class Arch>
+    void toUpper(char *s, size_t n) {
+        size_t i = 0;
+        for(; i + Arch::W <= n; i += Arch::W)
+            Arch::toUpper(s + i);
+        for(; i < n; i++) {
+            if('a' <= s[i] && s[i] <= 'z')
+                s[i] += 'A' - 'a';
+        }
+    }
+
+    template<class Arch>
+    size_t collapseHomopolymers(char *s, size_t n) {
+        if(n == 0)
+            return 0;
+        size_t out = 1;
+        size_t i = 1;
+        char last = s[0];
+//        Characters before i may be already overwritten so comparison with previous character is fixed using last
+        for(; i + Arch::W <= n; i += Arch::W) {
+            uint32_t keep = Arch::neq1Mask(s + i);
+            keep = (keep & ~uint32_t(1)) | uint32_t(s[i] != last);
+            last = s[i + Arch::W - 1];
+            if(out == i && keep == uint32_t((uint64_t(1) << Arch::W) - 1)) {
+                out += Arch::W;
+                continue;
+            }
+            for(size_t b = 0; b < Arch::W; b += 8) {
+                uint32_t mask = (keep >> b) & 0xFFu;
+                Arch::compact8(s + i + b, mask, s + out);
+                out += __builtin_popcount(mask);
+            }
+        }
+        for(; i < n; i++) {
+            if(s[i] != last)
+                s[out++] = s[i];
+            last = s[i];
+        }
+        return out;
+    }
+
+    //Checks if mask contains len consecutive set bits
+    inline bool hasRun(uint32_t mask, size_t len) {
+        if(len > 32)
+            return false;
+        size_t cur = 1;
+        while(cur < len && mask != 0) {
+            size_t step = cur < len - cur ? cur : len - cur;
+            mask &= mask >> step;
+            cur += step;
+        }
+        return mask != 0;
+    }
+
+    //Dimer runs are maximal segments where every character is equal to the one two positions before.
+    //Masks of such positions are computed with SIMD and only blocks that may contain a long run inside
+    //are processed bit by bit. Characters are removed from the end of long runs.
+    template<class Arch>
+    size_t compressDimers(char *s, size_t n, size_t max_dimer_size) {
+        const uint32_t full = uint32_t((uint64_t(1) << Arch::W) - 1);
+        size_t out = 0;
+        size_t copied = 0;
+        size_t run = 0;
+        auto finish = [&](size_t end) {
+            size_t at_len = run + 2;
+            run = 0;
+            if(at_len <= max_dimer_size)
+                return;
+            size_t cut = (at_len - max_dimer_size) / 2 * 2;
+            if(cut == 0)
+                return;
+            memmove(s + out, s + copied, end - cut - copied);
+            out += end - cut - copied;
+            copied = end;
+        };
+        size_t j = 2;
+        for(; j + Arch::W <= n; j += Arch::W) {
+            uint32_t mask = Arch::eq2Mask(s + j);
+            if(mask == full) {
+                run += Arch::W;
+                continue;
+            }
+            if(max_dimer_size >= 3 && !hasRun(mask, max_dimer_size - 1)) {
+                size_t low = __builtin_ctz(~mask);
+                run += low;
+                if(run > 0)
+                    finish(j + low);
+                size_t high = __builtin_clz(~(mask << (32 - Arch::W)));
+                run = high;
+                continue;
+            }
+            for(size_t b = 0; b < Arch::W; b++) {
+                if((mask >> b) & 1u)
+                    run++;
+                else if(run > 0)
+                    finish(j + b);
+            }
+        }
+        for(; j < n; j++) {
+            if(s[j] == s[j - 2])
+                run++;
+            else if(run > 0)
+                finish(j);
+        }
+        if(run > 0 && n >= 2)
+            finish(n);
+        if(copied == 0)
+            return n;
+        memmove(s + out, s + copied, n - copied);
+        return out + n - copied;
+    }
+
+    inline u_int64_t packCode(char c) {
+        return (u_int64_t(c >> 1) ^ u_int64_t(c >> 2)) & 3u;
+    }
+
+    template<class Arch>
+    void pack(const char *s, size_t n, u_int64_t *res) {
+        size_t words = n / 32;
+        for(size_t i = 0; i < words; i++)
+            res[i] = Arch::pack32(s + i * 32);
+        if(n % 32 != 0) {
+            u_int64_t word = 0;
+            for(size_t i = words * 32; i < n; i++)
+                word |= packCode(s[i]) << ((i % 32) * 2);
+            res[words] = word;
+        }
+    }
+
+    template<class Arch>
+    void packRC(const char *s, size_t n, u_int64_t *res) {
+        size_t words = n / 32;
+        for(size_t i = 0; i < words; i++)
+            res[i] = Arch::pack32RC(s + n - i * 32);
+        if(n % 32 != 0) {
+            u_int64_t word = 0;
+            for(size_t i = words * 32; i < n; i++)
+                word |= (3u ^ packCode(s[n - 1 - i])) << ((i % 32) * 2);
+            res[words] = word;
+        }
+    }
+
+    template<class Arch>
+    Kernels makeKernels(Architecture arch) {
+        return {arch, &toUpper<Arch>, &collapseHomopolymers<Arch>, &compressDimers<Arch>, &pack<Arch>, &packRC<Arch>};
+    }
+}
+}
@@ -0,0 +1,70 @@
+//This file is compiled with -msse4.1 and is only called after runtime CPU check
+
+#include "nucl_kernels_impl.hpp"
+#include <smmintrin.h>
+
+namespace nucl_kernels {
+namespace {
+    struct Arch {
+        static const size_t W = 16;
+
+        static __m128i load(const char *p) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        }
+
+        static void toUpper(char *p) {
+            __m128i v = load(p);
+            __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+            v = _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8('a' - 'A')));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+        }
+
+        static uint32_t neq1Mask(const char *p) {
+            return ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(load(p), load(p - 1)))) & 0xFFFFu;
+        }
+
+        static uint32_t eq2Mask(const char *p) {
+            return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(load(p), load(p - 2))));
+        }
+
+        static void compact8(const char *src, uint32_t mask, char *dst) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));
+            __m128i shuffle = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(impl::compact_table.v[mask]));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_shuffle_epi8(v, shuffle));
+        }
+
+        //Nucleotide codes are (c >> 1 ^ c >> 2) & 3. Codes are then merged pairwise into 4 and 8 bit groups.
+        static uint32_t packCodes(__m128i codes) {
+            __m128i pairs = _mm_maddubs_epi16(codes, _mm_set1_epi16(0x0401));
+            __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00100001));
+            __m128i bytes = _mm_shuffle_epi8(quads, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1,
+                                                                  -1, -1, -1, -1, -1, -1, -1, -1));
+            return uint32_t(_mm_cvtsi128_si32(bytes));
+        }
+
+        static __m128i codes(__m128i v) {
+            return _mm_and_si128(_mm_xor_si128(_mm_srli_epi16(v, 1), _mm_srli_epi16(v, 2)), _mm_set1_epi8(3));
+        }
+
+        static u_int64_t pack32(const char *p) {
+            return u_int64_t(packCodes(codes(load(p)))) | (u_int64_t(packCodes(codes(load(p + 16)))) << 32u);
+        }
+
+        static uint32_t pack16RC(const char *end) {
+            __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+            __m128i v = _mm_shuffle_epi8(load(end - 16), reverse);
+            return packCodes(_mm_xor_si128(codes(v), _mm_set1_epi8(3)));
+        }
+
+        static u_int64_t pack32RC(const char *end) {
+            return u_int64_t(pack16RC(end)) | (u_int64_t(pack16RC(end - 16)) << 32u);
+        }
+    };
+}
+
+    const Kernels &SSE41Kernels() {
+        static const Kernels kernels = impl::makeKernels<Arch>(Architecture::SSE4_1);
+        return kernels;
+    }
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "common/verify.hpp"
+#include <experimental/filesystem>
+#include <zlib.h>
+#include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace io {
+
+    //Bounded queue of decompressed chunks passed from the decompression thread to the reader. Errors of the
+    //decompression thread are passed to the reader, which reports them after the chunks that came before the error.
+    class ChunkQueue {
+    private:
+        std::mutex m;
+        std::condition_variable cv;
+        std::deque<std::vector<char>> q;
+        size_t capacity;
+        bool finished = false;
+        bool closed = false;
+        std::string error_;
+    public:
+        explicit ChunkQueue(size_t _capacity) : capacity(_capacity) {}
+
+        //Returns false if consumer does not need more data
+        bool push(std::vector<char> &&chunk) {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [this] {return q.size() < capacity || closed;});
+            if(closed)
+                return false;
+            q.emplace_back(std::move(chunk));
+            cv.notify_all();
+            return true;
+        }
+
+        //Returns false if all data was consumed
+        bool pop(std::vector<char> &chunk) {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [this] {return !q.empty() || finished;});
+            if(q.empty())
+                return false;
+            chunk = std::move(q.front());
+            q.pop_front();
+            cv.notify_all();
+            return true;
+        }
+
+        void finish() {
+            std::unique_lock<std::mutex> lock(m);
+            finished = true;
+            cv.notify_all();
+        }
+
+        void fail(const std::string &message) {
+            std::unique_lock<std::mutex> lock(m);
+            error_ = message;
+            finished = true;
+            cv.notify_all();
+        }
+
+        std::string error() {
+            std::unique_lock<std::mutex> lock(m);
+            return error_;
+        }
+
+        void close() {
+            std::unique_lock<std::mutex> lock(m);
+            closed = true;
+            cv.notify_all();
+        }
+    };
+
+    //Input streambuf for gzipped files. Decompression runs ahead of the reader in a separate thread.
+    //BGZF files are split into independent blocks that are inflated in parallel by threads workers.
+    //Plain gzip files can not be split and are inflated by the read-ahead thread with a large buffer. If a BGZF file
+    //is followed by plain gzip members, the rest of the file starting from the first such member is read as plain gzip.
+    class ParallelGzStreambuf : public std::streambuf {
+    private:
+        static const size_t header_size = 12;
+        static const size_t gz_chunk_size = 4u << 20u;
+        static const size_t max_bgzf_block = 1u << 16u;
+
+        ChunkQueue queue;
+        std::vector<char> current;
+        std::thread worker;
+
+        //Reads one BGZF block. Returns false at the end of file or if the block is not BGZF.
+        static bool readBlock(FILE *f, std::vector<char> &block) {
+            unsigned char header[header_size];
+            if(fread(header, 1, header_size, f) != header_size)
+                return false;
+            if(header[0] != 31 || header[1] != 139 || header[2] != 8 || (header[3] & 4u) == 0)
+                return false;
+            size_t xlen = header[10] | (size_t(header[11]) << 8u);
+            std::vector<unsigned char> extra(xlen);
+            if(fread(extra.data(), 1, xlen, f) != xlen)
+                return false;
+            size_t bsize = 0;
+            for(size_t pos = 0; pos + 4 <= xlen;) {
+                size_t slen = extra[pos + 2] | (size_t(extra[pos + 3]) << 8u);
+                if(extra[pos] == 'B' && extra[pos + 1] == 'C' && slen == 2 && pos + 6 <= xlen) {
+                    bsize = (extra[pos + 4] | (size_t(extra[pos + 5]) << 8u)) + 1;
+                    break;
+                }
+                pos += 4 + slen;
+            }
+            if(bsize < header_size + xlen + 8)
+                return false;
+            block.resize(bsize - header_size - xlen);
+            return fread(block.data(), 1, block.size(), f) == block.size();
+        }
+
+        //Block is compressed data followed by crc32 and uncompressed size. Returns false if the block is corrupted.
+        static bool inflateBlock(const std::vector<char> &block, std::vector<char> &res) {
+            if(block.size() < 8)
+                return false;
+            const auto *data = reinterpret_cast<const unsigned char *>(block.data());
+            size_t clen = block.size() - 8;
+            const unsigned char *tail = data + clen;
+            uint32_t crc = tail[0] | (uint32_t(tail[1]) << 8u) | (uint32_t(tail[2]) << 16u) | (uint32_t(tail[3]) << 24u);
+            size_t isize = tail[4] | (size_t(tail[5]) << 8u) | (size_t(tail[6]) << 16u) | (size_t(tail[7]) << 24u);
+            res.resize(isize);
+            if(isize == 0)
+                return true;
+            z_stream strm{};
+            if(inflateInit2(&strm, -15) != Z_OK)
+                return false;
+            strm.next_in = const_cast<unsigned char *>(data);
+            strm.avail_in = clen;
+            strm.next_out = reinterpret_cast<unsigned char *>(res.data());
+            strm.avail_out = isize;
+            int ret = inflate(&strm, Z_FINISH);
+            inflateEnd(&strm);
+            return ret == Z_STREAM_END && strm.avail_out == 0 &&
+                   crc32(0, reinterpret_cast<const unsigned char *>(res.data()), isize) == crc;
+        }
+
+        void decompressBGZF(const std::experimental::filesystem::path &file_name, size_t threads) {
+            FILE *f = fopen(file_name.c_str(), "rb");
+            if(f == nullptr) {
+                queue.fail("Failed to open file " + file_name.string());
+                return;
+            }
+            setvbuf(f, nullptr, _IOFBF, 1u << 20u);
+            const size_t batch_size = threads * 16;
+            bool eof = false;
+            long gzip_offset = -1;
+            while(!eof) {
+                std::vector<std::vector<char>> blocks;
+                while(blocks.size() < batch_size) {
+                    long offset = ftell(f);
+                    blocks.emplace_back();
+                    if(!readBlock(f, blocks.back())) {
+                        blocks.pop_back();
+                        if(!feof(f) || ftell(f) != offset)
+                            gzip_offset = offset;
+                        eof = true;
+                        break;
+                    }
+                }
+                std::vector<std::vector<char>> res(blocks.size());
+                std::vector<char> ok(blocks.size());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads) default(none) shared(blocks, res, ok)
+                for(size_t i = 0; i < blocks.size(); i++) {
+                    ok[i] = inflateBlock(blocks[i], res[i]);
+                }
+                std::vector<char> chunk;
+                chunk.reserve(blocks.size() * max_bgzf_block);
+                for(size_t i = 0; i < res.size(); i++) {
+                    if(!ok[i]) {
+                        fclose(f);
+                        if(!chunk.empty())
+                            queue.push(std::move(chunk));
+                        queue.fail("Corrupted BGZF block in file " + file_name.string());
+                        return;
+                    }
+                    chunk.insert(chunk.end(), res[i].begin(), res[i].end());
+                }
+                if(!chunk.empty() && !queue.push(std::move(chunk))) {
+                    gzip_offset = -1;
+                    break;
+                }
+            }
+            if(gzip_offset >= 0) {
+                unsigned char magic[2] = {};
+                fseek(f, gzip_offset, SEEK_SET);
+                if(fread(magic, 1, 2, f) != 2 || magic[0] != 31 || magic[1] != 139) {
+                    fclose(f);
+                    queue.fail("Unexpected data after BGZF blocks in file " + file_name.string());
+                    return;
+                }
+            }
+            fclose(f);
+            if(gzip_offset >= 0)
+                decompressGzip(file_name, gzip_offset);
+            else
+                queue.finish();
+        }
+
+        //Reads the file from the given offset with gzread, which also handles concatenated gzip members.
+        void decompressGzip(const std::experimental::filesystem::path &file_name, long offset = 0) {
+            int fd = open(file_name.c_str(), O_RDONLY);
+            if(fd < 0 || lseek(fd, offset, SEEK_SET) != offset) {
+                if(fd >= 0)
+                    ::close(fd);
+                queue.fail("Failed to open file " + file_name.string());
+                return;
+            }
+            gzFile f = gzdopen(fd, "rb");
+            if(f == nullptr) {
+                ::close(fd);
+                queue.fail("Failed to open file " + file_name.string());
+                return;
+            }
+            gzbuffer(f, 1u << 20u);
+            while(true) {
+                std::vector<char> chunk(gz_chunk_size);
+                int len = gzread(f, chunk.data(), chunk.size());
+                if(len < 0) {
+                    gzclose(f);
+                    queue.fail("Error while decompressing file " + file_name.string());
+                    return;
+                }
+                if(len == 0)
+                    break;
+                chunk.resize(len);
+                if(!queue.push(std::move(chunk)))
+                    break;
+            }
+            gzclose(f);
+            queue.finish();
+        }
+
+    public:
+        ParallelGzStreambuf(const std::experimental::filesystem::path &file_name, size_t threads) : queue(4) {
+            setg(nullptr, nullptr, nullptr);
+            if(isBGZF(file_name)) {
+                worker = std::thread([this, file_name, threads] {decompressBGZF(file_name, std::max<size_t>(threads, 1));});
+            } else {
+                worker = std::thread([this, file_name] {decompressGzip(file_name, 0);});
+            }
+        }
+
+        ParallelGzStreambuf(const ParallelGzStreambuf &) = delete;
+        ParallelGzStreambuf &operator=(const ParallelGzStreambuf &) = delete;
+
+        ~ParallelGzStreambuf() override {
+            queue.close();
+            if(worker.joinable())
+                worker.join();
+        }
+
+        static bool isBGZF(const std::experimental::filesystem::path &file_name) {
+            FILE *f = fopen(file_name.c_str(), "rb");
+            if(f == nullptr)
+                return false;
+            std::vector<char> block;
+            bool res = readBlock(f, block);
+            fclose(f);
+            return res;
+        }
+
+    protected:
+        int underflow() override {
+            if(gptr() < egptr())
+                return traits_type::to_int_type(*gptr());
+            do {
+                if(!queue.pop(current)) {
+                    std::string error = queue.error();
+                    VERIFY_MSG(error.empty(), error);
+                    setg(nullptr, nullptr, nullptr);
+                    return traits_type::eof();
+                }
+            } while(current.empty());
+            setg(current.data(), current.data(), current.data() + current.size());
+            return traits_type::to_int_type(*gptr());
+        }
+    };
+
+    class ParallelGzStream : public std::istream {
+    private:
+        ParallelGzStreambuf buf;
+    public:
+        ParallelGzStream(const std::experimental::filesystem::path &file_name, size_t threads) :
+                std::istream(nullptr), buf(file_name, threads) {
+            rdbuf(&buf);
+        }
+    };
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#include "seqio.hpp"
+#include "mapped_reader.hpp"
+#include "contigs.hpp"
+#include "common/logging.hpp"
+#include "common/omp_utils.hpp"
+#include "common/verify.hpp"
+#include <experimental/filesystem>
+#include <omp.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace io {
+
+    //Read after homopolymer and dimer compression. Provides the same interface as StringContig so that
+    //read processing code can be applied to both raw and cached reads.
+    struct CompressedRead {
+        std::string id;
+        Sequence seq;
+
+        CompressedRead() = default;
+        CompressedRead(std::string _id, Sequence _seq) : id(std::move(_id)), seq(std::move(_seq)) {}
+
+        Sequence makeSequence() const {return seq;}
+        Contig makeContig() const {return {seq, id};}
+        size_t size() const {return seq.size();}
+        bool isNull() const {return id.empty() && seq.empty();}
+    };
+
+    //Binary file with compressed reads stored 2 bits per nucleotide. It is written once per library and then
+    //read through a memory mapping, so later passes over the reads skip both parsing and compression.
+    //Long reads are split into pieces in raw coordinates before compression, so reads that may be split also keep
+    //their raw sequence. The cache is built for the shortest read length that may be split.
+    //File layout: header, library signature, records (id size, sequence size, raw size, stored raw size, id, packed
+    //sequence, raw sequence) and record offsets at the end. All fields are aligned to 8 bytes.
+    class ReadCache {
+    private:
+        struct Header {
+            char magic[8];
+            uint64_t homopolymer_compressing;
+            uint64_t min_dimer_to_compress;
+            uint64_t max_dimer_size;
+            uint64_t dimer_step;
+            uint64_t split_length;
+            uint64_t signature_size;
+            uint64_t read_num;
+            uint64_t index_offset;
+        };
+        static const char *magic() {
+            return "LJAHPC02";
+        }
+
+        MappedFile file;
+        const Header *header;
+        const uint64_t *index;
+
+        static size_t align(size_t size) {
+            return (size + 7) / 8 * 8;
+        }
+
+        static Header currentHeader() {
+            Header res{};
+            memcpy(res.magic, magic(), sizeof(res.magic));
+            res.homopolymer_compressing = StringContig::homopolymer_compressing;
+            res.min_dimer_to_compress = StringContig::min_dimer_to_compress;
+            res.max_dimer_size = StringContig::max_dimer_size;
+            res.dimer_step = StringContig::dimer_step;
+            return res;
+        }
+
+        static bool sameParameters(const Header &a, const Header &b) {
+            return memcmp(a.magic, b.magic, sizeof(a.magic)) == 0 &&
+                   a.homopolymer_compressing == b.homopolymer_compressing &&
+                   a.min_dimer_to_compress == b.min_dimer_to_compress &&
+                   a.max_dimer_size == b.max_dimer_size && a.dimer_step == b.dimer_step;
+        }
+
+        //Cache is invalidated if any of the library files is changed
+        static std::string signature(const Library &lib) {
+            std::stringstream ss;
+            for(const std::experimental::filesystem::path &path : lib) {
+                ss << std::experimental::filesystem::absolute(path).string() << "\t"
+                   << std::experimental::filesystem::file_size(path) << "\t"
+                   << std::experimental::filesystem::last_write_time(path).time_since_epoch().count() << "\n";
+            }
+            return ss.str();
+        }
+
+        static void writeAligned(std::ofstream &os, const char *data, size_t size) {
+            static const char zeros[8] = {};
+            os.write(data, size);
+            os.write(zeros, align(size) - size);
+        }
+
+    public:
+        class Iterator {
+        private:
+            const ReadCache *cache;
+            size_t pos;
+            size_t min_read_size;
+            size_t overlap;
+            CompressedRead next;
+            size_t cur_start = 0;
+            size_t cur_end = 0;
+
+            size_t raw_size = 0;
+
+            //Long reads are split into overlapping pieces of the raw read the same way as SeqReader does it
+            void chooseNextPos(size_t start) {
+                cur_start = start;
+                if(raw_size > start + 2 * min_read_size - overlap) {
+                    cur_end = start + min_read_size;
+                } else {
+                    cur_end = raw_size;
+                }
+            }
+
+            void load() {
+                if(pos < cache->size()) {
+                    next = (*cache)[pos];
+                    raw_size = cache->rawSize(pos);
+                    chooseNextPos(0);
+                }
+            }
+        public:
+            typedef CompressedRead value_type;
+
+            Iterator(const ReadCache &_cache, size_t _pos, size_t _min_read_size, size_t _overlap) :
+                    cache(&_cache), pos(_pos), min_read_size(_min_read_size), overlap(_overlap) {
+                VERIFY_MSG(min_read_size * 2 - overlap >= cache->header->split_length,
+                           "Read cache was built for splitting reads longer than " << cache->header->split_length);
+                load();
+            }
+
+            void operator++() {
+                if(cur_end < raw_size) {
+                    chooseNextPos(cur_end - overlap);
+                    return;
+                }
+                pos++;
+                load();
+            }
+
+            CompressedRead operator*() const {
+                if(cur_start != 0 || cur_end != raw_size) {
+                    StringContig piece(cache->rawSequence(pos).substr(cur_start, cur_end - cur_start),
+                                       next.id + "_" + std::to_string(cur_start));
+                    return {piece.id, piece.makeSequence()};
+                }
+                return next;
+            }
+
+            bool operator==(const Iterator &other) const {
+                return pos == other.pos && (pos == cache->size() || cur_start == other.cur_start);
+            }
+
+            bool operator!=(const Iterator &other) const {
+                return !(*this == other);
+            }
+        };
+
+        class Range {
+        private:
+            const ReadCache &cache;
+            size_t min_read_size;
+            size_t overlap;
+        public:
+            Range(const ReadCache &_cache, size_t _min_read_size, size_t _overlap) :
+                    cache(_cache), min_read_size(_min_read_size), overlap(_overlap) {
+                VERIFY(min_read_size >= overlap * 2);
+            }
+
+            Iterator begin() const {return {cache, 0, min_read_size, overlap};}
+            Iterator end() const {return {cache, cache.size(), min_read_size, overlap};}
+        };
+
+        explicit ReadCache(const std::experimental::filesystem::path &file_name) : file(file_name) {
+            VERIFY_MSG(isCache(file_name), "File " + file_name.string() + " is not a read cache");
+            header = reinterpret_cast<const Header *>(file.data());
+            VERIFY_MSG(sameParameters(*header, currentHeader()),
+                       "Read cache " + file_name.string() + " was built with different compression parameters");
+            VERIFY(header->index_offset + header->read_num * sizeof(uint64_t) <= file.size());
+            index = reinterpret_cast<const uint64_t *>(file.data() + header->index_offset);
+        }
+
+        size_t size() const {
+            return header->read_num;
+        }
+
+        CompressedRead operator[](size_t ind) const {
+            const char *rec = file.data() + index[ind];
+            const auto *sizes = reinterpret_cast<const uint64_t *>(rec);
+            const char *id = rec + 4 * sizeof(uint64_t);
+            const auto *words = reinterpret_cast<const uint64_t *>(id + align(sizes[0]));
+            return {std::string(id, id + sizes[0]), Sequence::FromPacked(words, sizes[1])};
+        }
+
+        //Length of the read before compression.
+        size_t rawSize(size_t ind) const {
+            return reinterpret_cast<const uint64_t *>(file.data() + index[ind])[2];
+        }
+
+        //Read before compression. Only stored for reads longer than the split length of the cache.
+        std::string rawSequence(size_t ind) const {
+            const char *rec = file.data() + index[ind];
+            const auto *sizes = reinterpret_cast<const uint64_t *>(rec);
+            VERIFY(sizes[3] == sizes[2]);
+            const char *raw = rec + 4 * sizeof(uint64_t) + align(sizes[0]) + (sizes[1] + 31) / 32 * sizeof(uint64_t);
+            return {raw, raw + sizes[3]};
+        }
+
+        Iterator begin() const {return {*this, 0, size_t(-1) / 2, size_t(-1) / 8};}
+        Iterator end() const {return {*this, size(), size_t(-1) / 2, size_t(-1) / 8};}
+
+        Range reads(size_t min_read_size, size_t overlap) const {
+            return {*this, min_read_size, overlap};
+        }
+
+        static bool isCache(const std::experimental::filesystem::path &file_name) {
+            std::ifstream is(file_name, std::ios::binary);
+            char buf[8] = {};
+            is.read(buf, sizeof(buf));
+            return is && memcmp(buf, magic(), sizeof(buf)) == 0;
+        }
+
+        static bool isCache(const Library &lib) {
+            return lib.size() == 1 && isCache(lib.front());
+        }
+
+        //Shortest read that SeqReader splits into pieces with these parameters.
+        static size_t splitLength(size_t min_read_size, size_t overlap) {
+            return 2 * min_read_size - overlap;
+        }
+
+        //Checks that cache exists and was built from the same library with the same compression parameters and can
+        //split reads of the given length
+        static bool isValid(const std::experimental::filesystem::path &file_name, const Library &lib,
+                            size_t split_length = size_t(-1)) {
+            if(!std::experimental::filesystem::is_regular_file(file_name) || !isCache(file_name))
+                return false;
+            MappedFile mapped(file_name);
+            if(mapped.size() < sizeof(Header))
+                return false;
+            Header stored{};
+            memcpy(&stored, mapped.data(), sizeof(Header));
+            std::string sig = signature(lib);
+            return sameParameters(stored, currentHeader()) && stored.split_length <= split_length &&
+                   stored.signature_size == sig.size() &&
+                   sizeof(Header) + align(sig.size()) <= mapped.size() &&
+                   memcmp(mapped.data() + sizeof(Header), sig.data(), sig.size()) == 0 &&
+                   stored.index_offset + stored.read_num * sizeof(uint64_t) == mapped.size();
+        }
+
+        //Compresses reads from the library in parallel batches and writes them to file_name in the original order.
+        static void build(logging::Logger &logger, size_t threads, const Library &lib,
+                          const std::experimental::filesystem::path &file_name, size_t split_length) {
+            logger.info() << "Writing compressed reads to binary cache " << file_name << std::endl;
+            std::experimental::filesystem::path tmp_name = file_name.string() + ".tmp";
+            std::ofstream os(tmp_name, std::ios::binary);
+            Header header = currentHeader();
+            header.split_length = split_length;
+            std::string sig = signature(lib);
+            header.signature_size = sig.size();
+            os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            writeAligned(os, sig.data(), sig.size());
+            size_t offset = sizeof(Header) + align(sig.size());
+            std::vector<uint64_t> offsets;
+            size_t total_len = 0;
+            const size_t batch_len = size_t(1) << 28u;
+            io::SeqReader reader(lib);
+            while(!reader.eof()) {
+                std::vector<StringContig> batch;
+                size_t len = 0;
+                while(!reader.eof() && len < batch_len) {
+                    batch.emplace_back(reader.read());
+                    len += batch.back().size();
+                }
+                std::vector<std::vector<uint64_t>> packed(batch.size());
+                std::vector<size_t> sizes(batch.size());
+                std::vector<std::string> raw(batch.size());
+                std::vector<size_t> raw_sizes(batch.size());
+#pragma omp parallel for schedule(dynamic, 16) num_threads(threads) default(none) shared(batch, packed, sizes, raw, raw_sizes, split_length)
+                for(size_t i = 0; i < batch.size(); i++) {
+                    raw_sizes[i] = batch[i].size();
+                    if(batch[i].size() > split_length)
+                        raw[i] = batch[i].seq;
+                    Sequence seq = batch[i].makeSequence();
+                    sizes[i] = seq.size();
+                    packed[i] = seq.packed();
+                }
+                for(size_t i = 0; i < batch.size(); i++) {
+                    offsets.push_back(offset);
+                    VERIFY(packed[i].size() == (sizes[i] + 31) / 32);
+                    uint64_t rec_sizes[4] = {batch[i].id.size(), sizes[i], raw_sizes[i], raw[i].size()};
+                    os.write(reinterpret_cast<const char *>(rec_sizes), sizeof(rec_sizes));
+                    writeAligned(os, batch[i].id.data(), batch[i].id.size());
+                    os.write(reinterpret_cast<const char *>(packed[i].data()), packed[i].size() * sizeof(uint64_t));
+                    writeAligned(os, raw[i].data(), raw[i].size());
+                    offset += sizeof(rec_sizes) + align(batch[i].id.size()) + packed[i].size() * sizeof(uint64_t) +
+                              align(raw[i].size());
+                    total_len += sizes[i];
+                }
+            }
+            os.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+            header.read_num = offsets.size();
+            header.index_offset = offset;
+            os.seekp(0);
+            os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            os.close();
+            VERIFY_MSG(!os.fail(), "Failed to write read cache " + tmp_name.string());
+            std::experimental::filesystem::rename(tmp_name, file_name);
+            logger.info() << "Cached " << offsets.size() << " reads with total compressed length " << total_len << std::endl;
+        }
+
+        //Returns library that consists of the cache file, building the cache if it is missing or outdated.
+        //Reads longer than split_length keep their raw sequence so that they can be split later.
+        static Library prepare(logging::Logger &logger, size_t threads, const Library &lib,
+                               const std::experimental::filesystem::path &file_name, size_t split_length) {
+            if(isValid(file_name, lib, split_length)) {
+                logger.info() << "Using compressed reads from binary cache " << file_name << std::endl;
+            } else {
+//                OpenMP thread pool does not survive fork so parallel compression runs in a separate process unless
+//                later stages run without fork isolation too
+                runIsolated([&logger, threads, &lib, &file_name, split_length] {
+                    build(logger, threads, lib, file_name, split_length);
+                });
+            }
+            return {file_name};
+        }
+    };
+
+    //Calls f(begin, end) with iterators over reads of the library. Libraries that consist of a read cache are read
+    //from the cache, others are parsed with SeqReader. Long reads are split in the same way in both cases.
+    template<class F>
+    void ProcessReads(const Library &lib, size_t min_read_size, size_t overlap, F &&f) {
+        if(ReadCache::isCache(lib)) {
+            ReadCache cache(lib.front());
+            ReadCache::Range range = cache.reads(min_read_size, overlap);
+            f(range.begin(), range.end());
+        } else {
+            SeqReader reader(lib, min_read_size, overlap);
+            f(reader.begin(), reader.end());
+        }
+    }
+
+    template<class F>
+    void ProcessReads(const Library &lib, F &&f) {
+        ProcessReads(lib, size_t(-1) / 2, size_t(-1) / 8, std::forward<F>(f));
+    }
+}
@@ -1,14 +1,17 @@
 #pragma once
 
 #include "common/string_utils.hpp"
-#include "stream.hpp"
+#include "parallel_gz.hpp"
 #include "contigs.hpp"
+#include "mapped_reader.hpp"
+#include "memory_files.hpp"
 #include <experimental/filesystem>
 #include <iterator>
 #include <string>
 #include <utility>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <utility>
 
 namespace io {
@@ -19,7 +22,7 @@ namespace io {
     inline bool CheckLibrary(const Library &lib) {
         bool res = true;
         for(const std::experimental::filesystem::path &path : lib) {
-            if(!std::experimental::filesystem::is_regular_file(path)) {
+            if(!std::experimental::filesystem::is_regular_file(path) && MemoryFiles::get(path) == nullptr) {
                 std::cerr << "Input file not found: " << path << std::endl;
                 res = false;
             }
@@ -112,7 +115,29 @@ namespace io {
                 choose_next_pos(cur_end - overlap);
                 return;
             }
-            while (stream != nullptr){
+            while (stream != nullptr || mapped != nullptr || memory != nullptr){
+                if(memory != nullptr) {
+                    if(mapped_pos < memory->size()) {
+                        next = StringContig((*memory)[mapped_pos]);
+                        mapped_pos += 1;
+                        choose_next_pos(0);
+                        cur_start = 0;
+                        return;
+                    }
+                    nextFile();
+                    continue;
+                }
+                if(mapped != nullptr) {
+                    if(mapped_pos < mapped->size()) {
+                        next = (*mapped)[mapped_pos].makeStringContig();
+                        mapped_pos += 1;
+                        choose_next_pos(0);
+                        cur_start = 0;
+                        return;
+                    }
+                    nextFile();
+                    continue;
+                }
                 std::string id, seq;
                 std::getline(*stream, id);
                 std::getline(*stream, seq);
@@ -155,20 +180,29 @@ namespace io {
 
         void nextFile() {
             delete stream;
+            stream = nullptr;
+            mapped.reset();
+            memory.reset();
+            mapped_pos = 0;
             if (file_it == lib.end()) {
                 stream = nullptr;
             } else {
                 std::experimental::filesystem::path file_name = *file_it;
+                memory = MemoryFiles::get(file_name);
+                if(memory != nullptr) {
+                    ++file_it;
+                    return;
+                }
                 if(!std::experimental::filesystem::is_regular_file(file_name)) {
                     std::cerr << "Error: file does not exist " << file_name << std::endl;
                 }
                 VERIFY(std::experimental::filesystem::is_regular_file(file_name));
                 if (endsWith(file_name, ".gz")) {
-                    stream = new gzstream::igzstream(file_name.c_str());
+                    stream = new ParallelGzStream(file_name, omp_get_max_threads());
                     fastq = endsWith(file_name, "fastq.gz") or endsWith(file_name, "fq.gz");
                 } else {
-                    stream = new std::ifstream(file_name);
                     fastq = endsWith(file_name, "fastq") or endsWith(file_name, "fq");
+                    mapped.reset(new MappedRecords(file_name, fastq, omp_get_max_threads()));
                 }
                 ++file_it;
             }
@@ -177,6 +211,11 @@ namespace io {
         const Library lib;
         Library::const_iterator file_it;
         std::istream * stream{};
+//        Uncompressed files are memory mapped and indexed instead of being parsed line by line
+        std::unique_ptr<MappedRecords> mapped{};
+//        Files registered in MemoryFiles are read from memory
+        MemoryFiles::Records memory{};
+        size_t mapped_pos = 0;
         bool fastq{};
         size_t min_read_size;
         size_t overlap;
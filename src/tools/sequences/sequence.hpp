@@ -3,7 +3,9 @@
 #include "common/oneline_utils.hpp"
 #include "common/output_utils.hpp"
 #include "nucl.hpp"
+#include "nucl_kernels.hpp"
 #include "IntrusiveRefCntPtr.h"
+#include "nucl_arena.hpp"
 #include "common/verify.hpp"
 #include <functional>
 #include <vector>
@@ -37,41 +39,93 @@ class Sequence {
     // Number of bits in STN (for faster div and mod)
     const static size_t STNBits = log_<STN, 2>::value;
 
-    class ManagedNuclBuffer final : public llvm::ThreadSafeRefCountedBase<ManagedNuclBuffer> {
-    public:
-        explicit ManagedNuclBuffer(size_t nucls) : _data(new ST[Sequence::DataSize(nucls)]) {
-        }
-
-        ManagedNuclBuffer(size_t nucls, ST *buf) : _data(new ST[Sequence::DataSize(nucls)]) {
-            std::uninitialized_copy(buf, buf + Sequence::DataSize(nucls), data());
-        }
-
-    private:
-        ST *_data;
-    public:
-        const ST *data() const { return _data; }
-
-        ST *data() { return _data; }
-
-        ~ManagedNuclBuffer() {
-            delete[] _data;
-        }
-
-    };
+    // Number of words stored inside the Sequence object instead of a shared buffer
+    const static size_t InlineWords = 2;
 
     size_t from_;
     size_t size_;
     bool rtl_; // Right to left + complimentary (?)
-    llvm::IntrusiveRefCntPtr<ManagedNuclBuffer> data_;
+    // Sequences of at most InlineWords * STN nucleotides always keep their words inline, without a buffer
+    bool inline_;
+    union {
+        struct {
+            ST *bytes;
+            NuclStorage *owner;
+        } ext_;
+        ST inline_words_[InlineWords];
+    };
 
     static size_t DataSize(size_t size) {
         return (size + STN - 1) >> STNBits;
     }
 
+    static bool FitsInline(size_t size) {
+        return DataSize(size) <= InlineWords;
+    }
+
+    const ST *words() const {
+        return inline_ ? inline_words_ : ext_.bytes;
+    }
+
+    ST *words() {
+        return inline_ ? inline_words_ : ext_.bytes;
+    }
+
+    //Words borrowed from a NuclArena have no owner to count references in
+    void retain() const {
+        if (!inline_ && ext_.owner != nullptr)
+            ext_.owner->Retain();
+    }
+
+    void release() const {
+        if (!inline_ && ext_.owner != nullptr)
+            ext_.owner->Release();
+    }
+
+    void setInline() {
+        inline_ = true;
+        for (ST &word : inline_words_)
+            word = 0;
+    }
+
+    void setExternal(ST *bytes, NuclStorage *owner) {
+        inline_ = false;
+        ext_.bytes = bytes;
+        ext_.owner = owner;
+        retain();
+    }
+
+    // Copies nucleotides [from, from + size) of the words into the inline words starting from position 0
+    void copyInline(const ST *bytes, size_t from, size_t size) {
+        size_t first = from >> STNBits;
+        size_t last = (from + size + STN - 1) >> STNBits;
+        size_t shift = (from & (STN - 1u)) << 1u;
+        for (size_t i = 0; i < InlineWords; i++) {
+            ST word = first + i < last ? bytes[first + i] : 0;
+            ST next = first + i + 1 < last ? bytes[first + i + 1] : 0;
+            inline_words_[i] = shift == 0 ? word : (word >> shift) | (next << (STBits - shift));
+        }
+    }
+
+    void steal(Sequence &other) {
+        from_ = other.from_;
+        size_ = other.size_;
+        rtl_ = other.rtl_;
+        inline_ = other.inline_;
+        if (inline_)
+            std::copy(other.inline_words_, other.inline_words_ + InlineWords, inline_words_);
+        else
+            ext_ = other.ext_;
+        other.from_ = 0;
+        other.size_ = 0;
+        other.rtl_ = false;
+        other.setInline();
+    }
+
     template<typename S>
     void InitFromNucls(const S &s, bool rc = false) {
         size_t bytes_size = DataSize(size_);
-        ST *bytes = data_->data();
+        ST *bytes = words();
         if(size_ > 0 && (!(is_dignucl(s[0]) || is_nucl(s[0])))) {
             std::cerr << "Bad nucleotide sequence " << size_ << " " << s << std::endl;
         }
@@ -80,6 +134,16 @@ class Sequence {
         // Which symbols does our string contain : 0123 or ACGT?
         bool digit_str = size_ == 0 || is_dignucl(s[0]);
 
+        if (!digit_str) {
+            const char *chars = reinterpret_cast<const char *>(&s[0]);
+            const nucl_kernels::Kernels &kernels = nucl_kernels::GetKernels();
+            if (rc)
+                kernels.packRC(chars, size_, bytes);
+            else
+                kernels.pack(chars, size_, bytes);
+            return;
+        }
+
         // data -- one temporary variable corresponding to the i-th array element
         // and some counters
         ST data = 0;
@@ -124,11 +188,36 @@ class Sequence {
     }
 
     Sequence(size_t size, int)
-            : from_(0), size_(size), rtl_(false), data_(new ManagedNuclBuffer(size_)) {}
+            : from_(0), size_(size), rtl_(false) {
+        if (FitsInline(size_)) {
+            setInline();
+        } else {
+            ManagedNuclBuffer *buffer = ManagedNuclBuffer::create(DataSize(size_));
+            setExternal(buffer->data(), buffer);
+        }
+    }
 
-    //Low level constructor. Handle with care.
+    Sequence(size_t size, NuclArena &arena)
+            : from_(0), size_(size), rtl_(false) {
+        if (FitsInline(size_))
+            setInline();
+        else
+            setExternal(arena.allocate(DataSize(size_)), nullptr);
+    }
+
+    //Low level constructor. Handle with care. Short subsequences are copied inline instead of sharing the buffer.
     Sequence(const Sequence &seq, size_t from, size_t size, bool rtl)
-            : from_(from), size_(size), rtl_(rtl), data_(seq.data_) {}
+            : from_(from), size_(size), rtl_(rtl) {
+        if (FitsInline(size_)) {
+            inline_ = true;
+            copyInline(seq.words(), from_, size_);
+            from_ = 0;
+        } else {
+            inline_ = false;
+            ext_ = seq.ext_;
+            retain();
+        }
+    }
 
 public:
     /**
@@ -163,41 +252,142 @@ public:
 
     Sequence()
             : Sequence(size_t(0), 0) {
-        memset(data_->data(), 0, DataSize(size_));
     }
 
     Sequence(const Sequence &s)
-            : Sequence(s, s.from_, s.size_, s.rtl_) {}
+            : from_(s.from_), size_(s.size_), rtl_(s.rtl_), inline_(s.inline_) {
+        if (inline_)
+            std::copy(s.inline_words_, s.inline_words_ + InlineWords, inline_words_);
+        else
+            ext_ = s.ext_;
+        retain();
+    }
+
+    Sequence(Sequence &&other) noexcept {
+        steal(other);
+    }
+
+    ~Sequence() {
+        release();
+    }
 
+    //Packs all parts directly into a single buffer
     static Sequence Concat(const std::vector<Sequence> &v) {
-        std::stringstream ss;
+        size_t size = 0;
         for(const auto &seq : v) {
-            ss << seq.str();
+            size += seq.size();
         }
-        return Sequence(ss.str());
+        Sequence res(size, 0);
+        ST *bytes = res.words();
+        std::fill(bytes, bytes + DataSize(size), 0);
+        size_t pos = 0;
+        for(const auto &seq : v) {
+            View view = seq.view();
+            for (size_t i = 0; i < view.size(); i++, pos++)
+                bytes[pos >> STNBits] |= ST(view[i]) << ((pos & (STN - 1u)) << 1u);
+        }
+        return res;
     }
 
     Sequence &operator=(const Sequence &rhs) {
         if (&rhs == this)
             return *this;
 
+        rhs.retain();
+        release();
         from_ = rhs.from_;
         size_ = rhs.size_;
         rtl_ = rhs.rtl_;
-        data_ = rhs.data_;
+        inline_ = rhs.inline_;
+        if (inline_)
+            std::copy(rhs.inline_words_, rhs.inline_words_ + InlineWords, inline_words_);
+        else
+            ext_ = rhs.ext_;
 
         return *this;
     }
 
-    Sequence &operator=(Sequence &&other) = default;
+    Sequence &operator=(Sequence &&other) noexcept {
+        if (&other == this)
+            return *this;
+        release();
+        steal(other);
+        return *this;
+    }
 
     Sequence copy() const {
         return Sequence(str());
     }
 
+    //Copy that borrows its words from the arena, see NuclArena
+    Sequence copy(NuclArena &arena) const {
+        Sequence res(size_, arena);
+        ST *bytes = res.words();
+        std::fill(bytes, bytes + DataSize(size_), 0);
+        View nucls = view();
+        for (size_t i = 0; i < size_; i++)
+            bytes[i >> STNBits] |= ST(nucls[i]) << ((i & (STN - 1u)) << 1u);
+        return res;
+    }
+
+    //Packed representation: 2 bits per nucleotide, i-th nucleotide is stored in bits 2*(i%32) of word i/32
+    static Sequence FromPacked(const u_int64_t *words, size_t size) {
+        Sequence res(size, 0);
+        std::copy(words, words + DataSize(size), res.words());
+        return res;
+    }
+
+    //Same as FromPacked but the words are stored in the arena instead of a separate buffer
+    static Sequence FromPacked(const u_int64_t *words, size_t size, NuclArena &arena) {
+        Sequence res(size, arena);
+        std::copy(words, words + DataSize(size), res.words());
+        return res;
+    }
+
+    std::vector<u_int64_t> packed() const {
+        if(from_ != 0 || rtl_)
+            return copy().packed();
+        const ST *bytes = words();
+        std::vector<u_int64_t> res(bytes, bytes + DataSize(size_));
+        if(!res.empty() && size_ % STN != 0)
+            res.back() &= (ST(1) << ((size_ % STN) << 1u)) - 1;
+        return std::move(res);
+    }
+
+    //Borrowed read-only access to the nucleotides without reference counting and bounds checks.
+    //The view is valid only while the buffer of the sequence it was taken from is alive. Short sequences store their
+    //words inline, so for them the view is valid only while that Sequence object is alive and not moved.
+    class View {
+        const ST *bytes_;
+        size_t from_;
+        size_t size_;
+        bool rtl_;
+    public:
+        View(const ST *bytes, size_t from, size_t size, bool rtl) : bytes_(bytes), from_(from), size_(size), rtl_(rtl) {
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        unsigned char operator[](const size_t index) const {
+            if (rtl_) {
+                size_t i = from_ + size_ - 1 - index;
+                return ((bytes_[i >> STNBits] >> ((i & (STN - 1u)) << 1u)) & 3u) ^ 3u;
+            } else {
+                size_t i = from_ + index;
+                return (bytes_[i >> STNBits] >> ((i & (STN - 1u)) << 1u)) & 3u;
+            }
+        }
+    };
+
+    View view() const {
+        return {words(), from_, size_, rtl_};
+    }
+
     unsigned char operator[](const size_t index) const {
         VERIFY(index < size_);
-        const ST *bytes = data_->data();
+        const ST *bytes = words();
         if (rtl_) {
             size_t i = from_ + size_ - 1 - index;
             return complement((bytes[i >> STNBits] >> ((i & (STN - 1u)) << 1u)) & 3u);
@@ -209,7 +399,7 @@ public:
 
     size_t asNumber() const {
         size_t res = 0;
-        const ST *bytes = data_->data();
+        const ST *bytes = words();
         if (rtl_) {
             for(size_t i = from_ + size_ - 1; i + 1 >= from_ + 1; i++) {
                 res = (res << 2u) + (complement((bytes[i >> STNBits] >> ((i & (STN - 1u)) << 1u)) & 3u));
@@ -227,7 +417,7 @@ public:
         if (size_ != that.size_)
             return false;
 
-        if (data_ == that.data_ && from_ == that.from_ && rtl_ == that.rtl_)
+        if (words() == that.words() && from_ == that.from_ && rtl_ == that.rtl_)
             return true;
 
         for (size_t i = 0; i < size_; ++i) {
@@ -306,11 +496,24 @@ public:
     }
 
     bool startsWith(const Sequence & other) const {
-        return (other.size() <= size()) && (Subseq(0, other.size()) == other);
+        if (other.size() > size())
+            return false;
+        for (size_t i = 0; i < other.size(); i++) {
+            if (this->operator[](i) != other[i])
+                return false;
+        }
+        return true;
     }
 
     bool endsWith(const Sequence & other) const {
-        return (other.size() <= size()) && (Subseq(size() - other.size(), size()) == other);
+        if (other.size() > size())
+            return false;
+        size_t shift = size() - other.size();
+        for (size_t i = 0; i < other.size(); i++) {
+            if (this->operator[](shift + i) != other[i])
+                return false;
+        }
+        return true;
     }
 
     bool nonContradicts(const Sequence & other) const {
@@ -381,7 +584,7 @@ Sequence Sequence::Suffix(size_t count) const {
  * @todo optimize sequence copy
  */
 Sequence Sequence::operator+(const Sequence &s) const {
-    if (data_ == s.data_ && rtl_ == s.rtl_ &&
+    if (words() == s.words() && rtl_ == s.rtl_ &&
             (
                 (!rtl_ && this->from_ + size_ == s.from_ ) ||
                 (rtl_ && this->from_ == s.from_ + s.size_)
@@ -405,7 +608,7 @@ std::string Sequence::str() const {
 
 std::string Sequence::err() const {
     std::ostringstream oss;
-    oss << "{ *data=" << data_->data() <<
+    oss << "{ *data=" << words() <<
         ", from_=" << from_ <<
         ", size_=" << size_ <<
         ", rtl_=" << int(rtl_) << " }";